@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <lwip/sockets.h>
 
+#include "TFGenericTCPSubmitQueue.h"
 #include "TFNetwork.h"
 
 #define debugfln(fmt, ...) tf_network_debugfln("TFGenericTCPClient[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
@@ -283,6 +284,13 @@ TFGenericTCPClientConnectionStatus TFGenericTCPClient::get_connection_status() c
     return TFGenericTCPClientConnectionStatus::Disconnected;
 }
 
+int TFGenericTCPClient::get_wait_socket_fd(bool *writable) const
+{
+    *writable = socket_fd < 0 && pending_socket_fd >= 0;
+
+    return socket_fd >= 0 ? socket_fd : pending_socket_fd;
+}
+
 // non-reentrant
 void TFGenericTCPClient::tick()
 {
@@ -291,6 +299,10 @@ void TFGenericTCPClient::tick()
         return;
     }
 
+    if (submit_queue != nullptr) {
+        submit_queue->drain();
+    }
+
     TFNetwork::NonReentrantScope scope(&non_reentrant);
 
     if (host == nullptr) {
@@ -364,6 +376,7 @@ void TFGenericTCPClient::tick()
             addr_in.sin_family = AF_INET;
             addr_in.sin_port   = htons(port);
 
+            host_address         = pending_host_address;
             pending_host_address = 0;
 
             if (::connect(pending_socket_fd, reinterpret_cast<struct sockaddr *>(&addr_in), sizeof(addr_in)) < 0 && errno != EINPROGRESS) {
@@ -459,6 +472,7 @@ void TFGenericTCPClient::close()
     disconnect_callback = nullptr;
     resolve_pending = false;
     pending_host_address = 0;
+    host_address = 0;
 
     close_hook();
 }
@@ -537,3 +551,42 @@ void TFGenericTCPClient::disconnect(TFGenericTCPClientDisconnectReason reason, i
 
     disconnect_callback(reason, error_number);
 }
+
+void TFGenericTCPClient::record_request_result(bool success, bool timeout)
+{
+    ++statistics.request_count;
+
+    if (success) {
+        statistics.last_response = now_us();
+    }
+    else {
+        ++statistics.error_count;
+    }
+
+    if (timeout) {
+        ++statistics.timeout_count;
+    }
+}
+
+TFGenericTCPClient *TFGenericTCPSharedClient::select_client() const
+{
+    TFGenericTCPClient *selected_client = client;
+    size_t selected_count               = client->get_outstanding_request_count();
+
+    for (size_t i = 1; i < connection_count && selected_count > 0; ++i) {
+        TFGenericTCPClient *connection = connections[i];
+
+        if (connection->get_connection_status() != TFGenericTCPClientConnectionStatus::Connected) {
+            continue;
+        }
+
+        size_t count = connection->get_outstanding_request_count();
+
+        if (count < selected_count) {
+            selected_client = connection;
+            selected_count  = count;
+        }
+    }
+
+    return selected_client;
+}
@@ -106,6 +106,17 @@ typedef std::function<void(TFGenericTCPClientConnectResult result, int error_num
 typedef std::function<void(TFGenericTCPClientDisconnectReason reason, int error_number)> TFGenericTCPClientDisconnectCallback;
 
 struct TFGenericTCPClientTransferHook;
+struct TFGenericTCPClientPoolShare;
+class TFGenericTCPSubmitQueue;
+
+// Requests are counted once they got sent and finished, successful or not
+struct TFGenericTCPClientStatistics
+{
+    uint32_t request_count = 0;
+    uint32_t error_count   = 0; // including timeouts
+    uint32_t timeout_count = 0;
+    micros_t last_response = 0_s; // 0_s if no successful response was received yet
+};
 
 class TFGenericTCPClient
 {
@@ -123,9 +134,26 @@ public:
     TFGenericTCPClientDisconnectResult disconnect(); // non-reentrant
     const char *get_host() const { return host; }
     uint16_t get_port() const { return port; }
+    uint32_t get_host_address() const { return host_address; } // IPv4 only, 0 until resolved
     TFGenericTCPClientConnectionStatus get_connection_status() const;
+    virtual size_t get_outstanding_request_count() const = 0; // pending and scheduled requests
+    virtual size_t get_in_flight_request_count() const = 0; // pending requests
+    const TFGenericTCPClientStatistics &get_statistics() const { return statistics; }
     void tick(); // non-reentrant
 
+    // The queue is drained at the start of tick(), the functions posted by
+    // other threads run on the ticking thread
+    void set_submit_queue(TFGenericTCPSubmitQueue *queue) { submit_queue = queue; }
+
+    // For threads that block in select() between ticks. Returns the socket to
+    // wait on or -1 if there is none. While connecting writable is set, the
+    // socket becomes writable once the connect finished
+    int get_wait_socket_fd(bool *writable) const;
+
+    // True if the next tick() sends a scheduled request without waiting for
+    // the socket, then a thread must not block between ticks
+    virtual bool is_send_pending() const { return false; }
+
 protected:
     virtual void close_hook()   = 0;
     virtual void tick_hook()    = 0;
@@ -136,6 +164,7 @@ protected:
     ssize_t recv(uint8_t *buffer, size_t length);
     void abort_connect(TFGenericTCPClientConnectResult result, int error_number);
     void disconnect(TFGenericTCPClientDisconnectReason reason, int error_number);
+    void record_request_result(bool success, bool timeout);
 
     TFGenericTCPClientTransferHook *transfer_hook_head = nullptr;
     bool non_reentrant            = false;
@@ -147,9 +176,12 @@ protected:
     bool resolve_pending          = false;
     uint32_t resolve_id           = 0;
     uint32_t pending_host_address = 0; // IPv4 only
+    uint32_t host_address         = 0; // IPv4 only
     int pending_socket_fd         = -1;
     micros_t connect_deadline     = 0_s;
     int socket_fd                 = -1;
+    TFGenericTCPClientStatistics statistics;
+    TFGenericTCPSubmitQueue *submit_queue = nullptr;
 };
 
 class TFGenericTCPSharedClient
@@ -165,8 +197,29 @@ public:
     bool remove_transfer_hook(TFGenericTCPClientTransferHook *hook) { return client->remove_transfer_hook(hook); }
     const char *get_host() const { return client->get_host(); }
     uint16_t get_port() const { return client->get_port(); }
+    uint32_t get_host_address() const { return client->get_host_address(); }
     TFGenericTCPClientConnectionStatus get_connection_status() const { return client->get_connection_status(); }
 
+    // Scheduling weight relative to the other shared clients of the same
+    // connection, for clients that queue requests per shared client
+    void set_weight(uint32_t weight_) { weight = weight_ > 0 ? weight_ : 1; }
+    uint32_t get_weight() const { return weight; }
+
+protected:
+    // Returns the connected client with the fewest outstanding requests, if the
+    // pool maintains more than one connection to the endpoint. Falls back to
+    // the primary client otherwise
+    TFGenericTCPClient *select_client() const;
+
+    // Returns the primary client, for state that has to stay with one connection
+    TFGenericTCPClient *get_primary_client() const { return client; }
+
 private:
+    friend class TFGenericTCPClientPool;
+
     TFGenericTCPClient *client;
+    TFGenericTCPClient *const *connections  = nullptr; // connections[0] == client
+    size_t connection_count                 = 1;
+    TFGenericTCPClientPoolShare *pool_share = nullptr;
+    uint32_t weight                         = 1;
 };
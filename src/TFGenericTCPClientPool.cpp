@@ -19,8 +19,12 @@
 
 #include "TFGenericTCPClientPool.h"
 
-#include <sys/types.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lwip/sockets.h>
 
+#include "TFGenericTCPSubmitQueue.h"
 #include "TFNetwork.h"
 
 #define debugfln(fmt, ...) tf_network_debugfln("TFGenericTCPClientPool[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
@@ -41,10 +45,79 @@ const char *get_tf_generic_tcp_client_pool_share_level_name(TFGenericTCPClientPo
     return "<Unknown>";
 }
 
+static uint32_t hash_host(const char *host, uint16_t port)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (const char *p = host; *p != '\0'; ++p) {
+        hash = (hash ^ static_cast<uint8_t>(*p)) * 16777619u;
+    }
+
+    hash = (hash ^ (port & 0xFF)) * 16777619u;
+    hash = (hash ^ (port >> 8)) * 16777619u;
+
+    return hash;
+}
+
+static uint32_t hash_address(uint32_t host_address, uint16_t port)
+{
+    uint32_t hash = host_address ^ (static_cast<uint32_t>(port) << 16 | port);
+
+    // finalizer of MurmurHash3
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+TFGenericTCPClientPool::TFGenericTCPClientPool(size_t max_slot_count_, size_t max_share_count_) :
+    max_slot_count(max_slot_count_ > 0 ? max_slot_count_ : 1),
+    max_share_count(max_share_count_ > 0 ? max_share_count_ : 1),
+    slots(new TFGenericTCPClientPoolSlot *[max_slot_count]()),
+    free_slot_indices(new size_t[max_slot_count]),
+    free_slot_count(max_slot_count)
+{
+    size_t index_length = 1;
+
+    while (index_length < max_slot_count) {
+        index_length <<= 1;
+    }
+
+    index_mask    = index_length - 1;
+    host_index    = new TFGenericTCPClientPoolHost *[index_length]();
+    address_index = new TFGenericTCPClientPoolSlot *[index_length]();
+
+    // pop lower indices first
+    for (size_t i = 0; i < max_slot_count; ++i) {
+        free_slot_indices[i] = max_slot_count - 1 - i;
+    }
+}
+
+TFGenericTCPClientPool::~TFGenericTCPClientPool()
+{
+    for (size_t i = 0; i < max_slot_count; ++i) {
+        TFGenericTCPClientPoolSlot *slot = slots[i];
+
+        if (slot != nullptr) {
+            remove_hosts(slot);
+            delete slot;
+        }
+    }
+
+    delete[] address_index;
+    delete[] host_index;
+    delete[] free_slot_indices;
+    delete[] slots;
+}
+
 // non-reentrant
 void TFGenericTCPClientPool::acquire(const char *host, uint16_t port,
                                      TFGenericTCPClientPoolConnectCallback &&connect_callback,
-                                     TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback)
+                                     TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback,
+                                     size_t connection_count /*= 1*/)
 {
     if (!connect_callback) {
         debugfln("acquire(host=%s port=%u) invalid argument", TFNetwork::printf_safe(host), port);
@@ -59,7 +132,8 @@ void TFGenericTCPClientPool::acquire(const char *host, uint16_t port,
 
     TFNetwork::NonReentrantScope scope(&non_reentrant);
 
-    if (host == nullptr || strlen(host) == 0 || port == 0 || !disconnect_callback) {
+    if (host == nullptr || strlen(host) == 0 || port == 0 || !disconnect_callback
+     || connection_count < 1 || connection_count > TF_GENERIC_TCP_CLIENT_POOL_MAX_CONNECTION_COUNT) {
         debugfln("acquire(host=%s port=%u) invalid argument", TFNetwork::printf_safe(host), port);
         connect_callback(TFGenericTCPClientConnectResult::InvalidArgument, -1, nullptr, TFGenericTCPClientPoolShareLevel::Undefined);
         return;
@@ -67,157 +141,118 @@ void TFGenericTCPClientPool::acquire(const char *host, uint16_t port,
 
     debugfln("acquire(host=%s port=%u)", host, port);
 
-    ssize_t slot_index = -1;
-
-    for (size_t i = 0; i < TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT; ++i) {
-        TFGenericTCPClientPoolSlot *slot = slots[i];
-
-        if (slot == nullptr) {
-            if (slot_index < 0) {
-                slot_index = i;
-            }
-
-            continue;
-        }
+    uint32_t hash = hash_host(host, port);
+    TFGenericTCPClientPoolSlot *slot = find_slot_by_host(host, port, hash);
 
-        if (slot->delete_pending) {
-            if (slot_index < 0 || slots[slot_index] == nullptr) {
-                slot_index = i;
-            }
+    if (slot != nullptr) {
+        ssize_t share_index = -1;
 
-            continue;
-        }
+        debugfln("acquire(host=%s port=%u) found matching existing slot (slot_index=%zu client=%p)",
+                 host, port, slot->index, static_cast<void *>(slot->client));
 
-        debugfln("acquire(host=%s port=%u) checking existing slot (slot_index=%zu client=%p host=%s port=%u)",
-                 host, port, i, static_cast<void *>(slot->client), slot->client->get_host(), slot->client->get_port());
-
-        if (strcmp(slot->client->get_host(), host) == 0 && slot->client->get_port() == port) {
-            ssize_t share_index = -1;
-
-            debugfln("acquire(host=%s port=%u) found matching existing slot (slot_index=%zu client=%p)",
-                     host, port, i, static_cast<void *>(slot->client));
-
-            for (size_t k = 0; k < TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT; ++k) {
+        if (slot->share_count < max_share_count) {
+            for (size_t k = 0; k < max_share_count; ++k) {
                 if (slot->shares[k] == nullptr) {
                     share_index = k;
                     break;
                 }
             }
+        }
 
-            if (share_index < 0) {
-                connect_callback(TFGenericTCPClientConnectResult::NoFreePoolShare, -1, nullptr, TFGenericTCPClientPoolShareLevel::Undefined);
-                return;
-            }
-
-            TFGenericTCPClientPoolShare *share = new TFGenericTCPClientPoolShare;
-            share->shared_client = create_shared_client(slot->client);
-
-            if (slot->client->get_connection_status() == TFGenericTCPClientConnectionStatus::Connected) {
-                share->disconnect_callback = std::move(disconnect_callback);
-                connect_callback(TFGenericTCPClientConnectResult::Connected, -1, share->shared_client, TFGenericTCPClientPoolShareLevel::Secondary);
-            }
-            else {
-                share->connect_callback = std::move(connect_callback);
-                share->pending_disconnect_callback = std::move(disconnect_callback);
-            }
-
-            slot->shares[share_index] = share;
-            ++slot->share_count;
+        if (share_index < 0) {
+            connect_callback(TFGenericTCPClientConnectResult::NoFreePoolShare, -1, nullptr, TFGenericTCPClientPoolShareLevel::Undefined);
             return;
         }
-    }
 
-    if (slot_index < 0) {
-        connect_callback(TFGenericTCPClientConnectResult::NoFreePoolSlot, -1, nullptr, TFGenericTCPClientPoolShareLevel::Undefined);
-        return;
-    }
+        TFGenericTCPClientPoolShare *share = new TFGenericTCPClientPoolShare;
+        attach_shared_client(share, slot, share_index);
 
-    if (slots[slot_index] == nullptr) {
-        slots[slot_index] = new TFGenericTCPClientPoolSlot;
-    }
+        // The first share on an idle connection is primary
+        TFGenericTCPClientPoolShareLevel share_level = slot->share_count == 0 ? TFGenericTCPClientPoolShareLevel::Primary : TFGenericTCPClientPoolShareLevel::Secondary;
 
-    TFGenericTCPClientPoolSlot *slot = slots[slot_index];
+        slot->shares[share_index] = share;
+        ++slot->share_count;
 
-    if (slot->delete_pending) {
-        debugfln("acquire(host=%s port=%u) reviving slot (slot_index=%zu slot=%p client=%p)",
-                 host, port, slot_index, static_cast<void *>(slot), static_cast<void *>(slot->client));
+        if (slot->client->get_connection_status() == TFGenericTCPClientConnectionStatus::Connected) {
+            set_default_weight(share->shared_client, share_level);
+
+            share->disconnect_callback = std::move(disconnect_callback);
+            connect_callback(TFGenericTCPClientConnectResult::Connected, -1, share->shared_client, share_level);
+        }
+        else {
+            share->connect_callback = std::move(connect_callback);
+            share->pending_disconnect_callback = std::move(disconnect_callback);
+        }
+
+        return;
     }
 
-    slot->delete_pending = false;
+    ssize_t slot_index = open_slot(host, port, hash, connection_count);
 
-    if (slot->client == nullptr) {
-        slot->client = create_client();
+    if (slot_index < 0) {
+        connect_callback(TFGenericTCPClientConnectResult::NoFreePoolSlot, -1, nullptr, TFGenericTCPClientPoolShareLevel::Undefined);
+        return;
     }
 
-    debugfln("acquire(host=%s port=%u) connecting slot (slot_index=%zu slot=%p client=%p)",
-             host, port, slot_index, static_cast<void *>(slot), static_cast<void *>(slot->client));
+    slot = slots[slot_index];
 
     TFGenericTCPClientPoolShare *share = new TFGenericTCPClientPoolShare;
-    share->shared_client = create_shared_client(slot->client);
+    attach_shared_client(share, slot, 0);
     share->connect_callback = std::move(connect_callback);
     share->pending_disconnect_callback = std::move(disconnect_callback);
     slot->shares[0] = share;
     ++slot->share_count;
 
-    slot->client->connect(host, port,
-    [this, slot_index](TFGenericTCPClientConnectResult result, int error_number) {
-        TFGenericTCPClientPoolSlot *slot = slots[slot_index];
-
-        debugfln("acquire(...) connected (result=%s error_number=%d slot_index=%zu slot=%p)",
-                 get_tf_generic_tcp_client_connect_result_name(result), error_number,
-                 slot_index, static_cast<void *>(slot));
-
-        TFGenericTCPClientPoolShareLevel share_level = TFGenericTCPClientPoolShareLevel::Primary;
-
-        for (size_t k = 0; k < TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT; ++k) {
-            TFGenericTCPClientPoolShare *share = slot->shares[k];
+    connect_slot(slot, host);
+}
 
-            if (share == nullptr) {
-                continue;
-            }
+// non-reentrant
+void TFGenericTCPClientPool::prewarm(const char *host, uint16_t port, micros_t idle_duration,
+                                     TFGenericTCPClientConnectCallback &&connect_callback,
+                                     size_t connection_count /*= 1*/)
+{
+    if (!connect_callback) {
+        debugfln("prewarm(host=%s port=%u) invalid argument", TFNetwork::printf_safe(host), port);
+        return;
+    }
 
-            TFGenericTCPClientPoolConnectCallback connect_callback = std::move(share->connect_callback);
-            share->connect_callback = nullptr;
+    if (non_reentrant) {
+        debugfln("prewarm(host=%s port=%u) non-reentrant", TFNetwork::printf_safe(host), port);
+        connect_callback(TFGenericTCPClientConnectResult::NonReentrant, -1);
+        return;
+    }
 
-            if (result == TFGenericTCPClientConnectResult::Connected) {
-                share->disconnect_callback = std::move(share->pending_disconnect_callback);
-            }
+    TFNetwork::NonReentrantScope scope(&non_reentrant);
 
-            share->pending_disconnect_callback = nullptr;
+    if (host == nullptr || strlen(host) == 0 || port == 0 || idle_duration < 0_s
+     || connection_count < 1 || connection_count > TF_GENERIC_TCP_CLIENT_POOL_MAX_CONNECTION_COUNT) {
+        debugfln("prewarm(host=%s port=%u) invalid argument", TFNetwork::printf_safe(host), port);
+        connect_callback(TFGenericTCPClientConnectResult::InvalidArgument, -1);
+        return;
+    }
 
-            connect_callback(result, error_number, result == TFGenericTCPClientConnectResult::Connected ? share->shared_client : nullptr, share_level);
+    debugfln("prewarm(host=%s port=%u)", host, port);
 
-            share_level = TFGenericTCPClientPoolShareLevel::Secondary;
+    uint32_t hash = hash_host(host, port);
 
-            if (result != TFGenericTCPClientConnectResult::Connected) {
-                // The disconnect callback is not optional, but it is not set until the connection is
-                // estabilshed. Therefore the release() call will not call the disconnect callback, hence
-                // reason and error_number are unused. Pass error_number as -2 to indicate this
-                release(slot_index, k, TFGenericTCPClientDisconnectReason::Requested /* unused */, -2 /* unused */, false);
-            }
-        }
-    },
-    [this, slot_index](TFGenericTCPClientDisconnectReason reason, int error_number) {
-        TFGenericTCPClientPoolSlot *slot = slots[slot_index];
+    if (find_slot_by_host(host, port, hash) != nullptr) {
+        connect_callback(TFGenericTCPClientConnectResult::AlreadyConnected, -1);
+        return;
+    }
 
-        if (slot->delete_pending) {
-            return;
-        }
+    ssize_t slot_index = open_slot(host, port, hash, connection_count);
 
-        debugfln("acquire(...) disconnected (reason=%s error_number=%d slot_index=%zu slot=%p)",
-                 get_tf_generic_tcp_client_disconnect_reason_name(reason), error_number,
-                 slot_index, static_cast<void *>(slot));
+    if (slot_index < 0) {
+        connect_callback(TFGenericTCPClientConnectResult::NoFreePoolSlot, -1);
+        return;
+    }
 
-        for (size_t k = 0; k < TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT; ++k) {
-            TFGenericTCPClientPoolShare *share = slot->shares[k];
+    TFGenericTCPClientPoolSlot *slot = slots[slot_index];
 
-            if (share == nullptr) {
-                continue;
-            }
+    slot->prewarm_callback = std::move(connect_callback);
+    slot->idle_duration = idle_duration;
 
-            release(slot_index, k, reason, error_number, false);
-        }
-    });
+    connect_slot(slot, host);
 }
 
 // non-reentrant
@@ -232,45 +267,39 @@ TFGenericTCPClientDisconnectResult TFGenericTCPClientPool::release(TFGenericTCPS
 
     debugfln("release(shared_client=%p force_disconnect=%u)", static_cast<void *>(shared_client), force_disconnect ? 1 : 0);
 
-    for (size_t i = 0; i < TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT; ++i) {
-        TFGenericTCPClientPoolSlot *slot = slots[i];
+    TFGenericTCPClientPoolShare *share = shared_client != nullptr ? shared_client->pool_share : nullptr;
 
-        if (slot == nullptr) {
-            continue;
-        }
+    if (share == nullptr
+     || share->slot_index >= max_slot_count
+     || slots[share->slot_index] == nullptr
+     || slots[share->slot_index]->shares[share->share_index] != share) {
+        debugfln("release(shared_client=%p force_disconnect=%u) shared client not found", static_cast<void *>(shared_client), force_disconnect ? 1 : 0);
+        return TFGenericTCPClientDisconnectResult::NotConnected;
+    }
 
-        for (size_t k = 0; k < TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT; ++k) {
-            TFGenericTCPClientPoolShare *share = slot->shares[k];
+    size_t slot_index = share->slot_index;
+    size_t share_index = share->share_index;
+    TFGenericTCPClientPoolSlot *slot = slots[slot_index];
 
-            if (share == nullptr || share->shared_client != shared_client) {
+    release(slot_index, share_index, TFGenericTCPClientDisconnectReason::Requested, -1, true, !force_disconnect);
+
+    if (force_disconnect) {
+        for (size_t n = 0; n < max_share_count && slot->share_count > 0; ++n) {
+            if (n == share_index) {
                 continue;
             }
 
-            release(i, k, TFGenericTCPClientDisconnectReason::Requested, -1, true);
-
-            if (force_disconnect) {
-                for (size_t n = 0; n < TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT; ++n) {
-                    if (n == k) {
-                        continue;
-                    }
-
-                    TFGenericTCPClientPoolShare *other_share = slot->shares[n];
+            TFGenericTCPClientPoolShare *other_share = slot->shares[n];
 
-                    if (other_share == nullptr) {
-                        continue;
-                    }
-
-                    release(i, n, TFGenericTCPClientDisconnectReason::Forced, -1, true);
-                }
+            if (other_share == nullptr) {
+                continue;
             }
 
-            return TFGenericTCPClientDisconnectResult::Disconnected;
+            release(slot_index, n, TFGenericTCPClientDisconnectReason::Forced, -1, true, false);
         }
     }
 
-    debugfln("release(shared_client=%p force_disconnect=%u) shared client not found", static_cast<void *>(shared_client), force_disconnect ? 1 : 0);
-
-    return TFGenericTCPClientDisconnectResult::NotConnected;
+    return TFGenericTCPClientDisconnectResult::Disconnected;
 }
 
 // non-reentrant
@@ -281,9 +310,13 @@ void TFGenericTCPClientPool::tick()
         return;
     }
 
+    if (submit_queue != nullptr) {
+        submit_queue->drain();
+    }
+
     TFNetwork::NonReentrantScope scope(&non_reentrant);
 
-    for (size_t i = 0; i < TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT; ++i) {
+    for (size_t i = 0; i < max_slot_count; ++i) {
         TFGenericTCPClientPoolSlot *slot = slots[i];
 
         if (slot == nullptr) {
@@ -293,17 +326,96 @@ void TFGenericTCPClientPool::tick()
         if (slot->delete_pending) {
             debugfln("tick() deleting slot (slot_index=%zu client=%p)", i, static_cast<void *>(slot->client));
 
+            set_client_count(slot, 0); // A merged slot is still connected
+
             slots[i] = nullptr;
-            delete slot->client;
+            free_slot_indices[free_slot_count++] = i;
+
             delete slot;
             continue;
         }
 
-        slot->client->tick();
+        for (size_t k = 0; k < slot->client_count; ++k) {
+            slot->clients[k]->tick();
+        }
+
+        if (slot->delete_pending) {
+            continue;
+        }
+
+        if (slot->share_count == 0
+         && slot->client->get_connection_status() == TFGenericTCPClientConnectionStatus::Connected
+         && deadline_elapsed(slot->idle_deadline)) {
+            debugfln("tick() closing idle slot (slot_index=%zu client=%p)", i, static_cast<void *>(slot->client));
+
+            mark_slot_for_deletion(slot);
+            slot->client->disconnect();
+            continue;
+        }
+
+        connect_secondary_clients(slot);
     }
 }
 
-void TFGenericTCPClientPool::release(size_t slot_index, size_t share_index, TFGenericTCPClientDisconnectReason reason, int error_number, bool disconnect)
+// non-reentrant
+void TFGenericTCPClientPool::wait(micros_t timeout, int wakeup_fd)
+{
+    if (non_reentrant) {
+        debugfln("wait() non-reentrant");
+        return;
+    }
+
+    fd_set read_fdset;
+    fd_set write_fdset;
+    int fd_max = wakeup_fd;
+
+    FD_ZERO(&read_fdset);
+    FD_ZERO(&write_fdset);
+
+    if (wakeup_fd >= 0) {
+        FD_SET(wakeup_fd, &read_fdset);
+    }
+
+    for (size_t i = 0; i < max_slot_count; ++i) {
+        TFGenericTCPClientPoolSlot *slot = slots[i];
+
+        if (slot == nullptr) {
+            continue;
+        }
+
+        for (size_t k = 0; k < slot->client_count; ++k) {
+            TFGenericTCPClient *client = slot->clients[k];
+
+            if (client->is_send_pending()) {
+                return;
+            }
+
+            bool writable;
+            int socket_fd = client->get_wait_socket_fd(&writable);
+
+            if (socket_fd < 0) {
+                continue;
+            }
+
+            FD_SET(socket_fd, writable ? &write_fdset : &read_fdset);
+
+            if (socket_fd > fd_max) {
+                fd_max = socket_fd;
+            }
+        }
+    }
+
+    int64_t timeout_us = static_cast<int64_t>(timeout);
+    struct timeval tv;
+    tv.tv_sec  = timeout_us / 1000000;
+    tv.tv_usec = timeout_us % 1000000;
+
+    if (select(fd_max + 1, &read_fdset, &write_fdset, nullptr, &tv) < 0 && errno != EINTR) {
+        debugfln("wait() select() failed: %s (%d)", strerror(errno), errno);
+    }
+}
+
+void TFGenericTCPClientPool::release(size_t slot_index, size_t share_index, TFGenericTCPClientDisconnectReason reason, int error_number, bool disconnect, bool linger)
 {
     TFGenericTCPClientPoolSlot *slot = slots[slot_index];
 
@@ -363,6 +475,16 @@ void TFGenericTCPClientPool::release(size_t slot_index, size_t share_index, TFGe
     delete share->shared_client;
     delete share;
 
+    if (slot->share_count == 0 && linger && slot->idle_duration > 0_s
+     && slot->client->get_connection_status() == TFGenericTCPClientConnectionStatus::Connected) {
+        debugfln("release(slot_index=%zu share_index=%zu) keeping idle slot (client=%p host=%s port=%u idle_duration=%lli)",
+                 slot_index, share_index, static_cast<void *>(slot->client), TFNetwork::printf_safe(slot->client->get_host()),
+                 slot->client->get_port(), static_cast<long long>(static_cast<int64_t>(slot->idle_duration)));
+
+        slot->idle_deadline = calculate_deadline(slot->idle_duration);
+        return;
+    }
+
     if (slot->share_count == 0) {
 #if TF_NETWORK_DEBUG_LOG
         if (reason == TFGenericTCPClientDisconnectReason::Requested && error_number == -2) {
@@ -377,10 +499,473 @@ void TFGenericTCPClientPool::release(size_t slot_index, size_t share_index, TFGe
         }
 #endif
 
-        slot->delete_pending = true;
+        mark_slot_for_deletion(slot);
 
         if (disconnect) {
             slot->client->disconnect();
         }
     }
 }
+
+size_t TFGenericTCPClientPool::get_metrics(TFGenericTCPClientPoolMetrics *metrics, size_t metrics_length)
+{
+    micros_t now = now_us();
+    size_t metrics_count = 0;
+
+    for (size_t i = 0; i < max_slot_count && metrics_count < metrics_length; ++i) {
+        TFGenericTCPClientPoolSlot *slot = slots[i];
+
+        if (slot == nullptr || slot->delete_pending) {
+            continue;
+        }
+
+        TFGenericTCPClientPoolMetrics *row = &metrics[metrics_count++];
+        micros_t last_response = 0_s;
+
+        row->host = slot->host_head != nullptr ? slot->host_head->host : nullptr;
+        row->port = slot->port;
+        row->host_address = slot->client->get_host_address();
+        row->connection_status = slot->client->get_connection_status();
+        row->share_count = slot->share_count;
+        row->connection_count = 0;
+        row->queue_depth = 0;
+        row->in_flight_count = 0;
+        row->request_count = 0;
+        row->error_count = 0;
+        row->timeout_count = 0;
+
+        for (size_t k = 0; k < slot->client_count; ++k) {
+            TFGenericTCPClient *client = slot->clients[k];
+            const TFGenericTCPClientStatistics &statistics = client->get_statistics();
+            size_t in_flight_count = client->get_in_flight_request_count();
+
+            if (client->get_connection_status() == TFGenericTCPClientConnectionStatus::Connected) {
+                ++row->connection_count;
+            }
+
+            row->queue_depth += client->get_outstanding_request_count() - in_flight_count;
+            row->in_flight_count += in_flight_count;
+            row->request_count += statistics.request_count;
+            row->error_count += statistics.error_count;
+            row->timeout_count += statistics.timeout_count;
+
+            if (statistics.last_response > last_response) {
+                last_response = statistics.last_response;
+            }
+        }
+
+        micros_t elapsed = now - slot->metrics_time;
+
+        // Replaced secondary connections take their counts with them
+        if (elapsed > 0_s && row->request_count >= slot->metrics_request_count) {
+            row->requests_per_second = static_cast<float>(row->request_count - slot->metrics_request_count) * 1000000.0f / static_cast<float>(static_cast<int64_t>(elapsed));
+        }
+        else {
+            row->requests_per_second = 0.0f;
+        }
+
+        row->time_since_last_response = last_response == 0_s ? -1_s : now - last_response;
+
+        slot->metrics_request_count = row->request_count;
+        slot->metrics_time = now;
+    }
+
+    return metrics_count;
+}
+
+ssize_t TFGenericTCPClientPool::open_slot(const char *host, uint16_t port, uint32_t hash, size_t connection_count)
+{
+    ssize_t slot_index = allocate_slot();
+
+    if (slot_index < 0) {
+        return -1;
+    }
+
+    TFGenericTCPClientPoolSlot *slot = slots[slot_index];
+
+    if (slot->delete_pending) {
+        debugfln("open_slot(host=%s port=%u) reviving slot (slot_index=%zd slot=%p client=%p)",
+                 host, port, slot_index, static_cast<void *>(slot), static_cast<void *>(slot->client));
+
+        for (size_t i = 0; i < slot->client_count; ++i) {
+            slot->clients[i]->disconnect(); // A merged or idle slot is still connected
+        }
+    }
+
+    slot->delete_pending = false;
+    slot->port = port;
+    slot->reconnect_deadline = 0_s;
+    slot->idle_duration = linger_duration;
+    slot->idle_deadline = 0_s;
+    slot->prewarm_callback = nullptr;
+
+    set_client_count(slot, connection_count);
+
+    slot->metrics_request_count = 0;
+    slot->metrics_time = now_us();
+
+    for (size_t i = 0; i < slot->client_count; ++i) {
+        slot->metrics_request_count += slot->clients[i]->get_statistics().request_count;
+    }
+
+    add_host(slot, host, hash);
+
+    return slot_index;
+}
+
+void TFGenericTCPClientPool::connect_slot(TFGenericTCPClientPoolSlot *slot, const char *host)
+{
+    size_t slot_index = slot->index;
+
+    debugfln("connect_slot(host=%s port=%u) connecting slot (slot_index=%zu slot=%p client=%p)",
+             host, slot->port, slot_index, static_cast<void *>(slot), static_cast<void *>(slot->client));
+
+    slot->client->connect(host, slot->port,
+    [this, slot_index](TFGenericTCPClientConnectResult result, int error_number) {
+        TFGenericTCPClientPoolSlot *slot = slots[slot_index];
+
+        debugfln("connect_slot(...) connected (result=%s error_number=%d slot_index=%zu slot=%p)",
+                 get_tf_generic_tcp_client_connect_result_name(result), error_number,
+                 slot_index, static_cast<void *>(slot));
+
+        TFGenericTCPClientConnectCallback prewarm_callback = std::move(slot->prewarm_callback);
+        slot->prewarm_callback = nullptr;
+
+        TFGenericTCPClientPoolShareLevel share_level = TFGenericTCPClientPoolShareLevel::Primary;
+
+        if (result == TFGenericTCPClientConnectResult::Connected) {
+            uint32_t host_address = slot->client->get_host_address();
+            TFGenericTCPClientPoolSlot *target_slot = find_slot_by_address(host_address, slot->port);
+
+            if (target_slot != nullptr && target_slot->share_count + slot->share_count <= max_share_count) {
+                // Another host name resolved to an address that already has a
+                // connection. Hand over all shares and host names to that slot
+                // and give up this connection
+                if (target_slot->share_count > 0) {
+                    share_level = TFGenericTCPClientPoolShareLevel::Secondary;
+                }
+
+                merge_slot(slot, target_slot);
+
+                slot = target_slot;
+            }
+            else {
+                if (target_slot == nullptr && host_address != 0) {
+                    add_address(slot, host_address);
+                }
+
+                if (slot->share_count == 0) {
+                    slot->idle_deadline = calculate_deadline(slot->idle_duration);
+                }
+            }
+        }
+        else if (slot->share_count == 0) {
+            mark_slot_for_deletion(slot);
+        }
+
+        if (prewarm_callback) {
+            prewarm_callback(result, error_number);
+        }
+
+        for (size_t k = 0; k < max_share_count; ++k) {
+            TFGenericTCPClientPoolShare *share = slot->shares[k];
+
+            if (share == nullptr || !share->connect_callback) {
+                continue;
+            }
+
+            TFGenericTCPClientPoolConnectCallback connect_callback = std::move(share->connect_callback);
+            share->connect_callback = nullptr;
+
+            if (result == TFGenericTCPClientConnectResult::Connected) {
+                set_default_weight(share->shared_client, share_level);
+
+                share->disconnect_callback = std::move(share->pending_disconnect_callback);
+            }
+
+            share->pending_disconnect_callback = nullptr;
+
+            connect_callback(result, error_number, result == TFGenericTCPClientConnectResult::Connected ? share->shared_client : nullptr, share_level);
+
+            share_level = TFGenericTCPClientPoolShareLevel::Secondary;
+
+            if (result != TFGenericTCPClientConnectResult::Connected) {
+                // The disconnect callback is not optional, but it is not set until the connection is
+                // estabilshed. Therefore the release() call will not call the disconnect callback, hence
+                // reason and error_number are unused. Pass error_number as -2 to indicate this
+                release(slot->index, k, TFGenericTCPClientDisconnectReason::Requested /* unused */, -2 /* unused */, false, false);
+            }
+        }
+    },
+    [this, slot_index](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        TFGenericTCPClientPoolSlot *slot = slots[slot_index];
+
+        if (slot->delete_pending) {
+            return;
+        }
+
+        debugfln("connect_slot(...) disconnected (reason=%s error_number=%d slot_index=%zu slot=%p)",
+                 get_tf_generic_tcp_client_disconnect_reason_name(reason), error_number,
+                 slot_index, static_cast<void *>(slot));
+
+        if (slot->share_count == 0) { // idle
+            mark_slot_for_deletion(slot);
+            return;
+        }
+
+        for (size_t k = 0; k < max_share_count; ++k) {
+            TFGenericTCPClientPoolShare *share = slot->shares[k];
+
+            if (share == nullptr) {
+                continue;
+            }
+
+            release(slot_index, k, reason, error_number, false, false);
+        }
+    });
+}
+
+ssize_t TFGenericTCPClientPool::allocate_slot()
+{
+    if (free_slot_count > 0) {
+        size_t slot_index = free_slot_indices[--free_slot_count];
+
+        slots[slot_index] = new TFGenericTCPClientPoolSlot(slot_index, max_share_count);
+
+        return static_cast<ssize_t>(slot_index);
+    }
+
+    // All slots are in use, try to revive a slot that is about to be deleted
+    for (size_t i = 0; i < max_slot_count; ++i) {
+        if (slots[i]->delete_pending) {
+            return static_cast<ssize_t>(i);
+        }
+    }
+
+    // Otherwise give up an idle connection
+    for (size_t i = 0; i < max_slot_count; ++i) {
+        if (slots[i]->share_count == 0) {
+            mark_slot_for_deletion(slots[i]);
+            return static_cast<ssize_t>(i);
+        }
+    }
+
+    return -1;
+}
+
+void TFGenericTCPClientPool::set_client_count(TFGenericTCPClientPoolSlot *slot, size_t client_count)
+{
+    while (slot->client_count > client_count) {
+        TFGenericTCPClient *client = slot->clients[--slot->client_count];
+
+        slot->clients[slot->client_count] = nullptr;
+
+        client->disconnect();
+        delete client;
+    }
+
+    while (slot->client_count < client_count) {
+        slot->clients[slot->client_count++] = create_client();
+    }
+
+    slot->client = slot->clients[0];
+}
+
+void TFGenericTCPClientPool::connect_secondary_clients(TFGenericTCPClientPoolSlot *slot)
+{
+    if (slot->client_count < 2
+     || slot->delete_pending
+     || slot->client->get_connection_status() != TFGenericTCPClientConnectionStatus::Connected
+     || !deadline_elapsed(slot->reconnect_deadline)) {
+        return;
+    }
+
+    size_t slot_index = slot->index;
+
+    for (size_t k = 1; k < slot->client_count; ++k) {
+        TFGenericTCPClient *client = slot->clients[k];
+
+        if (client->get_connection_status() != TFGenericTCPClientConnectionStatus::Disconnected) {
+            continue;
+        }
+
+        debugfln("connect_secondary_clients(slot_index=%zu) connecting secondary client (client_index=%zu client=%p)",
+                 slot_index, k, static_cast<void *>(client));
+
+        client->connect(slot->client->get_host(), slot->port,
+        [this, slot_index, k](TFGenericTCPClientConnectResult result, int error_number) {
+            (void)error_number; // only used for debug log
+
+            debugfln("connect_secondary_clients(...) connected (result=%s error_number=%d slot_index=%zu client_index=%zu)",
+                     get_tf_generic_tcp_client_connect_result_name(result), error_number, slot_index, k);
+
+            if (result != TFGenericTCPClientConnectResult::Connected) {
+                slots[slot_index]->reconnect_deadline = calculate_deadline(TF_GENERIC_TCP_CLIENT_POOL_RECONNECT_DELAY);
+            }
+        },
+        [this, slot_index, k](TFGenericTCPClientDisconnectReason reason, int error_number) {
+            (void)reason; // only used for debug log
+            (void)error_number;
+
+            debugfln("connect_secondary_clients(...) disconnected (reason=%s error_number=%d slot_index=%zu client_index=%zu)",
+                     get_tf_generic_tcp_client_disconnect_reason_name(reason), error_number, slot_index, k);
+
+            slots[slot_index]->reconnect_deadline = calculate_deadline(TF_GENERIC_TCP_CLIENT_POOL_RECONNECT_DELAY);
+        });
+    }
+}
+
+void TFGenericTCPClientPool::attach_shared_client(TFGenericTCPClientPoolShare *share, TFGenericTCPClientPoolSlot *slot, size_t share_index)
+{
+    share->shared_client = create_shared_client(slot->client);
+    share->shared_client->connections = slot->clients;
+    share->shared_client->connection_count = slot->client_count;
+    share->shared_client->pool_share = share;
+    share->slot_index = slot->index;
+    share->share_index = share_index;
+}
+
+void TFGenericTCPClientPool::set_default_weight(TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level)
+{
+    shared_client->set_weight(share_level == TFGenericTCPClientPoolShareLevel::Primary ? TF_GENERIC_TCP_CLIENT_POOL_PRIMARY_SHARE_WEIGHT
+                                                                                      : TF_GENERIC_TCP_CLIENT_POOL_SECONDARY_SHARE_WEIGHT);
+}
+
+void TFGenericTCPClientPool::mark_slot_for_deletion(TFGenericTCPClientPoolSlot *slot)
+{
+    slot->delete_pending = true;
+
+    remove_hosts(slot);
+    remove_address(slot);
+}
+
+void TFGenericTCPClientPool::merge_slot(TFGenericTCPClientPoolSlot *slot, TFGenericTCPClientPoolSlot *target_slot)
+{
+    debugfln("merge_slot(slot_index=%zu target_slot_index=%zu) merging slot with same host address (host_address=%08x port=%u)",
+             slot->index, target_slot->index, slot->client->get_host_address(), slot->port);
+
+    size_t target_share_index = 0;
+
+    for (size_t k = 0; k < max_share_count; ++k) {
+        TFGenericTCPClientPoolShare *share = slot->shares[k];
+
+        if (share == nullptr) {
+            continue;
+        }
+
+        while (target_slot->shares[target_share_index] != nullptr) {
+            ++target_share_index;
+        }
+
+        // The connect callbacks of the shares of this slot have not been
+        // called yet, so no one has seen their shared clients so far
+        delete share->shared_client;
+
+        attach_shared_client(share, target_slot, target_share_index);
+
+        target_slot->shares[target_share_index] = share;
+        ++target_slot->share_count;
+
+        slot->shares[k] = nullptr;
+        --slot->share_count;
+    }
+
+    // Move the host names, so future acquires for them find the target slot
+    while (slot->host_head != nullptr) {
+        TFGenericTCPClientPoolHost *host = slot->host_head;
+
+        slot->host_head = host->slot_next;
+        host->slot_index = target_slot->index;
+        host->slot_next = target_slot->host_head;
+        target_slot->host_head = host;
+    }
+
+    // Deleting the slot in the next tick() also closes its connection
+    mark_slot_for_deletion(slot);
+}
+
+TFGenericTCPClientPoolSlot *TFGenericTCPClientPool::find_slot_by_host(const char *host, uint16_t port, uint32_t hash) const
+{
+    for (TFGenericTCPClientPoolHost *entry = host_index[hash & index_mask]; entry != nullptr; entry = entry->index_next) {
+        if (entry->hash == hash && entry->port == port && strcmp(entry->host, host) == 0) {
+            return slots[entry->slot_index];
+        }
+    }
+
+    return nullptr;
+}
+
+void TFGenericTCPClientPool::add_host(TFGenericTCPClientPoolSlot *slot, const char *host, uint32_t hash)
+{
+    TFGenericTCPClientPoolHost *entry = new TFGenericTCPClientPoolHost;
+    TFGenericTCPClientPoolHost **bucket = &host_index[hash & index_mask];
+
+    entry->host = strdup(host);
+    entry->port = slot->port;
+    entry->hash = hash;
+    entry->slot_index = slot->index;
+    entry->index_next = *bucket;
+    entry->slot_next = slot->host_head;
+
+    *bucket = entry;
+    slot->host_head = entry;
+}
+
+void TFGenericTCPClientPool::remove_hosts(TFGenericTCPClientPoolSlot *slot)
+{
+    while (slot->host_head != nullptr) {
+        TFGenericTCPClientPoolHost *entry = slot->host_head;
+        TFGenericTCPClientPoolHost **entry_ptr = &host_index[entry->hash & index_mask];
+
+        while (*entry_ptr != entry) {
+            entry_ptr = &(*entry_ptr)->index_next;
+        }
+
+        *entry_ptr = entry->index_next;
+        slot->host_head = entry->slot_next;
+
+        free(entry->host);
+        delete entry;
+    }
+}
+
+TFGenericTCPClientPoolSlot *TFGenericTCPClientPool::find_slot_by_address(uint32_t host_address, uint16_t port) const
+{
+    if (host_address == 0) {
+        return nullptr;
+    }
+
+    for (TFGenericTCPClientPoolSlot *slot = address_index[hash_address(host_address, port) & index_mask]; slot != nullptr; slot = slot->address_index_next) {
+        if (slot->indexed_host_address == host_address && slot->port == port) {
+            return slot;
+        }
+    }
+
+    return nullptr;
+}
+
+void TFGenericTCPClientPool::add_address(TFGenericTCPClientPoolSlot *slot, uint32_t host_address)
+{
+    TFGenericTCPClientPoolSlot **bucket = &address_index[hash_address(host_address, slot->port) & index_mask];
+
+    slot->indexed_host_address = host_address;
+    slot->address_index_next = *bucket;
+    *bucket = slot;
+}
+
+void TFGenericTCPClientPool::remove_address(TFGenericTCPClientPoolSlot *slot)
+{
+    if (slot->indexed_host_address == 0) {
+        return;
+    }
+
+    TFGenericTCPClientPoolSlot **slot_ptr = &address_index[hash_address(slot->indexed_host_address, slot->port) & index_mask];
+
+    while (*slot_ptr != slot) {
+        slot_ptr = &(*slot_ptr)->address_index_next;
+    }
+
+    *slot_ptr = slot->address_index_next;
+    slot->indexed_host_address = 0;
+    slot->address_index_next = nullptr;
+}
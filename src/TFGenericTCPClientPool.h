@@ -19,8 +19,12 @@
 
 #pragma once
 
+#include <sys/types.h>
+
 #include "TFGenericTCPClient.h"
 
+// configuration
+
 #ifndef TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT
 #define TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT 16
 #endif
@@ -29,6 +33,28 @@
 #define TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT 16
 #endif
 
+#ifndef TF_GENERIC_TCP_CLIENT_POOL_MAX_CONNECTION_COUNT
+#define TF_GENERIC_TCP_CLIENT_POOL_MAX_CONNECTION_COUNT 4
+#endif
+
+// How long a connection stays open after its last share got released
+#ifndef TF_GENERIC_TCP_CLIENT_POOL_LINGER_DURATION
+#define TF_GENERIC_TCP_CLIENT_POOL_LINGER_DURATION 0_s
+#endif
+
+// Default scheduling weights of shared clients, see TFGenericTCPSharedClient::set_weight()
+#ifndef TF_GENERIC_TCP_CLIENT_POOL_PRIMARY_SHARE_WEIGHT
+#define TF_GENERIC_TCP_CLIENT_POOL_PRIMARY_SHARE_WEIGHT 2
+#endif
+
+#ifndef TF_GENERIC_TCP_CLIENT_POOL_SECONDARY_SHARE_WEIGHT
+#define TF_GENERIC_TCP_CLIENT_POOL_SECONDARY_SHARE_WEIGHT 1
+#endif
+
+#ifndef TF_GENERIC_TCP_CLIENT_POOL_RECONNECT_DELAY
+#define TF_GENERIC_TCP_CLIENT_POOL_RECONNECT_DELAY 5_s
+#endif
+
 enum class TFGenericTCPClientPoolShareLevel
 {
     Undefined,
@@ -44,43 +70,159 @@ typedef std::function<void(TFGenericTCPClientDisconnectReason reason, int error_
 struct TFGenericTCPClientPoolShare
 {
     TFGenericTCPSharedClient *shared_client;
+    size_t slot_index;
+    size_t share_index;
     TFGenericTCPClientPoolConnectCallback connect_callback;
     TFGenericTCPClientPoolDisconnectCallback pending_disconnect_callback;
     TFGenericTCPClientPoolDisconnectCallback disconnect_callback;
 };
 
+// Entry of the host index. A slot has one entry per host name it was acquired
+// for, more than one if aliases got merged into it after connecting
+struct TFGenericTCPClientPoolHost
+{
+    char *host;
+    uint16_t port;
+    uint32_t hash;
+    size_t slot_index;
+    TFGenericTCPClientPoolHost *index_next; // next entry in the same hash bucket
+    TFGenericTCPClientPoolHost *slot_next;  // next entry of the same slot
+};
+
 struct TFGenericTCPClientPoolSlot
 {
-    TFGenericTCPClientPoolSlot() { memset(shares, 0, sizeof(shares)); }
+    TFGenericTCPClientPoolSlot(size_t index_, size_t max_share_count) : index(index_), shares(new TFGenericTCPClientPoolShare *[max_share_count]()) {}
+    ~TFGenericTCPClientPoolSlot() { delete[] shares; }
 
+    TFGenericTCPClientPoolSlot(TFGenericTCPClientPoolSlot const &other) = delete;
+    TFGenericTCPClientPoolSlot &operator=(TFGenericTCPClientPoolSlot const &other) = delete;
+
+    size_t index;
     bool delete_pending = false;
-    TFGenericTCPClient *client = nullptr;
-    TFGenericTCPClientPoolShare *shares[TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT];
+    TFGenericTCPClient *client = nullptr; // primary connection, its state is the state of the slot
+    TFGenericTCPClient *clients[TF_GENERIC_TCP_CLIENT_POOL_MAX_CONNECTION_COUNT] = {}; // clients[0] == client
+    size_t client_count = 0;
+    micros_t reconnect_deadline = 0_s; // for secondary connections
+    micros_t idle_duration = 0_s;
+    micros_t idle_deadline = 0_s; // only used while share_count == 0
+    TFGenericTCPClientConnectCallback prewarm_callback;
+    uint16_t port = 0;
+    TFGenericTCPClientPoolHost *host_head = nullptr;
+    uint32_t indexed_host_address = 0; // 0 if not in the address index
+    TFGenericTCPClientPoolSlot *address_index_next = nullptr;
+    TFGenericTCPClientPoolShare **shares; // max_share_count entries
     size_t share_count = 0;
+    uint32_t metrics_request_count = 0; // baseline of the request rate
+    micros_t metrics_time = 0_s;
+};
+
+// One row per slot, counts are summed over all connections of the slot
+struct TFGenericTCPClientPoolMetrics
+{
+    const char *host; // owned by the pool, valid until the next tick(), acquire(), release() or prewarm() call
+    uint16_t port;
+    uint32_t host_address; // IPv4 only, 0 until resolved
+    TFGenericTCPClientConnectionStatus connection_status; // of the primary connection
+    size_t share_count;
+    size_t connection_count; // established connections
+    size_t queue_depth; // scheduled requests, not sent yet
+    size_t in_flight_count;
+    float requests_per_second; // since the previous get_metrics() call
+    uint32_t request_count;
+    uint32_t error_count;
+    uint32_t timeout_count;
+    micros_t time_since_last_response; // -1_s if no successful response was received yet
 };
 
 class TFGenericTCPClientPool
 {
 public:
-    TFGenericTCPClientPool() { memset(slots, 0, sizeof(slots)); }
-    virtual ~TFGenericTCPClientPool() {}
+    TFGenericTCPClientPool(size_t max_slot_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT,
+                           size_t max_share_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT);
+    virtual ~TFGenericTCPClientPool();
 
     TFGenericTCPClientPool(TFGenericTCPClientPool const &other) = delete;
     TFGenericTCPClientPool &operator=(TFGenericTCPClientPool const &other) = delete;
 
+    // If connection_count is greater than one, then the slot opens secondary
+    // connections to the endpoint once the primary connection is established.
+    // Transactions are spread over all established connections by fewest
+    // outstanding requests, so their order is only kept with a single
+    // connection. The connection_count of an existing slot is not changed
     void acquire(const char *host, uint16_t port,
                  TFGenericTCPClientPoolConnectCallback &&connect_callback,
-                 TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback); // non-reentrant
+                 TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback,
+                 size_t connection_count = 1); // non-reentrant
     TFGenericTCPClientDisconnectResult release(TFGenericTCPSharedClient *shared_client, bool force_disconnect = false); // non-reentrant
     void tick(); // non-reentrant
 
+    // Blocks in select() until a socket of the pool or the wakeup socket is
+    // ready or the timeout elapsed, so a thread that ticks the pool doesn't
+    // have to poll. Returns right away if a client has a request to send.
+    // Deadlines are only checked by tick(), so the timeout bounds how late a
+    // deadline can be noticed
+    void wait(micros_t timeout, int wakeup_fd = -1); // non-reentrant
+
+    // The queue is drained at the start of tick(), the functions posted by
+    // other threads run on the ticking thread and can call acquire(), release()
+    // and transact() on the shared clients
+    void set_submit_queue(TFGenericTCPSubmitQueue *queue) { submit_queue = queue; }
+
+    // Opens a connection without a share. It stays open for idle_duration
+    // after it got established, unless it is acquired in the meantime. After
+    // the last share of a prewarmed connection is released the linger duration
+    // applies as usual. AlreadyConnected is reported if a slot for host and
+    // port exists already. Idle connections are given up if no slot is free
+    void prewarm(const char *host, uint16_t port, micros_t idle_duration,
+                 TFGenericTCPClientConnectCallback &&connect_callback,
+                 size_t connection_count = 1); // non-reentrant
+
+    // A connection stays open for the linger duration after its last share got
+    // released, unless the release was forced. Acquiring it again during that
+    // time avoids resolving and connecting. The first share on an idle
+    // connection is reported as primary
+    void set_linger_duration(micros_t duration) { linger_duration = duration; }
+    micros_t get_linger_duration() const { return linger_duration; }
+
+    size_t get_max_slot_count() const { return max_slot_count; }
+    size_t get_max_share_count() const { return max_share_count; }
+
+    // Fills up to metrics_length rows and returns the number of rows filled.
+    // Doesn't allocate and doesn't touch the network, so it is cheap enough to
+    // be called periodically. Each call restarts the request rate measurement
+    size_t get_metrics(TFGenericTCPClientPoolMetrics *metrics, size_t metrics_length);
+
 protected:
     virtual TFGenericTCPClient *create_client() = 0;
     virtual TFGenericTCPSharedClient *create_shared_client(TFGenericTCPClient *client) = 0;
 
 private:
-    void release(size_t slot_index, size_t share_index, TFGenericTCPClientDisconnectReason reason, int error_number, bool disconnect);
+    void release(size_t slot_index, size_t share_index, TFGenericTCPClientDisconnectReason reason, int error_number, bool disconnect, bool linger);
+    ssize_t open_slot(const char *host, uint16_t port, uint32_t hash, size_t connection_count);
+    void connect_slot(TFGenericTCPClientPoolSlot *slot, const char *host);
+    ssize_t allocate_slot();
+    void set_client_count(TFGenericTCPClientPoolSlot *slot, size_t client_count);
+    void connect_secondary_clients(TFGenericTCPClientPoolSlot *slot);
+    static void set_default_weight(TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level);
+    void attach_shared_client(TFGenericTCPClientPoolShare *share, TFGenericTCPClientPoolSlot *slot, size_t share_index);
+    void mark_slot_for_deletion(TFGenericTCPClientPoolSlot *slot);
+    void merge_slot(TFGenericTCPClientPoolSlot *slot, TFGenericTCPClientPoolSlot *target_slot);
+    TFGenericTCPClientPoolSlot *find_slot_by_host(const char *host, uint16_t port, uint32_t hash) const;
+    void add_host(TFGenericTCPClientPoolSlot *slot, const char *host, uint32_t hash);
+    void remove_hosts(TFGenericTCPClientPoolSlot *slot);
+    TFGenericTCPClientPoolSlot *find_slot_by_address(uint32_t host_address, uint16_t port) const;
+    void add_address(TFGenericTCPClientPoolSlot *slot, uint32_t host_address);
+    void remove_address(TFGenericTCPClientPoolSlot *slot);
 
     bool non_reentrant = false;
-    TFGenericTCPClientPoolSlot *slots[TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT];
+    TFGenericTCPSubmitQueue *submit_queue = nullptr;
+    micros_t linger_duration = TF_GENERIC_TCP_CLIENT_POOL_LINGER_DURATION;
+    size_t max_slot_count;
+    size_t max_share_count;
+    TFGenericTCPClientPoolSlot **slots;         // max_slot_count entries
+    size_t *free_slot_indices;                  // stack of unused slot indices
+    size_t free_slot_count;
+    size_t index_mask;                          // both indices have index_mask + 1 buckets
+    TFGenericTCPClientPoolHost **host_index;    // keyed on host name and port
+    TFGenericTCPClientPoolSlot **address_index; // keyed on resolved host address and port, connected slots only
 };
@@ -0,0 +1,557 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFGenericTCPShardedClientPool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <lwip/sockets.h>
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFGenericTCPShardedClientPool[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+struct TFGenericTCPShardedClientPoolShard
+{
+    TFGenericTCPClientPool *pool = nullptr;
+    TFGenericTCPSubmitQueue queue;
+    std::thread thread;
+    int wakeup_fd = -1;
+    uint32_t weight = 1;
+};
+
+struct TFGenericTCPShardedClientPoolRingPoint
+{
+    uint32_t hash;
+    uint32_t shard_index;
+};
+
+struct TFGenericTCPShardedClientPoolShare
+{
+    TFGenericTCPSharedClient *shared_client;
+    size_t shard_index;
+    char *host; // owned, the endpoint and callbacks are kept for rebalance()
+    uint16_t port;
+    size_t connection_count;
+    TFGenericTCPClientPoolConnectCallback connect_callback;
+    TFGenericTCPClientPoolDisconnectCallback disconnect_callback;
+    TFGenericTCPShardedClientPoolShare *next;
+};
+
+static uint32_t hash_host(const char *host, uint16_t port)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (const char *p = host; *p != '\0'; ++p) {
+        hash = (hash ^ static_cast<uint8_t>(*p)) * 16777619u;
+    }
+
+    hash = (hash ^ (port & 0xFF)) * 16777619u;
+    hash = (hash ^ (port >> 8)) * 16777619u;
+
+    // FNV-1a alone clusters similar host names on the ring
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static uint32_t hash_ring_point(uint32_t shard_index, uint32_t replica)
+{
+    uint32_t hash = shard_index * 0x9E3779B1u ^ replica * 0x85EBCA77u;
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+// A non-blocking UDP socket connected to itself on the loopback interface
+static int create_wakeup_socket()
+{
+    int wakeup_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (wakeup_fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr_in;
+    socklen_t addr_in_length = sizeof(addr_in);
+
+    memset(&addr_in, 0, sizeof(addr_in));
+
+    addr_in.sin_family      = AF_INET;
+    addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_in.sin_port        = 0;
+
+    int flags;
+
+    if (bind(wakeup_fd, reinterpret_cast<struct sockaddr *>(&addr_in), sizeof(addr_in)) < 0
+     || getsockname(wakeup_fd, reinterpret_cast<struct sockaddr *>(&addr_in), &addr_in_length) < 0
+     || connect(wakeup_fd, reinterpret_cast<struct sockaddr *>(&addr_in), addr_in_length) < 0
+     || (flags = fcntl(wakeup_fd, F_GETFL, 0)) < 0
+     || fcntl(wakeup_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        int saved_errno = errno;
+
+        close(wakeup_fd);
+
+        errno = saved_errno;
+        return -1;
+    }
+
+    return wakeup_fd;
+}
+
+static void wake_up(int wakeup_fd)
+{
+    uint8_t byte = 0;
+
+    // Fails if the socket buffer is full, then a wakeup is pending anyway
+    send(wakeup_fd, &byte, sizeof(byte), 0);
+}
+
+static void drain_wakeup_socket(int wakeup_fd)
+{
+    uint8_t buffer[16];
+
+    while (recv(wakeup_fd, buffer, sizeof(buffer), 0) > 0) {
+    }
+}
+
+TFGenericTCPShardedClientPool::TFGenericTCPShardedClientPool(size_t shard_count_) :
+    shard_count(shard_count_ > 0 ? shard_count_ : 1)
+{
+    shards = new TFGenericTCPShardedClientPoolShard[shard_count];
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        int wakeup_fd = create_wakeup_socket();
+
+        if (wakeup_fd < 0) {
+            debugfln("TFGenericTCPShardedClientPool() could not create wakeup socket for shard %zu: %s (%d)", i, strerror(errno), errno);
+            continue;
+        }
+
+        shards[i].wakeup_fd = wakeup_fd;
+        shards[i].queue.set_notify_function([wakeup_fd]() {
+            wake_up(wakeup_fd);
+        });
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    if (!rebuild_ring()) {
+        debugfln("TFGenericTCPShardedClientPool() could not build hash ring");
+    }
+}
+
+TFGenericTCPShardedClientPool::~TFGenericTCPShardedClientPool()
+{
+    stop();
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        delete shards[i].pool;
+
+        if (shards[i].wakeup_fd >= 0) {
+            close(shards[i].wakeup_fd);
+        }
+    }
+
+    delete[] shards;
+    free(ring);
+
+    while (share_head != nullptr) {
+        TFGenericTCPShardedClientPoolShare *share = share_head;
+
+        share_head = share->next;
+        free(share->host);
+        delete share;
+    }
+}
+
+bool TFGenericTCPShardedClientPool::start()
+{
+    if (running.load()) {
+        debugfln("start() already running");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+
+        if (ring == nullptr) {
+            debugfln("start() no hash ring");
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        if (shards[i].wakeup_fd < 0) {
+            debugfln("start() no wakeup socket for shard %zu", i);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        TFGenericTCPShardedClientPoolShard *shard = &shards[i];
+
+        if (shard->pool == nullptr) {
+            shard->pool = create_pool();
+            shard->pool->set_submit_queue(&shard->queue);
+        }
+    }
+
+    running.store(true);
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        TFGenericTCPClientPool *pool = shards[i].pool;
+        int wakeup_fd = shards[i].wakeup_fd;
+
+        shards[i].thread = std::thread([this, pool, wakeup_fd]() {
+            while (running.load(std::memory_order_relaxed)) {
+                pool->tick();
+                pool->wait(TF_GENERIC_TCP_SHARDED_CLIENT_POOL_MAX_WAIT_DURATION, wakeup_fd);
+
+                // Functions posted meanwhile are run by the next tick
+                drain_wakeup_socket(wakeup_fd);
+            }
+        });
+    }
+
+    return true;
+}
+
+void TFGenericTCPShardedClientPool::stop()
+{
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        wake_up(shards[i].wakeup_fd);
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards[i].thread.join();
+    }
+}
+
+bool TFGenericTCPShardedClientPool::rebuild_ring()
+{
+    size_t new_length = 0;
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        new_length += shards[i].weight * TF_GENERIC_TCP_SHARDED_CLIENT_POOL_VIRTUAL_NODE_COUNT;
+    }
+
+    if (new_length == 0) {
+        return false;
+    }
+
+    TFGenericTCPShardedClientPoolRingPoint *new_ring = static_cast<TFGenericTCPShardedClientPoolRingPoint *>(malloc(new_length * sizeof(TFGenericTCPShardedClientPoolRingPoint)));
+
+    if (new_ring == nullptr) {
+        return false;
+    }
+
+    size_t k = 0;
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        uint32_t replica_count = shards[i].weight * TF_GENERIC_TCP_SHARDED_CLIENT_POOL_VIRTUAL_NODE_COUNT;
+
+        for (uint32_t r = 0; r < replica_count; ++r) {
+            TFGenericTCPShardedClientPoolRingPoint point{hash_ring_point(static_cast<uint32_t>(i), r), static_cast<uint32_t>(i)};
+            size_t m = k++;
+
+            // Insertion sort, the ring is only rebuilt on weight changes
+            while (m > 0 && new_ring[m - 1].hash > point.hash) {
+                new_ring[m] = new_ring[m - 1];
+                --m;
+            }
+
+            new_ring[m] = point;
+        }
+    }
+
+    free(ring);
+
+    ring        = new_ring;
+    ring_length = new_length;
+
+    return true;
+}
+
+size_t TFGenericTCPShardedClientPool::get_shard_index(const char *host, uint16_t port) const
+{
+    uint32_t hash = hash_host(host, port);
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    if (ring_length == 0) {
+        return 0; // no hash ring, acquire() and start() fail
+    }
+
+    // First point at or after the hash, wrapping around
+    size_t low  = 0;
+    size_t high = ring_length;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (ring[middle].hash < hash) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return ring[low < ring_length ? low : 0].shard_index;
+}
+
+bool TFGenericTCPShardedClientPool::set_shard_weight(size_t shard_index, uint32_t weight)
+{
+    if (shard_index >= shard_count) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    uint32_t old_weight = shards[shard_index].weight;
+
+    shards[shard_index].weight = weight;
+
+    if (!rebuild_ring()) {
+        shards[shard_index].weight = old_weight;
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t TFGenericTCPShardedClientPool::get_shard_weight(size_t shard_index) const
+{
+    if (shard_index >= shard_count) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    return shards[shard_index].weight;
+}
+
+TFGenericTCPSubmitQueue *TFGenericTCPShardedClientPool::get_submit_queue(size_t shard_index) const
+{
+    return shard_index < shard_count ? &shards[shard_index].queue : nullptr;
+}
+
+bool TFGenericTCPShardedClientPool::acquire(const char *host, uint16_t port,
+                                            TFGenericTCPClientPoolConnectCallback &&connect_callback,
+                                            TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback,
+                                            size_t connection_count)
+{
+    if (host == nullptr || port == 0) {
+        debugfln("acquire(host=%s port=%u) invalid argument", TFNetwork::printf_safe(host), port);
+        return false;
+    }
+
+    {
+        // The ring is only replaced by weight changes, it doesn't become null again
+        std::lock_guard<std::mutex> lock(ring_mutex);
+
+        if (ring == nullptr) {
+            debugfln("acquire(host=%s port=%u) no hash ring", host, port);
+            return false;
+        }
+    }
+
+    size_t shard_index = get_shard_index(host, port);
+    TFGenericTCPShardedClientPoolShard *shard = &shards[shard_index];
+    char *host_copy = strdup(host);
+
+    if (host_copy == nullptr) {
+        return false;
+    }
+
+    bool posted = shard->queue.post([this, shard, shard_index, host_copy, port, connect_callback, disconnect_callback, connection_count]() mutable {
+        // The connect callback is called exactly once and takes over host_copy
+        shard->pool->acquire(host_copy, port,
+        [this, shard_index, host_copy, port, connection_count, connect_callback, disconnect_callback](TFGenericTCPClientConnectResult result, int error_number,
+                                                                                                      TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level) {
+            if (result == TFGenericTCPClientConnectResult::Connected) {
+                std::lock_guard<std::mutex> lock(share_mutex);
+
+                share_head = new TFGenericTCPShardedClientPoolShare{shared_client, shard_index, host_copy, port, connection_count,
+                                                                    connect_callback, disconnect_callback, share_head};
+            }
+            else {
+                free(host_copy);
+            }
+
+            connect_callback(result, error_number, shared_client, share_level);
+        },
+        [this, disconnect_callback](TFGenericTCPClientDisconnectReason reason, int error_number, TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level) {
+            remove_share(shared_client);
+            disconnect_callback(reason, error_number, shared_client, share_level);
+        },
+        connection_count);
+    });
+
+    if (!posted) {
+        debugfln("acquire(host=%s port=%u) submit queue of shard %zu full", host, port, shard_index);
+        free(host_copy);
+    }
+
+    return posted;
+}
+
+bool TFGenericTCPShardedClientPool::release(TFGenericTCPSharedClient *shared_client, bool force_disconnect)
+{
+    ssize_t shard_index = get_shard_index(shared_client);
+
+    if (shard_index < 0) {
+        return false;
+    }
+
+    TFGenericTCPShardedClientPoolShard *shard = &shards[shard_index];
+
+    return shard->queue.post([this, shard, shared_client, force_disconnect]() {
+        // The connection might have been lost in the meantime, then the shared
+        // client was deleted already. The share is only removed on the worker
+        // thread, so this check cannot race with the deletion
+        if (has_share(shared_client)) {
+            shard->pool->release(shared_client, force_disconnect);
+        }
+    });
+}
+
+size_t TFGenericTCPShardedClientPool::rebalance()
+{
+    std::lock_guard<std::mutex> lock(share_mutex);
+    size_t moved_count = 0;
+
+    for (TFGenericTCPShardedClientPoolShare *share = share_head; share != nullptr; share = share->next) {
+        size_t old_shard_index = share->shard_index;
+
+        if (get_shard_index(share->host, share->port) == old_shard_index) {
+            continue;
+        }
+
+        TFGenericTCPShardedClientPoolShard *shard = &shards[old_shard_index];
+        TFGenericTCPSharedClient *shared_client = share->shared_client;
+        char *host_copy = strdup(share->host);
+
+        if (host_copy == nullptr) {
+            continue;
+        }
+
+        uint16_t port = share->port;
+        size_t connection_count = share->connection_count;
+        TFGenericTCPClientPoolConnectCallback connect_callback = share->connect_callback;
+        TFGenericTCPClientPoolDisconnectCallback disconnect_callback = share->disconnect_callback;
+
+        bool posted = shard->queue.post([this, shard, old_shard_index, shared_client, host_copy, port, connection_count, connect_callback, disconnect_callback]() mutable {
+            // The share might have been lost or moved by an earlier rebalance()
+            // in the meantime. Shares are only removed on the worker thread, so
+            // this check cannot race with the deletion
+            if (get_shard_index(shared_client) == static_cast<ssize_t>(old_shard_index)) {
+                shard->pool->release(shared_client);
+
+                if (!acquire(host_copy, port, std::move(connect_callback), std::move(disconnect_callback), connection_count)) {
+                    debugfln("rebalance() could not acquire (host=%s port=%u) again", host_copy, port);
+                }
+            }
+
+            free(host_copy);
+        });
+
+        if (!posted) {
+            debugfln("rebalance() submit queue of shard %zu full", old_shard_index);
+            free(host_copy);
+            continue;
+        }
+
+        ++moved_count;
+    }
+
+    return moved_count;
+}
+
+bool TFGenericTCPShardedClientPool::post(TFGenericTCPSharedClient *shared_client, TFGenericTCPSubmitFunction &&function)
+{
+    ssize_t shard_index = get_shard_index(shared_client);
+
+    if (shard_index < 0) {
+        return false;
+    }
+
+    return shards[shard_index].queue.post(std::move(function));
+}
+
+ssize_t TFGenericTCPShardedClientPool::get_shard_index(const TFGenericTCPSharedClient *shared_client) const
+{
+    std::lock_guard<std::mutex> lock(share_mutex);
+
+    for (TFGenericTCPShardedClientPoolShare *share = share_head; share != nullptr; share = share->next) {
+        if (share->shared_client == shared_client) {
+            return static_cast<ssize_t>(share->shard_index);
+        }
+    }
+
+    return -1;
+}
+
+size_t TFGenericTCPShardedClientPool::get_share_count(size_t shard_index) const
+{
+    std::lock_guard<std::mutex> lock(share_mutex);
+    size_t count = 0;
+
+    for (TFGenericTCPShardedClientPoolShare *share = share_head; share != nullptr; share = share->next) {
+        if (share->shard_index == shard_index) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+bool TFGenericTCPShardedClientPool::has_share(TFGenericTCPSharedClient *shared_client) const
+{
+    return get_shard_index(shared_client) >= 0;
+}
+
+void TFGenericTCPShardedClientPool::remove_share(TFGenericTCPSharedClient *shared_client)
+{
+    std::lock_guard<std::mutex> lock(share_mutex);
+
+    for (TFGenericTCPShardedClientPoolShare **share_ptr = &share_head; *share_ptr != nullptr; share_ptr = &(*share_ptr)->next) {
+        TFGenericTCPShardedClientPoolShare *share = *share_ptr;
+
+        if (share->shared_client == shared_client) {
+            *share_ptr = share->next;
+            free(share->host);
+            delete share;
+            return;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "TFGenericTCPClientPool.h"
+#include "TFGenericTCPSubmitQueue.h"
+
+// configuration
+
+// Longest time a worker thread blocks on the sockets of its pool before it
+// ticks the pool anyway, bounds how late timeouts and deadlines are noticed
+#ifndef TF_GENERIC_TCP_SHARDED_CLIENT_POOL_MAX_WAIT_DURATION
+#define TF_GENERIC_TCP_SHARDED_CLIENT_POOL_MAX_WAIT_DURATION 10_ms
+#endif
+
+// Points per unit of shard weight on the consistent hash ring
+#ifndef TF_GENERIC_TCP_SHARDED_CLIENT_POOL_VIRTUAL_NODE_COUNT
+#define TF_GENERIC_TCP_SHARDED_CLIENT_POOL_VIRTUAL_NODE_COUNT 64
+#endif
+
+struct TFGenericTCPShardedClientPoolShard;
+struct TFGenericTCPShardedClientPoolRingPoint;
+struct TFGenericTCPShardedClientPoolShare;
+
+// Spreads endpoints over several pools, each ticked by its own worker thread.
+// Endpoints are assigned to shards by consistent hashing of host and port, so
+// changing the weight of a shard only moves the endpoints that hash to the
+// changed part of the ring. Existing shares stay on their shard until they are
+// released or rebalance() is called, only new acquires follow the changed ring.
+//
+// Between ticks a worker thread blocks in select() on the sockets of its pool
+// and on a loopback UDP socket, to which every post to the submit queue of the
+// shard sends a byte to wake the worker up.
+//
+// acquire(), release() and post() are thread-safe. The connect and disconnect
+// callbacks run on the worker thread of the shard. Shared clients must only be
+// used on the worker thread of their shard, either from the callbacks or from
+// functions passed to post(). TFNetwork::resolve is called from all worker
+// threads and has to be thread-safe
+class TFGenericTCPShardedClientPool
+{
+public:
+    TFGenericTCPShardedClientPool(size_t shard_count_);
+    virtual ~TFGenericTCPShardedClientPool();
+
+    TFGenericTCPShardedClientPool(TFGenericTCPShardedClientPool const &other) = delete;
+    TFGenericTCPShardedClientPool &operator=(TFGenericTCPShardedClientPool const &other) = delete;
+
+    // Creates the pools and starts the worker threads. Fails if the hash ring
+    // or the wakeup sockets could not be created by the constructor
+    bool start();
+    void stop();  // joins the worker threads, the pools and their connections are kept
+    bool is_running() const { return running.load(); }
+
+    // Return false if the submit queue of the shard is full or there is no
+    // hash ring, then the callbacks are not called
+    bool acquire(const char *host, uint16_t port,
+                 TFGenericTCPClientPoolConnectCallback &&connect_callback,
+                 TFGenericTCPClientPoolDisconnectCallback &&disconnect_callback,
+                 size_t connection_count = 1);
+    bool release(TFGenericTCPSharedClient *shared_client, bool force_disconnect = false);
+    bool post(TFGenericTCPSharedClient *shared_client, TFGenericTCPSubmitFunction &&function);
+
+    size_t get_shard_count() const { return shard_count; }
+    size_t get_shard_index(const char *host, uint16_t port) const;
+    TFGenericTCPSubmitQueue *get_submit_queue(size_t shard_index) const; // for tf_modbus_tcp_submit_transact()
+    ssize_t get_shard_index(const TFGenericTCPSharedClient *shared_client) const; // -1 if not acquired
+    size_t get_share_count(size_t shard_index) const;
+
+    // Weight 0 removes the shard from the ring for new acquires. At least one
+    // shard has to keep a weight greater than 0
+    bool set_shard_weight(size_t shard_index, uint32_t weight);
+    uint32_t get_shard_weight(size_t shard_index) const;
+
+    // Moves the shares whose endpoint hashes to a different shard since the
+    // last weight change. Each moved share is released on its old shard, which
+    // reports a Requested disconnect, and then acquired again on its new shard
+    // with the same callbacks, which reports the new shared client. If the
+    // submit queue of the new shard is full, then the share is only released.
+    // Returns the number of shares that are being moved
+    size_t rebalance();
+
+protected:
+    virtual TFGenericTCPClientPool *create_pool() = 0;
+
+private:
+    bool rebuild_ring(); // ring_mutex has to be locked
+    bool has_share(TFGenericTCPSharedClient *shared_client) const;
+    void remove_share(TFGenericTCPSharedClient *shared_client);
+
+    size_t shard_count;
+    TFGenericTCPShardedClientPoolShard *shards; // shard_count entries
+    std::atomic<bool> running{false};
+    mutable std::mutex ring_mutex;
+    TFGenericTCPShardedClientPoolRingPoint *ring = nullptr; // sorted by hash
+    size_t ring_length = 0;
+    mutable std::mutex share_mutex;
+    TFGenericTCPShardedClientPoolShare *share_head = nullptr;
+};
@@ -0,0 +1,176 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFGenericTCPSubmitQueue.h"
+
+struct TFGenericTCPSubmitQueueCell
+{
+    std::atomic<size_t> sequence;
+    TFGenericTCPSubmitFunction function;
+};
+
+static size_t round_up_to_power_of_two(size_t value)
+{
+    size_t result = 2;
+
+    while (result < value) {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+TFGenericTCPSubmitQueue::TFGenericTCPSubmitQueue(size_t capacity)
+{
+    capacity = round_up_to_power_of_two(capacity);
+    cells    = new TFGenericTCPSubmitQueueCell[capacity];
+    mask     = capacity - 1;
+
+    for (size_t i = 0; i < capacity; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+TFGenericTCPSubmitQueue::~TFGenericTCPSubmitQueue()
+{
+    delete[] cells;
+}
+
+// Bounded queue by Dmitry Vyukov: each cell carries a sequence number that
+// tells producers and the consumer whose turn it is, producers claim a cell
+// with a compare-and-swap on the enqueue position
+bool TFGenericTCPSubmitQueue::post(TFGenericTCPSubmitFunction &&function)
+{
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+    TFGenericTCPSubmitQueueCell *cell;
+
+    while (true) {
+        cell = &cells[position & mask];
+
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (difference == 0) {
+            if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            return false; // full
+        }
+        else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->function = std::move(function);
+    cell->sequence.store(position + 1, std::memory_order_release);
+
+    if (notify_function) {
+        notify_function();
+    }
+
+    return true;
+}
+
+size_t TFGenericTCPSubmitQueue::drain()
+{
+    size_t count = 0;
+
+    // Only run what was queued when the drain started, functions can post again
+    for (size_t i = 0; i <= mask; ++i) {
+        TFGenericTCPSubmitQueueCell *cell = &cells[dequeue_position & mask];
+
+        if (cell->sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+            break;
+        }
+
+        TFGenericTCPSubmitFunction function = std::move(cell->function);
+
+        cell->function = nullptr;
+        cell->sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+
+        ++dequeue_position;
+
+        function();
+        ++count;
+    }
+
+    return count;
+}
+
+TFGenericTCPCompletionQueue::TFGenericTCPCompletionQueue(size_t capacity)
+{
+    capacity = round_up_to_power_of_two(capacity);
+    cells    = new TFGenericTCPSubmitQueueCell[capacity];
+    mask     = capacity - 1;
+}
+
+TFGenericTCPCompletionQueue::~TFGenericTCPCompletionQueue()
+{
+    delete[] cells;
+}
+
+bool TFGenericTCPCompletionQueue::reserve()
+{
+    if (reserved_count.fetch_add(1, std::memory_order_relaxed) > mask) {
+        reserved_count.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+void TFGenericTCPCompletionQueue::unreserve()
+{
+    reserved_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void TFGenericTCPCompletionQueue::push(TFGenericTCPSubmitFunction &&function)
+{
+    size_t position = head.load(std::memory_order_relaxed);
+
+    // Cannot be full, the slot was reserved
+    cells[position & mask].function = std::move(function);
+
+    head.store(position + 1, std::memory_order_release);
+}
+
+size_t TFGenericTCPCompletionQueue::poll()
+{
+    size_t position = tail.load(std::memory_order_relaxed);
+    size_t end = head.load(std::memory_order_acquire);
+    size_t count = 0;
+
+    while (position != end) {
+        TFGenericTCPSubmitFunction function = std::move(cells[position & mask].function);
+
+        cells[position & mask].function = nullptr;
+
+        ++position;
+        tail.store(position, std::memory_order_release);
+        reserved_count.fetch_sub(1, std::memory_order_relaxed);
+
+        function();
+        ++count;
+    }
+
+    return count;
+}
@@ -0,0 +1,92 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+
+// configuration
+#ifndef TF_GENERIC_TCP_SUBMIT_QUEUE_CAPACITY
+#define TF_GENERIC_TCP_SUBMIT_QUEUE_CAPACITY 64
+#endif
+
+typedef std::function<void(void)> TFGenericTCPSubmitFunction;
+
+struct TFGenericTCPSubmitQueueCell;
+
+// Bounded lock-free multi producer, single consumer queue of functions. Any
+// thread can post(), the thread that ticks the client or pool drains the queue
+// at the start of tick() and runs the functions there. This allows calling
+// non-reentrant functions such as transact() or acquire() from other threads
+class TFGenericTCPSubmitQueue
+{
+public:
+    TFGenericTCPSubmitQueue(size_t capacity = TF_GENERIC_TCP_SUBMIT_QUEUE_CAPACITY); // rounded up to a power of two
+    ~TFGenericTCPSubmitQueue();
+
+    TFGenericTCPSubmitQueue(TFGenericTCPSubmitQueue const &other) = delete;
+    TFGenericTCPSubmitQueue &operator=(TFGenericTCPSubmitQueue const &other) = delete;
+
+    bool post(TFGenericTCPSubmitFunction &&function); // thread-safe, false if full
+    size_t drain(); // consumer thread only, returns the number of functions run
+
+    // Called by post() after queueing a function, to wake up a consumer thread
+    // that blocks between ticks. Has to be set before any thread posts
+    void set_notify_function(TFGenericTCPSubmitFunction &&function) { notify_function = std::move(function); }
+
+private:
+    TFGenericTCPSubmitQueueCell *cells;
+    size_t mask;
+    std::atomic<size_t> enqueue_position{0};
+    size_t dequeue_position = 0;
+    TFGenericTCPSubmitFunction notify_function;
+};
+
+// Bounded lock-free single producer, single consumer queue of completions. The
+// submitting thread reserves a slot per request before submitting it, so that
+// the network thread can always push the completion without blocking. The
+// submitting thread runs the completions by calling poll(). Only one thread
+// may push and only one thread may reserve and poll: if a thread submits to
+// clients that are ticked by different network threads, then it needs one
+// completion queue per network thread
+class TFGenericTCPCompletionQueue
+{
+public:
+    TFGenericTCPCompletionQueue(size_t capacity = TF_GENERIC_TCP_SUBMIT_QUEUE_CAPACITY); // rounded up to a power of two
+    ~TFGenericTCPCompletionQueue();
+
+    TFGenericTCPCompletionQueue(TFGenericTCPCompletionQueue const &other) = delete;
+    TFGenericTCPCompletionQueue &operator=(TFGenericTCPCompletionQueue const &other) = delete;
+
+    bool reserve(); // consumer thread, false if all slots are reserved
+    void unreserve(); // consumer thread, if the request could not be submitted
+    void push(TFGenericTCPSubmitFunction &&function); // producer thread, needs a reserved slot
+    size_t poll(); // consumer thread, returns the number of completions run
+
+private:
+    TFGenericTCPSubmitQueueCell *cells;
+    size_t mask;
+    std::atomic<size_t> reserved_count{0};
+    std::atomic<size_t> head{0}; // written by the producer
+    std::atomic<size_t> tail{0}; // written by the consumer
+};
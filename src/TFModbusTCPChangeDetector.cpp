@@ -0,0 +1,174 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPChangeDetector.h"
+
+#include <string.h>
+
+TFModbusTCPChangeDetector::~TFModbusTCPChangeDetector()
+{
+    end();
+}
+
+bool TFModbusTCPChangeDetector::begin(uint16_t start_address_, uint16_t register_count_, uint16_t max_gap_)
+{
+    if (register_count_ == 0 || static_cast<uint32_t>(start_address_) + register_count_ > 65536u) {
+        return false;
+    }
+
+    end();
+
+    size_t bitmap_length = (register_count_ + 31) / 32;
+
+    previous       = static_cast<uint16_t *>(malloc(register_count_ * sizeof(uint16_t)));
+    changed_bitmap = static_cast<uint32_t *>(malloc(bitmap_length * sizeof(uint32_t)));
+
+    if (previous == nullptr || changed_bitmap == nullptr) {
+        end();
+        return false;
+    }
+
+    memset(changed_bitmap, 0, bitmap_length * sizeof(uint32_t));
+
+    start_address  = start_address_;
+    register_count = register_count_;
+    max_gap        = max_gap_;
+    changed_count  = 0;
+    primed         = false;
+
+    return true;
+}
+
+void TFModbusTCPChangeDetector::end()
+{
+    free(previous);
+    previous = nullptr;
+
+    free(changed_bitmap);
+    changed_bitmap = nullptr;
+
+    register_count = 0;
+    changed_count  = 0;
+    primed         = false;
+}
+
+size_t TFModbusTCPChangeDetector::update(const uint16_t *values, const TFModbusTCPChangeDetectorCallback &callback)
+{
+    if (previous == nullptr) {
+        return 0;
+    }
+
+    size_t bitmap_length = (register_count + 31) / 32;
+
+    if (!primed) {
+        memcpy(previous, values, register_count * sizeof(uint16_t));
+        memset(changed_bitmap, 0xFF, bitmap_length * sizeof(uint32_t));
+
+        if (register_count % 32 != 0) {
+            changed_bitmap[bitmap_length - 1] = (1u << (register_count % 32)) - 1;
+        }
+
+        changed_count = register_count;
+        primed        = true;
+
+        if (callback) {
+            callback(start_address, register_count, values);
+        }
+
+        return 1;
+    }
+
+    // Compare four registers per 64 bit word and only look at the individual
+    // registers of words that differ. Equal blocks are the common case
+    memset(changed_bitmap, 0, bitmap_length * sizeof(uint32_t));
+
+    changed_count = 0;
+
+    size_t i = 0;
+
+    for (; i + 4 <= register_count; i += 4) {
+        uint64_t current_word;
+        uint64_t previous_word;
+
+        memcpy(&current_word, &values[i], sizeof(current_word));
+        memcpy(&previous_word, &previous[i], sizeof(previous_word));
+
+        if (current_word == previous_word) {
+            continue;
+        }
+
+        for (size_t k = i; k < i + 4; ++k) {
+            if (values[k] != previous[k]) {
+                changed_bitmap[k / 32] |= 1u << (k % 32);
+                ++changed_count;
+            }
+        }
+    }
+
+    for (; i < register_count; ++i) {
+        if (values[i] != previous[i]) {
+            changed_bitmap[i / 32] |= 1u << (i % 32);
+            ++changed_count;
+        }
+    }
+
+    if (changed_count == 0) {
+        return 0;
+    }
+
+    memcpy(previous, values, register_count * sizeof(uint16_t));
+
+    // Walk the bitmap and report changed ranges, skipping empty bitmap words
+    size_t range_count = 0;
+    size_t range_start = 0;
+    size_t range_end   = 0; // exclusive, 0 if no range is open
+
+    for (size_t w = 0; w < bitmap_length; ++w) {
+        uint32_t bits = changed_bitmap[w];
+
+        while (bits != 0) {
+            size_t index = w * 32 + __builtin_ctz(bits);
+
+            bits &= bits - 1;
+
+            if (range_end > 0 && index <= range_end + max_gap) {
+                range_end = index + 1;
+                continue;
+            }
+
+            if (range_end > 0) {
+                if (callback) {
+                    callback(static_cast<uint16_t>(start_address + range_start), static_cast<uint16_t>(range_end - range_start), &values[range_start]);
+                }
+
+                ++range_count;
+            }
+
+            range_start = index;
+            range_end   = index + 1;
+        }
+    }
+
+    if (callback) {
+        callback(static_cast<uint16_t>(start_address + range_start), static_cast<uint16_t>(range_end - range_start), &values[range_start]);
+    }
+
+    return range_count + 1;
+}
@@ -0,0 +1,64 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+
+typedef std::function<void(uint16_t start_address, uint16_t data_count, const uint16_t *values)> TFModbusTCPChangeDetectorCallback;
+
+// Keeps a copy of a register range and reports which registers changed since
+// the previous update, as ranges and as bitmap. Meant to be fed from the
+// transaction or poll callback right after the registers were received, so
+// that consumers only process modified values. The first update after begin()
+// or reset() reports the whole range as changed
+class TFModbusTCPChangeDetector
+{
+public:
+    TFModbusTCPChangeDetector() {}
+    ~TFModbusTCPChangeDetector();
+
+    TFModbusTCPChangeDetector(TFModbusTCPChangeDetector const &other) = delete;
+    TFModbusTCPChangeDetector &operator=(TFModbusTCPChangeDetector const &other) = delete;
+
+    // Changed ranges that are at most max_gap unchanged registers apart are
+    // reported as one range
+    bool begin(uint16_t start_address, uint16_t register_count, uint16_t max_gap = 0);
+    void end();
+    void reset() { primed = false; }
+
+    // Returns the number of changed ranges, the callback is called once per range
+    size_t update(const uint16_t *values, const TFModbusTCPChangeDetectorCallback &callback = nullptr);
+
+    // One bit per register, LSB first, valid after update()
+    const uint32_t *get_changed_bitmap() const { return changed_bitmap; }
+    size_t get_changed_count() const { return changed_count; }
+
+private:
+    uint16_t start_address    = 0;
+    uint16_t register_count   = 0;
+    uint16_t max_gap          = 0;
+    uint16_t *previous        = nullptr;
+    uint32_t *changed_bitmap  = nullptr;
+    size_t changed_count      = 0;
+    bool primed               = false;
+};
@@ -121,6 +121,25 @@ const char *get_tf_modbus_tcp_client_transaction_result_name(TFModbusTCPClientTr
 
     case TFModbusTCPClientTransactionResult::ResponseShorterThanExpected:
         return "ResponseShorterThanExpected";
+
+    case TFModbusTCPClientTransactionResult::CircuitBreakerOpen:
+        return "CircuitBreakerOpen";
+    }
+
+    return "<Unknown>";
+}
+
+const char *get_tf_modbus_tcp_client_circuit_breaker_state_name(TFModbusTCPClientCircuitBreakerState state)
+{
+    switch (state) {
+    case TFModbusTCPClientCircuitBreakerState::Closed:
+        return "Closed";
+
+    case TFModbusTCPClientCircuitBreakerState::Open:
+        return "Open";
+
+    case TFModbusTCPClientCircuitBreakerState::HalfOpen:
+        return "HalfOpen";
     }
 
     return "<Unknown>";
@@ -133,6 +152,133 @@ void TFModbusTCPClient::transact(uint8_t unit_id,
                                  void *buffer,
                                  micros_t timeout,
                                  TFModbusTCPClientTransactionCallback &&callback)
+{
+    queue_transaction(nullptr, TF_MODBUS_TCP_CLIENT_DEFAULT_QUEUE_WEIGHT,
+                      unit_id, function_code, start_address, data_count, buffer, timeout, std::move(callback));
+}
+
+void TFModbusTCPClient::transact(uint8_t unit_id,
+                                 TFModbusTCPFunctionCode function_code,
+                                 uint16_t read_start_address,
+                                 uint16_t read_data_count,
+                                 void *read_buffer,
+                                 uint16_t write_start_address,
+                                 uint16_t write_data_count,
+                                 void *write_buffer,
+                                 micros_t timeout,
+                                 TFModbusTCPClientTransactionCallback &&callback)
+{
+    queue_transaction(nullptr, TF_MODBUS_TCP_CLIENT_DEFAULT_QUEUE_WEIGHT,
+                      unit_id, function_code, read_start_address, read_data_count, read_buffer,
+                      write_start_address, write_data_count, write_buffer, timeout, std::move(callback));
+}
+
+bool TFModbusTCPClient::prepare_transaction(TFModbusTCPClientPreparedTransaction *prepared,
+                                            uint8_t unit_id,
+                                            TFModbusTCPFunctionCode function_code,
+                                            uint16_t start_address,
+                                            uint16_t data_count)
+{
+    if (prepared == nullptr) {
+        return false;
+    }
+
+    uint8_t expected_byte_count;
+    size_t expected_payload_length;
+
+    switch (function_code) {
+    case TFModbusTCPFunctionCode::ReadCoils:
+    case TFModbusTCPFunctionCode::ReadDiscreteInputs:
+        if (data_count < TF_MODBUS_TCP_MIN_READ_COIL_COUNT || data_count > TF_MODBUS_TCP_MAX_READ_COIL_COUNT) {
+            return false;
+        }
+
+        expected_byte_count     = (data_count + 7) / 8;
+        expected_payload_length = offsetof(TFModbusTCPResponsePayload, coil_values) + expected_byte_count;
+        break;
+
+    case TFModbusTCPFunctionCode::ReadHoldingRegisters:
+    case TFModbusTCPFunctionCode::ReadInputRegisters:
+        if (data_count < TF_MODBUS_TCP_MIN_READ_REGISTER_COUNT || data_count > TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT) {
+            return false;
+        }
+
+        expected_byte_count     = data_count * 2;
+        expected_payload_length = offsetof(TFModbusTCPResponsePayload, register_values) + expected_byte_count;
+        break;
+
+    default:
+        return false;
+    }
+
+    TFModbusTCPRequest request;
+    size_t payload_length = offsetof(TFModbusTCPRequestPayload, byte_count);
+
+    static_assert(TF_MODBUS_TCP_CLIENT_PREPARED_FRAME_LENGTH == TF_MODBUS_TCP_HEADER_LENGTH + offsetof(TFModbusTCPRequestPayload, byte_count), "Prepared frame has unexpected length");
+
+    request.header.transaction_id = 0;
+    request.header.protocol_id    = htons(0);
+    request.header.frame_length   = htons(TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH + payload_length);
+    request.header.unit_id        = unit_id;
+
+    request.payload.function_code = static_cast<uint8_t>(function_code);
+    request.payload.start_address = htons(start_address);
+    request.payload.data_count    = htons(data_count);
+
+    prepared->unit_id                 = unit_id;
+    prepared->function_code           = function_code;
+    prepared->start_address           = start_address;
+    prepared->data_count              = data_count;
+    prepared->expected_byte_count     = expected_byte_count;
+    prepared->expected_payload_length = expected_payload_length;
+
+    memcpy(prepared->frame, request.bytes, sizeof(prepared->frame));
+
+    return true;
+}
+
+void TFModbusTCPClient::transact(const TFModbusTCPClientPreparedTransaction *prepared,
+                                 void *buffer,
+                                 micros_t timeout,
+                                 TFModbusTCPClientTransactionCallback &&callback)
+{
+    queue_transaction(nullptr, TF_MODBUS_TCP_CLIENT_DEFAULT_QUEUE_WEIGHT, prepared, buffer, timeout, std::move(callback));
+}
+
+void TFModbusTCPClient::queue_transaction(const void *owner,
+                                          uint32_t weight,
+                                          const TFModbusTCPClientPreparedTransaction *prepared,
+                                          void *buffer,
+                                          micros_t timeout,
+                                          TFModbusTCPClientTransactionCallback &&callback)
+{
+    if (!callback) {
+        return;
+    }
+
+    if (prepared == nullptr) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Prepared transaction pointer is null");
+        return;
+    }
+
+    if (buffer == nullptr) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Data pointer is null");
+        return;
+    }
+
+    schedule_transaction(owner, weight, prepared->unit_id, prepared->function_code, prepared->start_address, prepared->data_count, buffer,
+                         0, 0, nullptr, prepared, timeout, std::move(callback));
+}
+
+void TFModbusTCPClient::queue_transaction(const void *owner,
+                                          uint32_t weight,
+                                          uint8_t unit_id,
+                                          TFModbusTCPFunctionCode function_code,
+                                          uint16_t start_address,
+                                          uint16_t data_count,
+                                          void *buffer,
+                                          micros_t timeout,
+                                          TFModbusTCPClientTransactionCallback &&callback)
 {
     if (!callback) {
         return;
@@ -222,6 +368,10 @@ void TFModbusTCPClient::transact(uint8_t unit_id,
 
         break;
 
+    case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Function code requires separate read and write buffers");
+        return;
+
     default:
         callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Function code is out-of-range");
         return;
@@ -232,6 +382,69 @@ void TFModbusTCPClient::transact(uint8_t unit_id,
         return;
     }
 
+    schedule_transaction(owner, weight, unit_id, function_code, start_address, data_count, buffer, 0, 0, nullptr, nullptr, timeout, std::move(callback));
+}
+
+void TFModbusTCPClient::queue_transaction(const void *owner,
+                                          uint32_t weight,
+                                          uint8_t unit_id,
+                                          TFModbusTCPFunctionCode function_code,
+                                          uint16_t read_start_address,
+                                          uint16_t read_data_count,
+                                          void *read_buffer,
+                                          uint16_t write_start_address,
+                                          uint16_t write_data_count,
+                                          void *write_buffer,
+                                          micros_t timeout,
+                                          TFModbusTCPClientTransactionCallback &&callback)
+{
+    if (!callback) {
+        return;
+    }
+
+    if (function_code != TFModbusTCPFunctionCode::ReadWriteMultipleRegisters) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Function code is out-of-range");
+        return;
+    }
+
+    if (read_data_count < TF_MODBUS_TCP_MIN_READ_REGISTER_COUNT || read_data_count > TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Read data count is out-of-range");
+        return;
+    }
+
+    if (write_data_count < TF_MODBUS_TCP_MIN_WRITE_REGISTER_COUNT || write_data_count > TF_MODBUS_TCP_MAX_READ_WRITE_WRITE_REGISTER_COUNT) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Write data count is out-of-range");
+        return;
+    }
+
+    if (read_buffer == nullptr) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Read data pointer is null");
+        return;
+    }
+
+    if (write_buffer == nullptr) {
+        callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Write data pointer is null");
+        return;
+    }
+
+    schedule_transaction(owner, weight, unit_id, function_code, read_start_address, read_data_count, read_buffer,
+                         write_start_address, write_data_count, write_buffer, nullptr, timeout, std::move(callback));
+}
+
+void TFModbusTCPClient::schedule_transaction(const void *owner,
+                                             uint32_t weight,
+                                             uint8_t unit_id,
+                                             TFModbusTCPFunctionCode function_code,
+                                             uint16_t start_address,
+                                             uint16_t data_count,
+                                             void *buffer,
+                                             uint16_t write_start_address,
+                                             uint16_t write_data_count,
+                                             void *write_buffer,
+                                             const TFModbusTCPClientPreparedTransaction *prepared,
+                                             micros_t timeout,
+                                             TFModbusTCPClientTransactionCallback &&callback)
+{
     if (timeout < 0_s) {
         callback(TFModbusTCPClientTransactionResult::InvalidArgument, "Timeout is negative");
         return;
@@ -242,35 +455,139 @@ void TFModbusTCPClient::transact(uint8_t unit_id,
         return;
     }
 
-    TFModbusTCPClientTransaction **tail_ptr = &scheduled_transaction_head;
-    size_t scheduled_transaction_count = 0;
+    if (circuit_breaker_state == TFModbusTCPClientCircuitBreakerState::HalfOpen) {
+        callback(TFModbusTCPClientTransactionResult::CircuitBreakerOpen, "Probe transaction is pending");
+        return;
+    }
+
+    if (circuit_breaker_state == TFModbusTCPClientCircuitBreakerState::Open) {
+        if (!deadline_elapsed(circuit_breaker_probe_deadline)) {
+            callback(TFModbusTCPClientTransactionResult::CircuitBreakerOpen, nullptr);
+            return;
+        }
+
+        debugfln("schedule_transaction(...) sending probe transaction");
+
+        // This transaction is the probe
+        circuit_breaker_state = TFModbusTCPClientCircuitBreakerState::HalfOpen;
+    }
+
+    TFModbusTCPClientTransactionQueue **queue_ptr = &queue_head;
 
-    while (*tail_ptr != nullptr) {
-        tail_ptr = &(*tail_ptr)->next;
-        ++scheduled_transaction_count;
+    while (*queue_ptr != nullptr && (*queue_ptr)->owner != owner) {
+        queue_ptr = &(*queue_ptr)->next;
     }
 
-    if (scheduled_transaction_count >= TF_MODBUS_TCP_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT) {
+    TFModbusTCPClientTransactionQueue *queue = *queue_ptr;
+
+    if (queue == nullptr) {
+        queue = new TFModbusTCPClientTransactionQueue;
+
+        queue->owner             = owner;
+        queue->deficit           = 0;
+        queue->transaction_count = 0;
+        queue->head              = nullptr;
+        queue->tail_ptr          = &queue->head;
+        queue->next              = nullptr;
+
+        *queue_ptr = queue; // append to keep the round-robin order
+
+        // If the round-robin already passed the last queue, then the new queue
+        // is next, before wrapping around to the head
+        if (current_queue == nullptr) {
+            current_queue = queue;
+        }
+    }
+    else if (queue->transaction_count >= TF_MODBUS_TCP_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT) {
         callback(TFModbusTCPClientTransactionResult::NoTransactionAvailable, nullptr);
         return;
     }
 
+    queue->weight = weight > 0 ? weight : 1;
+
     TFModbusTCPClientTransaction *transaction = new TFModbusTCPClientTransaction;
 
-    transaction->unit_id       = unit_id;
-    transaction->function_code = function_code;
-    transaction->start_address = start_address;
-    transaction->data_count    = data_count;
-    transaction->buffer        = buffer;
-    transaction->timeout       = timeout;
-    transaction->callback      = std::move(callback);
-    transaction->next          = nullptr;
+    transaction->unit_id             = unit_id;
+    transaction->function_code       = function_code;
+    transaction->start_address       = start_address;
+    transaction->data_count          = data_count;
+    transaction->buffer              = buffer;
+    transaction->write_start_address = write_start_address;
+    transaction->write_data_count    = write_data_count;
+    transaction->write_buffer        = write_buffer;
+    transaction->prepared            = prepared;
+    transaction->timeout             = timeout;
+    transaction->callback            = std::move(callback);
+    transaction->next                = nullptr;
+
+    *queue->tail_ptr = transaction;
+    queue->tail_ptr  = &transaction->next;
+    ++queue->transaction_count;
+}
+
+size_t TFModbusTCPClient::get_outstanding_request_count() const
+{
+    size_t count = pending_transaction != nullptr ? 1 : 0;
+
+    for (TFModbusTCPClientTransactionQueue *queue = queue_head; queue != nullptr; queue = queue->next) {
+        count += queue->transaction_count;
+    }
 
-    *tail_ptr = transaction;
+    return count;
+}
+
+// Deficit round-robin with a cost of one per transaction: each visit of the
+// round-robin adds the queue's weight to its deficit, which is then spent on
+// that many transactions before moving on to the next queue. A queue that
+// runs empty forfeits its remaining deficit and is removed
+TFModbusTCPClientTransaction *TFModbusTCPClient::dequeue_transaction()
+{
+    if (queue_head == nullptr) {
+        return nullptr;
+    }
+
+    if (current_queue == nullptr) {
+        current_queue = queue_head;
+    }
+
+    TFModbusTCPClientTransactionQueue *queue = current_queue;
+
+    if (queue->deficit == 0) {
+        queue->deficit = queue->weight;
+    }
+
+    TFModbusTCPClientTransaction *transaction = queue->head;
+
+    queue->head = transaction->next;
+    transaction->next = nullptr;
+    --queue->transaction_count;
+    --queue->deficit;
+
+    if (queue->head == nullptr) {
+        current_queue = queue->next;
+
+        TFModbusTCPClientTransactionQueue **queue_ptr = &queue_head;
+
+        while (*queue_ptr != queue) {
+            queue_ptr = &(*queue_ptr)->next;
+        }
+
+        *queue_ptr = queue->next;
+        delete queue;
+    }
+    else if (queue->deficit == 0) {
+        current_queue = queue->next;
+    }
+
+    return transaction;
 }
 
 void TFModbusTCPClient::close_hook()
 {
+    consecutive_timeout_count      = 0;
+    circuit_breaker_state          = TFModbusTCPClientCircuitBreakerState::Closed;
+    circuit_breaker_probe_deadline = 0_s;
+
     reset_pending_response();
     finish_all_transactions(TFModbusTCPClientTransactionResult::Aborted, "Connection got closed");
 }
@@ -279,13 +596,33 @@ void TFModbusTCPClient::tick_hook()
 {
     check_pending_transaction_timeout();
 
-    if (pending_transaction == nullptr && scheduled_transaction_head != nullptr) {
-        pending_transaction          = scheduled_transaction_head;
-        scheduled_transaction_head   = scheduled_transaction_head->next;
-        pending_transaction->next    = nullptr;
+    if (pending_transaction == nullptr && queue_head != nullptr) {
+        pending_transaction          = dequeue_transaction();
         pending_transaction_id       = next_transaction_id++;
         pending_transaction_deadline = calculate_deadline(pending_transaction->timeout);
 
+        const TFModbusTCPClientPreparedTransaction *prepared = pending_transaction->prepared;
+
+        if (prepared != nullptr) {
+            uint8_t frame[TF_MODBUS_TCP_CLIENT_PREPARED_FRAME_LENGTH];
+
+            memcpy(frame, prepared->frame, sizeof(frame));
+
+            frame[0] = static_cast<uint8_t>(pending_transaction_id >> 8);
+            frame[1] = static_cast<uint8_t>(pending_transaction_id & 0xFF);
+
+            if (!send(frame, sizeof(frame))) {
+                int saved_errno = errno;
+                char error_message[128];
+
+                snprintf(error_message, sizeof(error_message), "%s (%d)", strerror(saved_errno), saved_errno);
+                finish_pending_transaction(TFModbusTCPClientTransactionResult::SendFailed, error_message);
+                disconnect(TFGenericTCPClientDisconnectReason::SocketSendFailed, saved_errno);
+            }
+
+            return;
+        }
+
         TFModbusTCPRequest request;
         size_t payload_length;
 
@@ -361,6 +698,26 @@ void TFModbusTCPClient::tick_hook()
 
             break;
 
+        case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+            request.payload.data_count          = htons(pending_transaction->data_count);
+            request.payload.write_start_address = htons(pending_transaction->write_start_address);
+            request.payload.write_data_count    = htons(pending_transaction->write_data_count);
+            request.payload.write_byte_count    = pending_transaction->write_data_count * 2;
+            payload_length                      = offsetof(TFModbusTCPRequestPayload, write_register_values) + request.payload.write_byte_count;
+
+            if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                uint16_t *write_buffer = static_cast<uint16_t *>(pending_transaction->write_buffer);
+
+                for (size_t i = 0; i < pending_transaction->write_data_count; ++i) {
+                    request.payload.write_register_values[i] = htons(write_buffer[i]);
+                }
+            }
+            else { // TFModbusTCPByteOrder::Network
+                memcpy(request.payload.write_register_values, pending_transaction->write_buffer, request.payload.write_byte_count);
+            }
+
+            break;
+
         default:
             return; // unreachable, just here to stop the compiler from warning about "payload_length may be used uninitialized"
         }
@@ -495,6 +852,9 @@ bool TFModbusTCPClient::receive_hook()
         return true;
     }
 
+    // Any response to the pending transaction shows that the device is responsive
+    record_response();
+
     if (pending_transaction->unit_id != pending_response.header.unit_id) {
         debugfln("receive_hook() unit ID mismatch (pending_response.header.unit_id=%u pending_transaction->unit_id=%u)",
                  pending_response.header.unit_id, pending_transaction->unit_id);
@@ -537,71 +897,83 @@ bool TFModbusTCPClient::receive_hook()
     bool check_or_mask          = false;
     uint16_t expected_or_mask;    // as TFModbusTCPByteOrder::Host
 
-    switch (static_cast<TFModbusTCPFunctionCode>(pending_response.payload.function_code)) {
-    case TFModbusTCPFunctionCode::ReadCoils:
-    case TFModbusTCPFunctionCode::ReadDiscreteInputs:
-        expected_byte_count     = (pending_transaction->data_count + 7) / 8;
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, coil_values) + expected_byte_count;
-        copy_coil_values        = true;
-        break;
+    const TFModbusTCPClientPreparedTransaction *prepared = pending_transaction->prepared;
 
-    case TFModbusTCPFunctionCode::ReadHoldingRegisters:
-    case TFModbusTCPFunctionCode::ReadInputRegisters:
-        expected_byte_count     = pending_transaction->data_count * 2;
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, register_values) + expected_byte_count;
-        copy_register_values    = true;
-        break;
+    if (prepared != nullptr) {
+        expected_byte_count     = prepared->expected_byte_count;
+        expected_payload_length = prepared->expected_payload_length;
+        copy_coil_values        = prepared->function_code == TFModbusTCPFunctionCode::ReadCoils
+                               || prepared->function_code == TFModbusTCPFunctionCode::ReadDiscreteInputs;
+        copy_register_values    = !copy_coil_values;
+    }
+    else {
+        switch (static_cast<TFModbusTCPFunctionCode>(pending_response.payload.function_code)) {
+        case TFModbusTCPFunctionCode::ReadCoils:
+        case TFModbusTCPFunctionCode::ReadDiscreteInputs:
+            expected_byte_count     = (pending_transaction->data_count + 7) / 8;
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, coil_values) + expected_byte_count;
+            copy_coil_values        = true;
+            break;
 
-    case TFModbusTCPFunctionCode::WriteSingleCoil:
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
-        check_start_address     = true;
-        check_data_value        = true;
-        expected_data_value     = static_cast<uint8_t *>(pending_transaction->buffer)[0] != 0 ? 0xFF00 : 0x0000;
-        break;
+        case TFModbusTCPFunctionCode::ReadHoldingRegisters:
+        case TFModbusTCPFunctionCode::ReadInputRegisters:
+        case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+            expected_byte_count     = pending_transaction->data_count * 2;
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, register_values) + expected_byte_count;
+            copy_register_values    = true;
+            break;
 
-    case TFModbusTCPFunctionCode::WriteSingleRegister:
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
-        check_start_address     = true;
-        check_data_value        = true;
+        case TFModbusTCPFunctionCode::WriteSingleCoil:
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
+            check_start_address     = true;
+            check_data_value        = true;
+            expected_data_value     = static_cast<uint8_t *>(pending_transaction->buffer)[0] != 0 ? 0xFF00 : 0x0000;
+            break;
 
-        if (register_byte_order == TFModbusTCPByteOrder::Host) {
-            expected_data_value = static_cast<uint16_t *>(pending_transaction->buffer)[0];
-        }
-        else { // TFModbusTCPByteOrder::Network
-            expected_data_value = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[0]);
-        }
+        case TFModbusTCPFunctionCode::WriteSingleRegister:
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
+            check_start_address     = true;
+            check_data_value        = true;
 
-        break;
+            if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                expected_data_value = static_cast<uint16_t *>(pending_transaction->buffer)[0];
+            }
+            else { // TFModbusTCPByteOrder::Network
+                expected_data_value = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[0]);
+            }
 
-    case TFModbusTCPFunctionCode::WriteMultipleCoils:
-    case TFModbusTCPFunctionCode::WriteMultipleRegisters:
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
-        check_start_address     = true;
-        check_data_count        = true;
-        break;
+            break;
 
-    case TFModbusTCPFunctionCode::MaskWriteRegister:
-        expected_payload_length = offsetof(TFModbusTCPResponsePayload, sentinel);
-        check_start_address     = true;
-        check_and_mask          = true;
-        check_or_mask           = true;
+        case TFModbusTCPFunctionCode::WriteMultipleCoils:
+        case TFModbusTCPFunctionCode::WriteMultipleRegisters:
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, or_mask);
+            check_start_address     = true;
+            check_data_count        = true;
+            break;
 
-        if (register_byte_order == TFModbusTCPByteOrder::Host) {
-            expected_and_mask = static_cast<uint16_t *>(pending_transaction->buffer)[0];
-            expected_or_mask  = static_cast<uint16_t *>(pending_transaction->buffer)[1];
-        }
-        else { // TFModbusTCPByteOrder::Network
-            expected_and_mask = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[0]);
-            expected_or_mask  = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[1]);
-        }
+        case TFModbusTCPFunctionCode::MaskWriteRegister:
+            expected_payload_length = offsetof(TFModbusTCPResponsePayload, sentinel);
+            check_start_address     = true;
+            check_and_mask          = true;
+            check_or_mask           = true;
 
-        break;
+            if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                expected_and_mask = static_cast<uint16_t *>(pending_transaction->buffer)[0];
+                expected_or_mask  = static_cast<uint16_t *>(pending_transaction->buffer)[1];
+            }
+            else { // TFModbusTCPByteOrder::Network
+                expected_and_mask = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[0]);
+                expected_or_mask  = ntohs(static_cast<uint16_t *>(pending_transaction->buffer)[1]);
+            }
 
-    default:
-        snprintf(error_message, sizeof(error_message), "Unsupported function code is 0x%02x", pending_response.payload.function_code);
-        reset_pending_response();
-        finish_pending_transaction(TFModbusTCPClientTransactionResult::ResponseFunctionCodeNotSupported, error_message);
-        return true;
+            break;
+
+        default:
+            snprintf(error_message, sizeof(error_message), "Unsupported function code is 0x%02x", pending_response.payload.function_code);
+            reset_pending_response();
+            finish_pending_transaction(TFModbusTCPClientTransactionResult::ResponseFunctionCodeNotSupported, error_message);
+            return true;
+        }
     }
 
     if (pending_response_payload_used < expected_payload_length) {
@@ -634,7 +1006,10 @@ bool TFModbusTCPClient::receive_hook()
         if (pending_transaction->buffer != nullptr) {
             if (copy_coil_values) {
                 memcpy(pending_transaction->buffer, pending_response.payload.coil_values, pending_response.payload.byte_count);
-                static_cast<uint8_t *>(pending_transaction->buffer)[pending_response.payload.byte_count - 1] &= (1u << (pending_transaction->data_count % 8)) - 1;
+
+                if ((pending_transaction->data_count % 8) != 0) {
+                    static_cast<uint8_t *>(pending_transaction->buffer)[pending_response.payload.byte_count - 1] &= (1u << (pending_transaction->data_count % 8)) - 1;
+                }
             }
 
             if (copy_register_values) {
@@ -768,6 +1143,8 @@ void TFModbusTCPClient::finish_pending_transaction(uint16_t transaction_id, TFMo
 void TFModbusTCPClient::finish_pending_transaction(TFModbusTCPClientTransactionResult result, const char *error_message)
 {
     if (pending_transaction != nullptr) {
+        record_request_result(result == TFModbusTCPClientTransactionResult::Success, result == TFModbusTCPClientTransactionResult::Timeout);
+
         TFModbusTCPClientTransactionCallback callback = std::move(pending_transaction->callback);
         pending_transaction->callback = nullptr;
 
@@ -783,30 +1160,78 @@ void TFModbusTCPClient::finish_pending_transaction(TFModbusTCPClientTransactionR
 void TFModbusTCPClient::finish_all_transactions(TFModbusTCPClientTransactionResult result, const char *error_message)
 {
     finish_pending_transaction(result, error_message);
+    finish_scheduled_transactions(result, error_message);
+}
+
+void TFModbusTCPClient::finish_scheduled_transactions(TFModbusTCPClientTransactionResult result, const char *error_message)
+{
+    TFModbusTCPClientTransactionQueue *queue = queue_head;
+    queue_head    = nullptr;
+    current_queue = nullptr;
 
-    TFModbusTCPClientTransaction *scheduled_transaction = scheduled_transaction_head;
-    scheduled_transaction_head = nullptr;
+    while (queue != nullptr) {
+        TFModbusTCPClientTransaction *scheduled_transaction = queue->head;
 
-    while (scheduled_transaction != nullptr) {
-        TFModbusTCPClientTransactionCallback callback = std::move(scheduled_transaction->callback);
-        scheduled_transaction->callback = nullptr;
+        while (scheduled_transaction != nullptr) {
+            TFModbusTCPClientTransactionCallback callback = std::move(scheduled_transaction->callback);
+            scheduled_transaction->callback = nullptr;
 
-        TFModbusTCPClientTransaction *scheduled_transaction_next = scheduled_transaction->next;
+            TFModbusTCPClientTransaction *scheduled_transaction_next = scheduled_transaction->next;
 
-        delete scheduled_transaction;
-        scheduled_transaction = scheduled_transaction_next;
+            delete scheduled_transaction;
+            scheduled_transaction = scheduled_transaction_next;
 
-        callback(result, error_message);
+            callback(result, error_message);
+        }
+
+        TFModbusTCPClientTransactionQueue *queue_next = queue->next;
+
+        delete queue;
+        queue = queue_next;
     }
 }
 
 void TFModbusTCPClient::check_pending_transaction_timeout()
 {
     if (pending_transaction != nullptr && deadline_elapsed(pending_transaction_deadline)) {
+        // record the timeout first, otherwise a transaction scheduled from
+        // the callback would bypass the circuit breaker
+        record_timeout();
         finish_pending_transaction(TFModbusTCPClientTransactionResult::Timeout, nullptr);
     }
 }
 
+void TFModbusTCPClient::record_response()
+{
+    consecutive_timeout_count = 0;
+
+    if (circuit_breaker_state != TFModbusTCPClientCircuitBreakerState::Closed) {
+        debugfln("record_response() closing circuit breaker");
+
+        circuit_breaker_state = TFModbusTCPClientCircuitBreakerState::Closed;
+    }
+}
+
+void TFModbusTCPClient::record_timeout()
+{
+#if TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD > 0
+    ++consecutive_timeout_count;
+
+    if (circuit_breaker_state == TFModbusTCPClientCircuitBreakerState::Open
+     || (circuit_breaker_state == TFModbusTCPClientCircuitBreakerState::Closed
+      && consecutive_timeout_count < TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD)) {
+        return;
+    }
+
+    debugfln("record_timeout() opening circuit breaker (consecutive_timeout_count=%zu)", consecutive_timeout_count);
+
+    circuit_breaker_state          = TFModbusTCPClientCircuitBreakerState::Open;
+    circuit_breaker_probe_deadline = calculate_deadline(TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_PROBE_INTERVAL);
+
+    finish_scheduled_transactions(TFModbusTCPClientTransactionResult::CircuitBreakerOpen, "Device is not responding");
+#endif
+}
+
 void TFModbusTCPClient::reset_pending_response()
 {
     pending_response_header_used    = 0;
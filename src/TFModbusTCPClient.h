@@ -27,7 +27,23 @@
 
 // configuration
 #ifndef TF_MODBUS_TCP_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT
-#define TF_MODBUS_TCP_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT 16
+#define TF_MODBUS_TCP_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT 16 // per queue
+#endif
+
+#ifndef TF_MODBUS_TCP_CLIENT_DEFAULT_QUEUE_WEIGHT
+#define TF_MODBUS_TCP_CLIENT_DEFAULT_QUEUE_WEIGHT 1
+#endif
+
+// Consecutive timeouts after which the circuit breaker opens, 0 disables it.
+// The breaker is per connection, not per unit ID. On a gateway a single
+// unresponsive unit can therefore block all other units behind it, so this
+// is only enabled on request
+#ifndef TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD
+#define TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD 0
+#endif
+
+#ifndef TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_PROBE_INTERVAL
+#define TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_PROBE_INTERVAL 5_s
 #endif
 
 enum class TFModbusTCPClientTransactionResult
@@ -64,12 +80,40 @@ enum class TFModbusTCPClientTransactionResult
     ResponseAndMaskMismatch,
     ResponseOrMaskMismatch,
     ResponseShorterThanExpected,
+    CircuitBreakerOpen,
 };
 
 const char *get_tf_modbus_tcp_client_transaction_result_name(TFModbusTCPClientTransactionResult result);
 
+// The circuit breaker opens after TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD
+// consecutive timeouts. While it is open all scheduled and new transactions
+// fail with CircuitBreakerOpen. Once per probe interval the next transaction
+// is let through as probe. If it gets a response the circuit breaker closes
+enum class TFModbusTCPClientCircuitBreakerState
+{
+    Closed,
+    Open,
+    HalfOpen, // probe transaction is pending
+};
+
+const char *get_tf_modbus_tcp_client_circuit_breaker_state_name(TFModbusTCPClientCircuitBreakerState state);
+
 typedef std::function<void(TFModbusTCPClientTransactionResult result, const char *error_message)> TFModbusTCPClientTransactionCallback;
 
+#define TF_MODBUS_TCP_CLIENT_PREPARED_FRAME_LENGTH (TF_MODBUS_TCP_HEADER_LENGTH + 5u)
+
+// A read request that is encoded once, see TFModbusTCPClient::prepare_transaction()
+struct TFModbusTCPClientPreparedTransaction
+{
+    uint8_t unit_id;
+    TFModbusTCPFunctionCode function_code;
+    uint16_t start_address;
+    uint16_t data_count;
+    uint8_t frame[TF_MODBUS_TCP_CLIENT_PREPARED_FRAME_LENGTH]; // transaction ID is patched on send
+    uint8_t expected_byte_count;
+    size_t expected_payload_length;
+};
+
 struct TFModbusTCPClientTransaction
 {
     uint8_t unit_id;
@@ -77,11 +121,29 @@ struct TFModbusTCPClientTransaction
     uint16_t start_address;
     uint16_t data_count;
     void *buffer;
+    uint16_t write_start_address; // Read/Write Multiple Registers (23)
+    uint16_t write_data_count;    // Read/Write Multiple Registers (23)
+    void *write_buffer;           // Read/Write Multiple Registers (23)
+    const TFModbusTCPClientPreparedTransaction *prepared;
     micros_t timeout;
     TFModbusTCPClientTransactionCallback callback;
     TFModbusTCPClientTransaction *next;
 };
 
+// Scheduled transactions are queued per owner, each shared client is an owner
+// and direct calls to the client share the nullptr owner. The queues are served
+// by deficit round-robin, so one owner cannot starve the others
+struct TFModbusTCPClientTransactionQueue
+{
+    const void *owner; // only used as key
+    uint32_t weight;
+    uint32_t deficit;
+    size_t transaction_count;
+    TFModbusTCPClientTransaction *head;
+    TFModbusTCPClientTransaction **tail_ptr;
+    TFModbusTCPClientTransactionQueue *next;
+};
+
 class TFModbusTCPClient final : public TFGenericTCPClient
 {
 public:
@@ -95,7 +157,86 @@ public:
                   micros_t timeout,
                   TFModbusTCPClientTransactionCallback &&callback);
 
+    // Read/Write Multiple Registers (23)
+    void transact(uint8_t unit_id,
+                  TFModbusTCPFunctionCode function_code,
+                  uint16_t read_start_address,
+                  uint16_t read_data_count,
+                  void *read_buffer,
+                  uint16_t write_start_address,
+                  uint16_t write_data_count,
+                  void *write_buffer,
+                  micros_t timeout,
+                  TFModbusTCPClientTransactionCallback &&callback);
+
+    // Encodes a read request (function codes 1 to 4) once, so recurring reads
+    // skip building the request and most of the response checks. The prepared
+    // transaction has to stay valid until the transactions using it finished
+    static bool prepare_transaction(TFModbusTCPClientPreparedTransaction *prepared,
+                                    uint8_t unit_id,
+                                    TFModbusTCPFunctionCode function_code,
+                                    uint16_t start_address,
+                                    uint16_t data_count);
+
+    void transact(const TFModbusTCPClientPreparedTransaction *prepared,
+                  void *buffer,
+                  micros_t timeout,
+                  TFModbusTCPClientTransactionCallback &&callback);
+
+    size_t get_outstanding_request_count() const override;
+    size_t get_in_flight_request_count() const override { return pending_transaction != nullptr ? 1 : 0; }
+    bool is_send_pending() const override { return socket_fd >= 0 && pending_transaction == nullptr && queue_head != nullptr; }
+    TFModbusTCPClientCircuitBreakerState get_circuit_breaker_state() const { return circuit_breaker_state; }
+
 private:
+    friend class TFModbusTCPSharedClient;
+
+    void queue_transaction(const void *owner,
+                           uint32_t weight,
+                           uint8_t unit_id,
+                           TFModbusTCPFunctionCode function_code,
+                           uint16_t start_address,
+                           uint16_t data_count,
+                           void *buffer,
+                           micros_t timeout,
+                           TFModbusTCPClientTransactionCallback &&callback);
+
+    void queue_transaction(const void *owner,
+                           uint32_t weight,
+                           uint8_t unit_id,
+                           TFModbusTCPFunctionCode function_code,
+                           uint16_t read_start_address,
+                           uint16_t read_data_count,
+                           void *read_buffer,
+                           uint16_t write_start_address,
+                           uint16_t write_data_count,
+                           void *write_buffer,
+                           micros_t timeout,
+                           TFModbusTCPClientTransactionCallback &&callback);
+
+    void queue_transaction(const void *owner,
+                           uint32_t weight,
+                           const TFModbusTCPClientPreparedTransaction *prepared,
+                           void *buffer,
+                           micros_t timeout,
+                           TFModbusTCPClientTransactionCallback &&callback);
+
+    void schedule_transaction(const void *owner,
+                              uint32_t weight,
+                              uint8_t unit_id,
+                              TFModbusTCPFunctionCode function_code,
+                              uint16_t start_address,
+                              uint16_t data_count,
+                              void *buffer,
+                              uint16_t write_start_address,
+                              uint16_t write_data_count,
+                              void *write_buffer,
+                              const TFModbusTCPClientPreparedTransaction *prepared,
+                              micros_t timeout,
+                              TFModbusTCPClientTransactionCallback &&callback);
+
+    TFModbusTCPClientTransaction *dequeue_transaction();
+
     void close_hook() override;
     void tick_hook() override;
     bool receive_hook() override;
@@ -104,25 +245,32 @@ private:
     void finish_pending_transaction(uint16_t transaction_id, TFModbusTCPClientTransactionResult result, const char *error_message);
     void finish_pending_transaction(TFModbusTCPClientTransactionResult result, const char *error_message);
     void finish_all_transactions(TFModbusTCPClientTransactionResult result, const char *error_message);
+    void finish_scheduled_transactions(TFModbusTCPClientTransactionResult result, const char *error_message);
     void check_pending_transaction_timeout();
+    void record_response();
+    void record_timeout();
     void reset_pending_response();
 
     TFModbusTCPByteOrder register_byte_order;
     uint16_t next_transaction_id;
-    TFModbusTCPClientTransaction *pending_transaction        = nullptr;
-    uint16_t pending_transaction_id                          = 0;
-    micros_t pending_transaction_deadline                    = 0_s;
-    TFModbusTCPClientTransaction *scheduled_transaction_head = nullptr;
+    TFModbusTCPClientTransaction *pending_transaction          = nullptr;
+    uint16_t pending_transaction_id                            = 0;
+    micros_t pending_transaction_deadline                      = 0_s;
+    TFModbusTCPClientTransactionQueue *queue_head              = nullptr;
+    TFModbusTCPClientTransactionQueue *current_queue           = nullptr;
     TFModbusTCPResponse pending_response;
-    size_t pending_response_header_used                      = 0;
-    bool pending_response_header_checked                     = false;
-    size_t pending_response_payload_used                     = 0;
+    size_t pending_response_header_used                        = 0;
+    bool pending_response_header_checked                       = false;
+    size_t pending_response_payload_used                       = 0;
+    size_t consecutive_timeout_count                           = 0;
+    TFModbusTCPClientCircuitBreakerState circuit_breaker_state = TFModbusTCPClientCircuitBreakerState::Closed;
+    micros_t circuit_breaker_probe_deadline                    = 0_s;
 };
 
 class TFModbusTCPSharedClient final : public TFGenericTCPSharedClient
 {
 public:
-    TFModbusTCPSharedClient(TFModbusTCPClient *client_) : TFGenericTCPSharedClient(client_), client(client_) {}
+    TFModbusTCPSharedClient(TFModbusTCPClient *client_) : TFGenericTCPSharedClient(client_) {}
 
     void transact(uint8_t unit_id,
                   TFModbusTCPFunctionCode function_code,
@@ -132,9 +280,29 @@ public:
                   micros_t timeout,
                   TFModbusTCPClientTransactionCallback &&callback)
     {
-        client->transact(unit_id, function_code, start_address, data_count, buffer, timeout, std::move(callback));
+        static_cast<TFModbusTCPClient *>(select_client())->queue_transaction(this, get_weight(), unit_id, function_code, start_address, data_count, buffer, timeout, std::move(callback));
     }
 
-private:
-    TFModbusTCPClient *client;
+    void transact(uint8_t unit_id,
+                  TFModbusTCPFunctionCode function_code,
+                  uint16_t read_start_address,
+                  uint16_t read_data_count,
+                  void *read_buffer,
+                  uint16_t write_start_address,
+                  uint16_t write_data_count,
+                  void *write_buffer,
+                  micros_t timeout,
+                  TFModbusTCPClientTransactionCallback &&callback)
+    {
+        static_cast<TFModbusTCPClient *>(select_client())->queue_transaction(this, get_weight(), unit_id, function_code, read_start_address, read_data_count, read_buffer,
+                                                                             write_start_address, write_data_count, write_buffer, timeout, std::move(callback));
+    }
+
+    void transact(const TFModbusTCPClientPreparedTransaction *prepared,
+                  void *buffer,
+                  micros_t timeout,
+                  TFModbusTCPClientTransactionCallback &&callback)
+    {
+        static_cast<TFModbusTCPClient *>(select_client())->queue_transaction(this, get_weight(), prepared, buffer, timeout, std::move(callback));
+    }
 };
@@ -25,7 +25,10 @@
 class TFModbusTCPClientPool : public TFGenericTCPClientPool
 {
 public:
-    TFModbusTCPClientPool(TFModbusTCPByteOrder register_byte_order_) : register_byte_order(register_byte_order_) {}
+    TFModbusTCPClientPool(TFModbusTCPByteOrder register_byte_order_,
+                          size_t max_slot_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT,
+                          size_t max_share_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT) :
+        TFGenericTCPClientPool(max_slot_count_, max_share_count_), register_byte_order(register_byte_order_) {}
 
 protected:
     TFGenericTCPClient *create_client() override;
@@ -38,6 +38,10 @@ static_assert(offsetof(TFModbusTCPRequestPayload, or_mask)         == 5, "TFModb
 static_assert(offsetof(TFModbusTCPRequestPayload, coil_values)     == 6, "TFModbusTCPRequestPayload::coil_values has unexpected offset");
 static_assert(offsetof(TFModbusTCPRequestPayload, register_values) == 6, "TFModbusTCPRequestPayload::register_values has unexpected offset");
 static_assert(offsetof(TFModbusTCPRequestPayload, sentinel)        == 7, "TFModbusTCPRequestPayload::sentinel has unexpected offset");
+static_assert(offsetof(TFModbusTCPRequestPayload, write_start_address)   == 5,  "TFModbusTCPRequestPayload::write_start_address has unexpected offset");
+static_assert(offsetof(TFModbusTCPRequestPayload, write_data_count)      == 7,  "TFModbusTCPRequestPayload::write_data_count has unexpected offset");
+static_assert(offsetof(TFModbusTCPRequestPayload, write_byte_count)      == 9,  "TFModbusTCPRequestPayload::write_byte_count has unexpected offset");
+static_assert(offsetof(TFModbusTCPRequestPayload, write_register_values) == 10, "TFModbusTCPRequestPayload::write_register_values has unexpected offset");
 static_assert(offsetof(TFModbusTCPRequestPayload, bytes)           == 0, "TFModbusTCPRequestPayload::header has unexpected offset");
 
 static_assert(sizeof(TFModbusTCPRequest) == TF_MODBUS_TCP_HEADER_LENGTH + TF_MODBUS_TCP_MAX_REQUEST_PAYLOAD_LENGTH, "TFModbusTCPRequest has unexpected size");
@@ -104,6 +108,28 @@ const char *get_tf_modbus_tcp_function_code_name(TFModbusTCPFunctionCode functio
 
     case TFModbusTCPFunctionCode::MaskWriteRegister:
         return "MaskWriteRegister";
+
+    case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+        return "ReadWriteMultipleRegisters";
+    }
+
+    return "<Unknown>";
+}
+
+const char *get_tf_modbus_tcp_table_name(TFModbusTCPTable table)
+{
+    switch (table) {
+    case TFModbusTCPTable::Coils:
+        return "Coils";
+
+    case TFModbusTCPTable::DiscreteInputs:
+        return "DiscreteInputs";
+
+    case TFModbusTCPTable::HoldingRegisters:
+        return "HoldingRegisters";
+
+    case TFModbusTCPTable::InputRegisters:
+        return "InputRegisters";
     }
 
     return "<Unknown>";
@@ -43,6 +43,7 @@
 #define TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT             125u
 #define TF_MODBUS_TCP_MIN_WRITE_REGISTER_COUNT            1u
 #define TF_MODBUS_TCP_MAX_WRITE_REGISTER_COUNT            123u
+#define TF_MODBUS_TCP_MAX_READ_WRITE_WRITE_REGISTER_COUNT 121u
 #define TF_MODBUS_TCP_MIN_DATA_BYTE_COUNT                 1u
 #define TF_MODBUS_TCP_MAX_DATA_BYTE_COUNT                 250u
 
@@ -56,19 +57,30 @@ const char *get_tf_modbus_tcp_byte_order_name(TFModbusTCPByteOrder byte_order);
 
 enum class TFModbusTCPFunctionCode : uint8_t
 {
-    ReadCoils              = 1,
-    ReadDiscreteInputs     = 2,
-    ReadHoldingRegisters   = 3,
-    ReadInputRegisters     = 4,
-    WriteSingleCoil        = 5,
-    WriteSingleRegister    = 6,
-    WriteMultipleCoils     = 15,
-    WriteMultipleRegisters = 16,
-    MaskWriteRegister      = 22,
+    ReadCoils                  = 1,
+    ReadDiscreteInputs         = 2,
+    ReadHoldingRegisters       = 3,
+    ReadInputRegisters         = 4,
+    WriteSingleCoil            = 5,
+    WriteSingleRegister        = 6,
+    WriteMultipleCoils         = 15,
+    WriteMultipleRegisters     = 16,
+    MaskWriteRegister          = 22,
+    ReadWriteMultipleRegisters = 23,
 };
 
 const char *get_tf_modbus_tcp_function_code_name(TFModbusTCPFunctionCode function_code);
 
+enum class TFModbusTCPTable : uint8_t
+{
+    Coils,
+    DiscreteInputs,
+    HoldingRegisters,
+    InputRegisters,
+};
+
+const char *get_tf_modbus_tcp_table_name(TFModbusTCPTable table);
+
 enum class TFModbusTCPExceptionCode : uint8_t
 {
     Success                            = 0,
@@ -116,6 +128,7 @@ union TFModbusTCPRequestPayload
                                          // Write Multiple Coils (15),
                                          // Write Multiple Registers (16)
                                          // Mask Write Register (22)
+                                         // Read/Write Multiple Registers (23), read part
         union {
             struct [[gnu::packed]] {
                 union {
@@ -125,15 +138,24 @@ union TFModbusTCPRequestPayload
                                          // Read Input Registers (4),
                                          // Write Multiple Coils (15),
                                          // Write Multiple registers (16)
+                                         // Read/Write Multiple Registers (23), read part
                     uint16_t data_value; // Write Single Coil (5),
                                          // Write Single Register (6)
                 };
-                struct [[gnu::packed]] {
-                    uint8_t byte_count;  // Write Multiple Coils (15),
-                                         // Write Multiple Registers (16)
-                    union {
-                        uint8_t coil_values[TF_MODBUS_TCP_MAX_WRITE_COIL_BYTE_COUNT];     // Write Multiple Coils (15),
-                        uint16_t register_values[TF_MODBUS_TCP_MAX_WRITE_REGISTER_COUNT]; // Write Multiple Registers (16)
+                union {
+                    struct [[gnu::packed]] {
+                        uint8_t byte_count;  // Write Multiple Coils (15),
+                                             // Write Multiple Registers (16)
+                        union {
+                            uint8_t coil_values[TF_MODBUS_TCP_MAX_WRITE_COIL_BYTE_COUNT];     // Write Multiple Coils (15),
+                            uint16_t register_values[TF_MODBUS_TCP_MAX_WRITE_REGISTER_COUNT]; // Write Multiple Registers (16)
+                        };
+                    };
+                    struct [[gnu::packed]] {
+                        uint16_t write_start_address; // Read/Write Multiple Registers (23)
+                        uint16_t write_data_count;    // Read/Write Multiple Registers (23)
+                        uint8_t write_byte_count;     // Read/Write Multiple Registers (23)
+                        uint16_t write_register_values[TF_MODBUS_TCP_MAX_READ_WRITE_WRITE_REGISTER_COUNT]; // Read/Write Multiple Registers (23)
                     };
                 };
             };
@@ -168,12 +190,14 @@ union TFModbusTCPResponsePayload
                                          // Read Discrete Inputs (2),
                                          // Read Holding Registers (3),
                                          // Read Input Registers (4)
+                                         // Read/Write Multiple Registers (23)
                 };
                 union {
                     uint8_t coil_values[TF_MODBUS_TCP_MAX_READ_COIL_BYTE_COUNT];     // Read Coils (1),
                                                                                      // Read Discrete Inputs (2)
                     uint16_t register_values[TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT]; // Read Holding Registers (3),
                                                                                      // Read Input Registers (4)
+                                                                                     // Read/Write Multiple Registers (23)
                     uint8_t exception_sentinel;                                      // Not part of the actual protocol, there for offsetof() calculations
                 };
             };
@@ -0,0 +1,297 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPFleetStore.h"
+
+#include <math.h>
+#include <string.h>
+
+TFModbusTCPFleetSnapshot::~TFModbusTCPFleetSnapshot()
+{
+    free(values);
+    free(validity);
+}
+
+bool TFModbusTCPFleetSnapshot::resize(size_t device_count_, size_t column_count_)
+{
+    size_t new_stride = (device_count_ + 7u) & ~static_cast<size_t>(7u);
+    size_t new_validity_stride = (new_stride + 31u) / 32u;
+    float *new_values = static_cast<float *>(calloc(column_count_ * new_stride, sizeof(float)));
+    uint32_t *new_validity = static_cast<uint32_t *>(calloc(column_count_ * new_validity_stride, sizeof(uint32_t)));
+
+    if (new_values == nullptr || new_validity == nullptr) {
+        free(new_values);
+        free(new_validity);
+        return false;
+    }
+
+    // Keep existing columns, the device count doesn't change once set
+    if (new_stride == stride) {
+        memcpy(new_values, values, column_count * stride * sizeof(float));
+        memcpy(new_validity, validity, column_count * validity_stride * sizeof(uint32_t));
+    }
+
+    free(values);
+    free(validity);
+
+    values          = new_values;
+    validity        = new_validity;
+    device_count    = device_count_;
+    column_count    = column_count_;
+    stride          = new_stride;
+    validity_stride = new_validity_stride;
+
+    return true;
+}
+
+bool TFModbusTCPFleetSnapshot::is_valid(size_t device_index, size_t column_index) const
+{
+    if (device_index >= device_count || column_index >= column_count) {
+        return false;
+    }
+
+    return (get_validity(column_index)[device_index / 32] & (1u << (device_index % 32))) != 0;
+}
+
+size_t TFModbusTCPFleetSnapshot::get_valid_count(size_t column_index) const
+{
+    const uint32_t *bitmap = get_validity(column_index);
+    size_t count = 0;
+
+    for (size_t i = 0; i < validity_stride; ++i) {
+        count += static_cast<size_t>(__builtin_popcount(bitmap[i]));
+    }
+
+    return count;
+}
+
+// A single float accumulator loses precision as the sum grows with the device
+// count. Each run of 64 values is summed in 8 independent float lanes, which
+// keeps the error of the float additions small and lets the compiler use SIMD
+// without reassociating. Only the run sums are accumulated as double, because
+// double arithmetic is done in software on the ESP32
+static double sum_column(const float *column, size_t length)
+{
+    double result = 0.0;
+
+    for (size_t i = 0; i < length; i += 64) {
+        size_t run_end = i + 64 < length ? i + 64 : length;
+        float lanes[8] = {};
+
+        // length is a multiple of 8
+        for (size_t k = i; k < run_end; k += 8) {
+            for (size_t lane = 0; lane < 8; ++lane) {
+                lanes[lane] += column[k + lane];
+            }
+        }
+
+        result += static_cast<double>(((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+    }
+
+    return result;
+}
+
+float TFModbusTCPFleetSnapshot::get_sum(size_t column_index) const
+{
+    // Invalid entries are 0.0f, no need to check the bitmap
+    return static_cast<float>(sum_column(get_column(column_index), stride));
+}
+
+float TFModbusTCPFleetSnapshot::get_average(size_t column_index) const
+{
+    size_t count = get_valid_count(column_index);
+
+    if (count == 0) {
+        return NAN;
+    }
+
+    return static_cast<float>(sum_column(get_column(column_index), stride) / static_cast<double>(count));
+}
+
+bool TFModbusTCPFleetSnapshot::get_min(size_t column_index, float *value) const
+{
+    const float *column = get_column(column_index);
+    const uint32_t *bitmap = get_validity(column_index);
+    bool found = false;
+    float result = INFINITY;
+
+    for (size_t w = 0; w < validity_stride; ++w) {
+        uint32_t bits = bitmap[w];
+
+        if (bits == 0) {
+            continue;
+        }
+
+        found = true;
+
+        for (size_t i = w * 32; i < w * 32 + 32 && i < device_count; ++i) {
+            if ((bits & (1u << (i % 32))) != 0 && column[i] < result) {
+                result = column[i];
+            }
+        }
+    }
+
+    if (found) {
+        *value = result;
+    }
+
+    return found;
+}
+
+bool TFModbusTCPFleetSnapshot::get_max(size_t column_index, float *value) const
+{
+    const float *column = get_column(column_index);
+    const uint32_t *bitmap = get_validity(column_index);
+    bool found = false;
+    float result = -INFINITY;
+
+    for (size_t w = 0; w < validity_stride; ++w) {
+        uint32_t bits = bitmap[w];
+
+        if (bits == 0) {
+            continue;
+        }
+
+        found = true;
+
+        for (size_t i = w * 32; i < w * 32 + 32 && i < device_count; ++i) {
+            if ((bits & (1u << (i % 32))) != 0 && column[i] > result) {
+                result = column[i];
+            }
+        }
+    }
+
+    if (found) {
+        *value = result;
+    }
+
+    return found;
+}
+
+TFModbusTCPFleetStore::~TFModbusTCPFleetStore()
+{
+    free(columns);
+}
+
+ssize_t TFModbusTCPFleetStore::add_column(TFModbusTCPSchemaType type, float scale)
+{
+    Column *new_columns = static_cast<Column *>(realloc(columns, (column_count + 1) * sizeof(Column)));
+
+    if (new_columns == nullptr) {
+        return -1;
+    }
+
+    columns = new_columns;
+
+    if (!resize(max_device_count, column_count + 1)) {
+        return -1;
+    }
+
+    columns[column_count - 1] = Column{type, scale};
+
+    return static_cast<ssize_t>(column_count - 1);
+}
+
+bool TFModbusTCPFleetStore::set(size_t device_index, size_t column_index, float value)
+{
+    if (device_index >= device_count || column_index >= column_count) {
+        return false;
+    }
+
+    if (isnan(value)) {
+        invalidate(device_index, column_index);
+        return true;
+    }
+
+    values[column_index * stride + device_index] = value;
+    validity[column_index * validity_stride + device_index / 32] |= 1u << (device_index % 32);
+
+    return true;
+}
+
+bool TFModbusTCPFleetStore::set_registers(size_t device_index, size_t column_index, const uint16_t *registers)
+{
+    if (column_index >= column_count) {
+        return false;
+    }
+
+    const Column &column = columns[column_index];
+    uint32_t u32 = get_tf_modbus_tcp_schema_type_register_count(column.type) == 2
+                 ? (static_cast<uint32_t>(registers[0]) << 16) | registers[1] : registers[0];
+    float value;
+
+    switch (column.type) {
+    case TFModbusTCPSchemaType::Uint16:
+        value = static_cast<float>(static_cast<uint16_t>(u32));
+        break;
+
+    case TFModbusTCPSchemaType::Int16:
+        value = static_cast<float>(static_cast<int16_t>(u32));
+        break;
+
+    case TFModbusTCPSchemaType::Uint32:
+        value = static_cast<float>(u32);
+        break;
+
+    case TFModbusTCPSchemaType::Int32:
+        value = static_cast<float>(static_cast<int32_t>(u32));
+        break;
+
+    case TFModbusTCPSchemaType::Float32:
+        memcpy(&value, &u32, sizeof(value));
+        break;
+
+    default:
+        return false;
+    }
+
+    return set(device_index, column_index, value * column.scale);
+}
+
+void TFModbusTCPFleetStore::invalidate(size_t device_index, size_t column_index)
+{
+    if (device_index >= device_count || column_index >= column_count) {
+        return;
+    }
+
+    values[column_index * stride + device_index] = 0.0f;
+    validity[column_index * validity_stride + device_index / 32] &= ~(1u << (device_index % 32));
+}
+
+void TFModbusTCPFleetStore::invalidate_device(size_t device_index)
+{
+    for (size_t i = 0; i < column_count; ++i) {
+        invalidate(device_index, i);
+    }
+}
+
+bool TFModbusTCPFleetStore::take_snapshot(TFModbusTCPFleetSnapshot *snapshot) const
+{
+    if (snapshot->device_count != device_count || snapshot->column_count != column_count) {
+        if (!snapshot->resize(device_count, column_count)) {
+            return false;
+        }
+    }
+
+    memcpy(snapshot->values, values, column_count * stride * sizeof(float));
+    memcpy(snapshot->validity, validity, column_count * validity_stride * sizeof(uint32_t));
+
+    return true;
+}
@@ -0,0 +1,94 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "TFModbusTCPSchema.h"
+
+// Values of selected points of many devices, stored as one float column per
+// point with one validity bit per device. Invalid entries are kept at 0.0f,
+// so sums can run over a whole column without checking the validity bits
+class TFModbusTCPFleetSnapshot
+{
+public:
+    TFModbusTCPFleetSnapshot() {}
+    ~TFModbusTCPFleetSnapshot();
+
+    TFModbusTCPFleetSnapshot(TFModbusTCPFleetSnapshot const &other) = delete;
+    TFModbusTCPFleetSnapshot &operator=(TFModbusTCPFleetSnapshot const &other) = delete;
+
+    size_t get_device_count() const { return device_count; }
+    size_t get_column_count() const { return column_count; }
+    const float *get_column(size_t column_index) const { return &values[column_index * stride]; }
+    const uint32_t *get_validity(size_t column_index) const { return &validity[column_index * validity_stride]; }
+    bool is_valid(size_t device_index, size_t column_index) const;
+    size_t get_valid_count(size_t column_index) const;
+
+    float get_sum(size_t column_index) const; // of valid values
+    float get_average(size_t column_index) const; // NaN if no value is valid
+    bool get_min(size_t column_index, float *value) const; // false if no value is valid
+    bool get_max(size_t column_index, float *value) const;
+
+protected:
+    friend class TFModbusTCPFleetStore;
+
+    bool resize(size_t device_count_, size_t column_count_);
+
+    float *values = nullptr;       // column_count * stride
+    uint32_t *validity = nullptr;  // column_count * validity_stride
+    size_t device_count = 0;
+    size_t column_count = 0;
+    size_t stride = 0;             // device_count rounded up to a multiple of 8
+    size_t validity_stride = 0;    // stride / 32 rounded up
+};
+
+// Columns are added before the devices' polls start delivering. A consistent
+// fleet-wide view is taken with take_snapshot() between updates
+class TFModbusTCPFleetStore : public TFModbusTCPFleetSnapshot
+{
+public:
+    TFModbusTCPFleetStore(size_t device_count_) : max_device_count(device_count_) {}
+    ~TFModbusTCPFleetStore();
+
+    // Values are decoded from registers with the given type and multiplied by
+    // the scale factor. Returns the column index or -1
+    ssize_t add_column(TFModbusTCPSchemaType type, float scale = 1.0f);
+
+    bool set(size_t device_index, size_t column_index, float value);
+    bool set_registers(size_t device_index, size_t column_index, const uint16_t *registers); // host byte order, high word first
+    void invalidate(size_t device_index, size_t column_index);
+    void invalidate_device(size_t device_index);
+
+    bool take_snapshot(TFModbusTCPFleetSnapshot *snapshot) const;
+
+private:
+    struct Column
+    {
+        TFModbusTCPSchemaType type;
+        float scale;
+    };
+
+    size_t max_device_count;
+    Column *columns = nullptr;
+};
@@ -0,0 +1,414 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPPollScheduler.h"
+
+#include <string.h>
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPPollScheduler[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+struct TFModbusTCPPollSchedulerEntry
+{
+    uint8_t unit_id;
+    TFModbusTCPTable table;
+    uint16_t start_address;
+    uint16_t data_count;
+    micros_t period;
+    void *destination;
+    TFModbusTCPPollSchedulerEntryCallback callback;
+    TFModbusTCPPollSchedulerEntry *next;
+};
+
+struct TFModbusTCPPollSchedulerBlock
+{
+    uint8_t unit_id;
+    TFModbusTCPTable table;
+    uint16_t start_address;
+    uint16_t data_count;
+    micros_t period;
+    micros_t deadline;
+    bool in_flight;
+    TFModbusTCPPollSchedulerEntry **entries; // points into TFModbusTCPPollSchedulerPlan::block_entries
+    size_t entry_count;
+    void *buffer;                            // points into TFModbusTCPPollSchedulerPlan::buffer
+};
+
+// The plan outlives the scheduler while blocks are in flight, because the
+// client writes to the block buffers until the transactions are finished
+struct TFModbusTCPPollSchedulerPlan
+{
+    TFModbusTCPPollScheduler *scheduler; // nullptr after the scheduler stopped
+    size_t ref_count;                    // scheduler plus blocks in flight
+    TFModbusTCPPollSchedulerBlock *blocks;
+    size_t block_count;
+    TFModbusTCPPollSchedulerEntry **block_entries;
+    uint8_t *buffer;
+};
+
+static bool is_bit_table(TFModbusTCPTable table)
+{
+    return table == TFModbusTCPTable::Coils || table == TFModbusTCPTable::DiscreteInputs;
+}
+
+static uint32_t get_max_read_count(TFModbusTCPTable table)
+{
+    return is_bit_table(table) ? TF_MODBUS_TCP_MAX_READ_COIL_COUNT : TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT;
+}
+
+static size_t get_buffer_length(TFModbusTCPTable table, uint16_t data_count)
+{
+    // Keep register buffers 16 bit aligned
+    return is_bit_table(table) ? (data_count + 15u) / 16u * 2u : data_count * 2u;
+}
+
+static TFModbusTCPFunctionCode get_read_function_code(TFModbusTCPTable table)
+{
+    switch (table) {
+    case TFModbusTCPTable::Coils:
+        return TFModbusTCPFunctionCode::ReadCoils;
+
+    case TFModbusTCPTable::DiscreteInputs:
+        return TFModbusTCPFunctionCode::ReadDiscreteInputs;
+
+    case TFModbusTCPTable::HoldingRegisters:
+        return TFModbusTCPFunctionCode::ReadHoldingRegisters;
+
+    case TFModbusTCPTable::InputRegisters:
+        break;
+    }
+
+    return TFModbusTCPFunctionCode::ReadInputRegisters;
+}
+
+// Orders entries by period, unit ID, table and start address, so mergeable
+// entries are next to each other and blocks of the same period are grouped
+static bool entry_less(const TFModbusTCPPollSchedulerEntry *a, const TFModbusTCPPollSchedulerEntry *b)
+{
+    if (a->period != b->period) {
+        return a->period < b->period;
+    }
+
+    if (a->unit_id != b->unit_id) {
+        return a->unit_id < b->unit_id;
+    }
+
+    if (a->table != b->table) {
+        return a->table < b->table;
+    }
+
+    return a->start_address < b->start_address;
+}
+
+TFModbusTCPPollScheduler::~TFModbusTCPPollScheduler()
+{
+    stop();
+
+    while (entry_head != nullptr) {
+        TFModbusTCPPollSchedulerEntry *entry = entry_head;
+
+        entry_head = entry->next;
+
+        delete entry;
+    }
+}
+
+bool TFModbusTCPPollScheduler::add(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, micros_t period,
+                                   void *destination, TFModbusTCPPollSchedulerEntryCallback &&callback /*= nullptr*/)
+{
+    if (plan != nullptr) {
+        debugfln("add(unit_id=%u start_address=%u) already running", unit_id, start_address);
+        return false;
+    }
+
+    if (data_count < 1 || data_count > get_max_read_count(table) || static_cast<uint32_t>(start_address) + data_count > 65536u || period <= 0_s || destination == nullptr) {
+        debugfln("add(unit_id=%u start_address=%u data_count=%u) invalid argument", unit_id, start_address, data_count);
+        return false;
+    }
+
+    TFModbusTCPPollSchedulerEntry *entry = new TFModbusTCPPollSchedulerEntry;
+
+    entry->unit_id       = unit_id;
+    entry->table         = table;
+    entry->start_address = start_address;
+    entry->data_count    = data_count;
+    entry->period        = period;
+    entry->destination   = destination;
+    entry->callback      = std::move(callback);
+    entry->next          = entry_head;
+
+    entry_head = entry;
+    ++entry_count;
+
+    return true;
+}
+
+bool TFModbusTCPPollScheduler::start()
+{
+    if (plan != nullptr || entry_count == 0) {
+        debugfln("start() already running or no entries");
+        return false;
+    }
+
+    TFModbusTCPPollSchedulerEntry **sorted_entries = new TFModbusTCPPollSchedulerEntry *[entry_count];
+    size_t sorted_count = 0;
+
+    // Insertion sort, plans are small and built once
+    for (TFModbusTCPPollSchedulerEntry *entry = entry_head; entry != nullptr; entry = entry->next) {
+        size_t i = sorted_count++;
+
+        while (i > 0 && entry_less(entry, sorted_entries[i - 1])) {
+            sorted_entries[i] = sorted_entries[i - 1];
+            --i;
+        }
+
+        sorted_entries[i] = entry;
+    }
+
+    TFModbusTCPPollSchedulerBlock *blocks = new TFModbusTCPPollSchedulerBlock[entry_count]; // upper bound
+    size_t block_count = 0;
+    size_t buffer_length = 0;
+
+    for (size_t i = 0; i < entry_count; ++i) {
+        TFModbusTCPPollSchedulerEntry *entry = sorted_entries[i];
+        TFModbusTCPPollSchedulerBlock *block = block_count > 0 ? &blocks[block_count - 1] : nullptr;
+
+        if (block != nullptr
+         && block->period == entry->period
+         && block->unit_id == entry->unit_id
+         && block->table == entry->table) {
+            uint32_t block_end = static_cast<uint32_t>(block->start_address) + block->data_count;
+            uint32_t entry_end = static_cast<uint32_t>(entry->start_address) + entry->data_count;
+            uint32_t merged_end = entry_end > block_end ? entry_end : block_end;
+
+            if (entry->start_address <= block_end + TF_MODBUS_TCP_POLL_SCHEDULER_MAX_GAP
+             && merged_end - block->start_address <= get_max_read_count(block->table)) {
+                block->data_count = static_cast<uint16_t>(merged_end - block->start_address);
+                ++block->entry_count;
+                continue;
+            }
+        }
+
+        block = &blocks[block_count++];
+
+        block->unit_id       = entry->unit_id;
+        block->table         = entry->table;
+        block->start_address = entry->start_address;
+        block->data_count    = entry->data_count;
+        block->period        = entry->period;
+        block->deadline      = 0_s;
+        block->in_flight     = false;
+        block->entries       = &sorted_entries[i];
+        block->entry_count   = 1;
+        block->buffer        = nullptr;
+    }
+
+    for (size_t i = 0; i < block_count; ++i) {
+        buffer_length += get_buffer_length(blocks[i].table, blocks[i].data_count);
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(buffer_length));
+
+    if (buffer == nullptr) {
+        debugfln("start() could not allocate %zu buffer bytes", buffer_length);
+
+        delete[] blocks;
+        delete[] sorted_entries;
+        return false;
+    }
+
+    size_t buffer_offset = 0;
+    micros_t now = now_us();
+
+    for (size_t i = 0; i < block_count; ) {
+        // Stagger the blocks of each period evenly over the period
+        size_t group_end = i + 1;
+
+        while (group_end < block_count && blocks[group_end].period == blocks[i].period) {
+            ++group_end;
+        }
+
+        size_t group_size = group_end - i;
+
+        for (size_t k = 0; k < group_size; ++k) {
+            TFModbusTCPPollSchedulerBlock *block = &blocks[i + k];
+
+            block->deadline = now + micros_t{static_cast<int64_t>(block->period) * static_cast<int64_t>(k) / static_cast<int64_t>(group_size)};
+            block->buffer   = buffer + buffer_offset;
+
+            buffer_offset += get_buffer_length(block->table, block->data_count);
+
+            debugfln("start() block (unit_id=%u table=%s start_address=%u data_count=%u entry_count=%zu period=%lli)",
+                     block->unit_id, get_tf_modbus_tcp_table_name(block->table), block->start_address, block->data_count,
+                     block->entry_count, static_cast<long long>(static_cast<int64_t>(block->period)));
+        }
+
+        i = group_end;
+    }
+
+    plan = new TFModbusTCPPollSchedulerPlan;
+
+    plan->scheduler     = this;
+    plan->ref_count     = 1;
+    plan->blocks        = blocks;
+    plan->block_count   = block_count;
+    plan->block_entries = sorted_entries;
+    plan->buffer        = buffer;
+
+    return true;
+}
+
+void TFModbusTCPPollScheduler::stop()
+{
+    if (plan == nullptr) {
+        return;
+    }
+
+    plan->scheduler = nullptr;
+
+    release_plan(plan);
+    plan = nullptr;
+}
+
+void TFModbusTCPPollScheduler::tick()
+{
+    TFModbusTCPPollSchedulerPlan *current_plan = plan;
+
+    if (current_plan == nullptr) {
+        return;
+    }
+
+    for (size_t i = 0; i < current_plan->block_count; ++i) {
+        TFModbusTCPPollSchedulerBlock *block = &current_plan->blocks[i];
+
+        if (!deadline_elapsed(block->deadline)) {
+            continue;
+        }
+
+        // Keep the stagger, unless the block fell behind
+        block->deadline = block->deadline + block->period;
+
+        if (deadline_elapsed(block->deadline)) {
+            block->deadline = calculate_deadline(block->period);
+        }
+
+        if (block->in_flight) {
+            debugfln("tick() overrun (unit_id=%u table=%s start_address=%u data_count=%u)",
+                     block->unit_id, get_tf_modbus_tcp_table_name(block->table), block->start_address, block->data_count);
+
+            ++overrun_count;
+
+            if (overrun_callback) {
+                overrun_callback(block->unit_id, block->table, block->start_address, block->data_count);
+            }
+        }
+        else {
+            block->in_flight = true;
+            ++current_plan->ref_count;
+
+            TFModbusTCPClientTransactionCallback callback =
+            [current_plan, i](TFModbusTCPClientTransactionResult result, const char *error_message) {
+                (void)error_message;
+                finish_block(current_plan, i, result);
+            };
+
+            if (shared_client != nullptr) {
+                shared_client->transact(block->unit_id, get_read_function_code(block->table), block->start_address, block->data_count,
+                                        block->buffer, block->period, std::move(callback));
+            }
+            else {
+                client->transact(block->unit_id, get_read_function_code(block->table), block->start_address, block->data_count,
+                                 block->buffer, block->period, std::move(callback));
+            }
+        }
+
+        // A callback might have stopped the scheduler
+        if (plan != current_plan) {
+            return;
+        }
+    }
+}
+
+size_t TFModbusTCPPollScheduler::get_block_count() const
+{
+    return plan != nullptr ? plan->block_count : 0;
+}
+
+void TFModbusTCPPollScheduler::finish_block(TFModbusTCPPollSchedulerPlan *plan, size_t block_index, TFModbusTCPClientTransactionResult result)
+{
+    TFModbusTCPPollSchedulerBlock *block = &plan->blocks[block_index];
+
+    block->in_flight = false;
+
+    for (size_t i = 0; i < block->entry_count && plan->scheduler != nullptr; ++i) {
+        TFModbusTCPPollSchedulerEntry *entry = block->entries[i];
+
+        if (result == TFModbusTCPClientTransactionResult::Success) {
+            uint16_t offset = entry->start_address - block->start_address;
+
+            if (is_bit_table(block->table)) {
+                const uint8_t *source = static_cast<const uint8_t *>(block->buffer);
+                uint8_t *destination = static_cast<uint8_t *>(entry->destination);
+
+                if (offset % 8 == 0) {
+                    memcpy(destination, source + offset / 8, (entry->data_count + 7u) / 8u);
+                }
+                else {
+                    memset(destination, 0, (entry->data_count + 7u) / 8u);
+
+                    for (uint16_t k = 0; k < entry->data_count; ++k) {
+                        uint16_t bit = offset + k;
+
+                        if ((source[bit / 8] & (1u << (bit % 8))) != 0) {
+                            destination[k / 8] |= static_cast<uint8_t>(1u << (k % 8));
+                        }
+                    }
+                }
+
+                // Bits past the end of the entry belong to other entries
+                if (entry->data_count % 8 != 0) {
+                    destination[entry->data_count / 8] &= static_cast<uint8_t>((1u << (entry->data_count % 8)) - 1u);
+                }
+            }
+            else {
+                memcpy(entry->destination, static_cast<const uint16_t *>(block->buffer) + offset, entry->data_count * sizeof(uint16_t));
+            }
+        }
+
+        if (entry->callback) {
+            entry->callback(result);
+        }
+    }
+
+    release_plan(plan);
+}
+
+void TFModbusTCPPollScheduler::release_plan(TFModbusTCPPollSchedulerPlan *plan)
+{
+    if (--plan->ref_count > 0) {
+        return;
+    }
+
+    free(plan->buffer);
+    delete[] plan->blocks;
+    delete[] plan->block_entries;
+    delete plan;
+}
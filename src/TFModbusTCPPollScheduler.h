@@ -0,0 +1,84 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "TFModbusTCPClient.h"
+
+// configuration
+
+// Unused registers or bits between two entries that are still read as part of
+// one block. Reading them fails if the device doesn't implement them
+#ifndef TF_MODBUS_TCP_POLL_SCHEDULER_MAX_GAP
+#define TF_MODBUS_TCP_POLL_SCHEDULER_MAX_GAP 0
+#endif
+
+typedef std::function<void(TFModbusTCPClientTransactionResult result)> TFModbusTCPPollSchedulerEntryCallback;
+typedef std::function<void(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count)> TFModbusTCPPollSchedulerOverrunCallback;
+
+struct TFModbusTCPPollSchedulerEntry;
+struct TFModbusTCPPollSchedulerPlan;
+
+// Reads a fixed set of register or bit ranges periodically. Entries of the same
+// unit, table and period are merged into blocks within the protocol limits.
+// The blocks of each period are staggered evenly over the period. Data is read
+// into buffers owned by the scheduler and copied to the destinations of the
+// entries afterwards, registers as uint16_t values in the register byte order
+// of the client and bits packed LSB first. If a block is still in flight when it is due again, then this
+// cycle is skipped and reported as overrun
+class TFModbusTCPPollScheduler
+{
+public:
+    TFModbusTCPPollScheduler(TFModbusTCPClient *client_) : client(client_) {}
+    TFModbusTCPPollScheduler(TFModbusTCPSharedClient *shared_client_) : shared_client(shared_client_) {}
+    ~TFModbusTCPPollScheduler();
+
+    TFModbusTCPPollScheduler(TFModbusTCPPollScheduler const &other) = delete;
+    TFModbusTCPPollScheduler &operator=(TFModbusTCPPollScheduler const &other) = delete;
+
+    // The destination has to stay valid while the scheduler is running. The
+    // optional callback is called after every read of the entry's block
+    bool add(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, micros_t period,
+             void *destination, TFModbusTCPPollSchedulerEntryCallback &&callback = nullptr);
+    void set_overrun_callback(TFModbusTCPPollSchedulerOverrunCallback &&callback) { overrun_callback = std::move(callback); }
+
+    bool start(); // computes the blocks, entries cannot be added while running
+    void stop();
+    void tick();
+
+    bool is_running() const { return plan != nullptr; }
+    size_t get_block_count() const;
+    uint32_t get_overrun_count() const { return overrun_count; }
+
+private:
+    static void finish_block(TFModbusTCPPollSchedulerPlan *plan, size_t block_index, TFModbusTCPClientTransactionResult result);
+    static void release_plan(TFModbusTCPPollSchedulerPlan *plan);
+
+    TFModbusTCPClient *client = nullptr;
+    TFModbusTCPSharedClient *shared_client = nullptr;
+    TFModbusTCPPollSchedulerEntry *entry_head = nullptr;
+    size_t entry_count = 0;
+    TFModbusTCPPollSchedulerPlan *plan = nullptr;
+    TFModbusTCPPollSchedulerOverrunCallback overrun_callback;
+    uint32_t overrun_count = 0;
+};
@@ -0,0 +1,442 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPRecorder.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if TF_MODBUS_TCP_RECORDER_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPRecorder[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+#define TF_MODBUS_TCP_RECORDER_MAGIC         0x524D4654u // "TFMR"
+#define TF_MODBUS_TCP_RECORDER_VERSION       1u
+#define TF_MODBUS_TCP_RECORDER_PADDING_TABLE 0xFF
+
+struct TFModbusTCPRecorderFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_length;
+    uint32_t reserved0;
+    uint64_t data_length;
+    uint64_t tail;
+    uint64_t head;
+    uint64_t record_count;
+    uint64_t reserved1[2];
+};
+
+static_assert(sizeof(TFModbusTCPRecorderFileHeader) == 64, "Unexpected file header length");
+
+struct TFModbusTCPRecorderRecordHeader
+{
+    uint32_t record_length;
+    uint8_t unit_id;
+    uint8_t table;
+    uint16_t start_address;
+    uint16_t data_count;
+    uint16_t reserved0;
+    uint32_t reserved1;
+    int64_t timestamp;
+};
+
+static_assert(sizeof(TFModbusTCPRecorderRecordHeader) == 24, "Unexpected record header length");
+
+static size_t get_values_length(TFModbusTCPTable table, uint16_t data_count)
+{
+    return table == TFModbusTCPTable::Coils || table == TFModbusTCPTable::DiscreteInputs ? (data_count + 7u) / 8u : data_count * 2u;
+}
+
+static bool is_header_valid(const TFModbusTCPRecorderFileHeader *header, size_t region_length)
+{
+    return header->magic == TF_MODBUS_TCP_RECORDER_MAGIC
+        && header->version == TF_MODBUS_TCP_RECORDER_VERSION
+        && header->header_length == sizeof(TFModbusTCPRecorderFileHeader)
+        && header->data_length == region_length - sizeof(TFModbusTCPRecorderFileHeader)
+        && header->tail <= header->head
+        && header->head - header->tail <= header->data_length;
+}
+
+TFModbusTCPRecorder::~TFModbusTCPRecorder()
+{
+    close();
+}
+
+bool TFModbusTCPRecorder::open(const char *path, size_t data_length)
+{
+    if (region != nullptr) {
+        debugfln("open() already open");
+        return false;
+    }
+
+    data_length &= ~static_cast<size_t>(7u);
+
+    if (data_length < sizeof(TFModbusTCPRecorderRecordHeader)) {
+        debugfln("open(data_length=%zu) invalid argument", data_length);
+        return false;
+    }
+
+    size_t length = sizeof(TFModbusTCPRecorderFileHeader) + data_length;
+
+    if (path == nullptr) {
+        region = static_cast<uint8_t *>(calloc(1, length));
+
+        if (region == nullptr) {
+            debugfln("open() could not allocate %zu bytes", length);
+            return false;
+        }
+    }
+    else {
+#if TF_MODBUS_TCP_RECORDER_MMAP
+        int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0) {
+            debugfln("open(path=%s) failed: %s (%d)", path, strerror(errno), errno);
+            return false;
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) < 0 || (static_cast<size_t>(st.st_size) != length && ftruncate(fd, static_cast<off_t>(length)) < 0)) {
+            debugfln("open(path=%s) could not resize file: %s (%d)", path, strerror(errno), errno);
+            ::close(fd);
+            return false;
+        }
+
+        void *new_region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        ::close(fd);
+
+        if (new_region == MAP_FAILED) {
+            debugfln("open(path=%s) mmap failed: %s (%d)", path, strerror(errno), errno);
+            return false;
+        }
+
+        region = static_cast<uint8_t *>(new_region);
+        mapped = true;
+#else
+        debugfln("open() mmap not supported");
+        return false;
+#endif
+    }
+
+    region_length = length;
+
+    TFModbusTCPRecorderFileHeader *header = reinterpret_cast<TFModbusTCPRecorderFileHeader *>(region);
+
+    if (!is_header_valid(header, region_length)) {
+        memset(header, 0, sizeof(TFModbusTCPRecorderFileHeader));
+
+        header->version       = TF_MODBUS_TCP_RECORDER_VERSION;
+        header->header_length = sizeof(TFModbusTCPRecorderFileHeader);
+        header->data_length   = data_length;
+
+        __atomic_store_n(&header->magic, TF_MODBUS_TCP_RECORDER_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    dropped_count = 0;
+
+    return true;
+}
+
+void TFModbusTCPRecorder::close()
+{
+    if (region == nullptr) {
+        return;
+    }
+
+    if (mapped) {
+#if TF_MODBUS_TCP_RECORDER_MMAP
+        munmap(region, region_length);
+#endif
+    }
+    else {
+        free(region);
+    }
+
+    region        = nullptr;
+    region_length = 0;
+    mapped        = false;
+}
+
+bool TFModbusTCPRecorder::flush()
+{
+#if TF_MODBUS_TCP_RECORDER_MMAP
+    if (mapped && msync(region, region_length, MS_SYNC) < 0) {
+        debugfln("flush() msync failed: %s (%d)", strerror(errno), errno);
+        return false;
+    }
+#endif
+
+    return region != nullptr;
+}
+
+bool TFModbusTCPRecorder::record(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, const void *values, micros_t timestamp)
+{
+    if (region == nullptr) {
+        return false;
+    }
+
+    TFModbusTCPRecorderFileHeader *header = reinterpret_cast<TFModbusTCPRecorderFileHeader *>(region);
+    uint8_t *data = region + sizeof(TFModbusTCPRecorderFileHeader);
+    uint64_t data_length = header->data_length;
+    size_t values_length = get_values_length(table, data_count);
+    uint32_t record_length = static_cast<uint32_t>((sizeof(TFModbusTCPRecorderRecordHeader) + values_length + 7u) & ~static_cast<size_t>(7u));
+
+    if (record_length > data_length) {
+        ++dropped_count;
+        return false;
+    }
+
+    uint64_t head = header->head;
+    uint64_t tail = header->tail;
+    uint64_t offset = head % data_length;
+
+    // Fill the end of the ring with a padding record, records never wrap
+    if (offset + record_length > data_length) {
+        uint32_t padding_length = static_cast<uint32_t>(data_length - offset);
+
+        while (head + padding_length - tail > data_length) {
+            tail += reinterpret_cast<TFModbusTCPRecorderRecordHeader *>(data + tail % data_length)->record_length;
+        }
+
+        __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+
+        TFModbusTCPRecorderRecordHeader *padding = reinterpret_cast<TFModbusTCPRecorderRecordHeader *>(data + offset);
+
+        padding->record_length = padding_length;
+        padding->table         = TF_MODBUS_TCP_RECORDER_PADDING_TABLE;
+
+        head += padding_length;
+        offset = 0;
+
+        __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+    }
+
+    // Release the oldest records before overwriting them
+    while (head + record_length - tail > data_length) {
+        tail += reinterpret_cast<TFModbusTCPRecorderRecordHeader *>(data + tail % data_length)->record_length;
+    }
+
+    __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+
+    TFModbusTCPRecorderRecordHeader *record_header = reinterpret_cast<TFModbusTCPRecorderRecordHeader *>(data + offset);
+
+    record_header->record_length = record_length;
+    record_header->unit_id       = unit_id;
+    record_header->table         = static_cast<uint8_t>(table);
+    record_header->start_address = start_address;
+    record_header->data_count    = data_count;
+    record_header->reserved0     = 0;
+    record_header->reserved1     = 0;
+    record_header->timestamp     = static_cast<int64_t>(timestamp);
+
+    memcpy(record_header + 1, values, values_length);
+
+    header->record_count += 1;
+
+    __atomic_store_n(&header->head, head + record_length, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+uint64_t TFModbusTCPRecorder::get_record_count() const
+{
+    return region != nullptr ? reinterpret_cast<const TFModbusTCPRecorderFileHeader *>(region)->record_count : 0;
+}
+
+#undef debugfln
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPRecorderReader[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+TFModbusTCPRecorderReader::~TFModbusTCPRecorderReader()
+{
+    close();
+}
+
+bool TFModbusTCPRecorderReader::open(const char *path)
+{
+#if TF_MODBUS_TCP_RECORDER_MMAP
+    if (region != nullptr || path == nullptr) {
+        debugfln("open() already open or invalid argument");
+        return false;
+    }
+
+    int fd = ::open(path, O_RDONLY);
+
+    if (fd < 0) {
+        debugfln("open(path=%s) failed: %s (%d)", path, strerror(errno), errno);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) <= sizeof(TFModbusTCPRecorderFileHeader)) {
+        debugfln("open(path=%s) file missing or too short", path);
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    void *new_region = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (new_region == MAP_FAILED) {
+        debugfln("open(path=%s) mmap failed: %s (%d)", path, strerror(errno), errno);
+        return false;
+    }
+
+    if (!is_header_valid(static_cast<const TFModbusTCPRecorderFileHeader *>(new_region), length)) {
+        debugfln("open(path=%s) invalid or incompatible file header", path);
+        munmap(new_region, length);
+        return false;
+    }
+
+    region        = static_cast<const uint8_t *>(new_region);
+    region_length = length;
+    mapped        = true;
+
+    rewind();
+
+    return true;
+#else
+    (void)path;
+
+    debugfln("open() mmap not supported");
+    return false;
+#endif
+}
+
+bool TFModbusTCPRecorderReader::open(const TFModbusTCPRecorder *recorder)
+{
+    if (region != nullptr || recorder->region == nullptr) {
+        debugfln("open() already open or recorder not open");
+        return false;
+    }
+
+    region        = recorder->region;
+    region_length = recorder->region_length;
+    mapped        = false;
+
+    rewind();
+
+    return true;
+}
+
+void TFModbusTCPRecorderReader::close()
+{
+    if (region == nullptr) {
+        return;
+    }
+
+#if TF_MODBUS_TCP_RECORDER_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t *>(region), region_length);
+    }
+#endif
+
+    region        = nullptr;
+    region_length = 0;
+    mapped        = false;
+}
+
+void TFModbusTCPRecorderReader::rewind()
+{
+    if (region != nullptr) {
+        position = __atomic_load_n(&reinterpret_cast<const TFModbusTCPRecorderFileHeader *>(region)->tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+bool TFModbusTCPRecorderReader::next(TFModbusTCPRecorderRecord *record)
+{
+    if (region == nullptr) {
+        return false;
+    }
+
+    const TFModbusTCPRecorderFileHeader *header = reinterpret_cast<const TFModbusTCPRecorderFileHeader *>(region);
+    const uint8_t *data = region + sizeof(TFModbusTCPRecorderFileHeader);
+    uint64_t data_length = header->data_length;
+
+    while (true) {
+        uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+
+        if (position < tail) {
+            position = tail; // lapped by the writer
+        }
+
+        if (position >= head) {
+            return false;
+        }
+
+        uint64_t offset = position % data_length;
+        const TFModbusTCPRecorderRecordHeader *record_header = reinterpret_cast<const TFModbusTCPRecorderRecordHeader *>(data + offset);
+
+        // Padding records can be as short as 8 bytes, only the record length
+        // and the table are valid in all records
+        uint32_t record_length = record_header->record_length;
+        uint8_t table = record_header->table;
+
+        // The record might have been overwritten while it was read
+        if (position < __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        if (record_length < 8 || (record_length % 8) != 0 || offset + record_length > data_length) {
+            debugfln("next() corrupt record at position %llu", static_cast<unsigned long long>(position));
+            return false;
+        }
+
+        if (table == TF_MODBUS_TCP_RECORDER_PADDING_TABLE) {
+            position += record_length;
+            continue;
+        }
+
+        if (record_length < sizeof(TFModbusTCPRecorderRecordHeader)) {
+            debugfln("next() corrupt record at position %llu", static_cast<unsigned long long>(position));
+            return false;
+        }
+
+        TFModbusTCPRecorderRecordHeader copy = *record_header;
+
+        if (position < __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        position += record_length;
+
+        record->timestamp     = micros_t{copy.timestamp};
+        record->unit_id       = copy.unit_id;
+        record->table         = static_cast<TFModbusTCPTable>(copy.table);
+        record->start_address = copy.start_address;
+        record->data_count    = copy.data_count;
+        record->values        = record_header + 1;
+
+        return true;
+    }
+}
@@ -0,0 +1,138 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <TFTools/Micros.h>
+
+#include "TFModbusTCPCommon.h"
+
+// configuration
+#ifndef TF_MODBUS_TCP_RECORDER_MMAP
+#if defined(__linux__) || defined(__APPLE__)
+#define TF_MODBUS_TCP_RECORDER_MMAP 1
+#else
+#define TF_MODBUS_TCP_RECORDER_MMAP 0
+#endif
+#endif
+
+// Records polled register and bit ranges into a fixed size ring. The ring is
+// a memory-mapped file, so that offline tools can read it directly. All fields
+// are little endian (host byte order of all supported targets):
+//
+//   file header, 64 bytes
+//     0  uint32 magic "TFMR" (0x524D4654)
+//     4  uint32 version (1)
+//     8  uint32 header length (64)
+//    12  uint32 reserved
+//    16  uint64 data length, size of the ring after the header, multiple of 8
+//    24  uint64 tail, position of the oldest record
+//    32  uint64 head, position after the newest committed record
+//    40  uint64 committed record count since creation
+//    48  uint64 reserved (2x)
+//
+//   record, 8 byte aligned at header length + (position % data length)
+//     0  uint32 record length, including this header and the padding
+//     4  uint8  unit ID
+//     5  uint8  table (TFModbusTCPTable), 0xFF for a padding record
+//     6  uint16 start address
+//     8  uint16 data count, registers or bits
+//    10  uint16 reserved
+//    12  uint32 reserved
+//    16  int64  timestamp in microseconds
+//    24  values: registers as uint16 in the register byte order of the client
+//        that read them, bits packed LSB first, padded to 8 bytes
+//
+// Positions are free running byte counts. Records never wrap: if a record does
+// not fit before the end of the ring, then the remaining space is filled with
+// a padding record. The writer advances the tail past the records it is about
+// to overwrite before writing and advances the head after the record is
+// complete. Everything between tail and head is valid after a crash.
+//
+// Without mmap support the ring can only be created without path, in memory
+// of the own process
+class TFModbusTCPRecorder
+{
+public:
+    TFModbusTCPRecorder() {}
+    ~TFModbusTCPRecorder();
+
+    TFModbusTCPRecorder(TFModbusTCPRecorder const &other) = delete;
+    TFModbusTCPRecorder &operator=(TFModbusTCPRecorder const &other) = delete;
+
+    // Reopens an existing compatible file of the same data length and keeps
+    // its records, otherwise the file is initialized
+    bool open(const char *path, size_t data_length);
+    void close();
+    bool is_open() const { return region != nullptr; }
+    bool flush(); // msync to the file
+
+    // Meant to be called from the poll callback, copies the values once
+    bool record(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, const void *values, micros_t timestamp = now_us());
+
+    uint64_t get_record_count() const;
+    uint64_t get_dropped_count() const { return dropped_count; } // records larger than the ring
+
+private:
+    friend class TFModbusTCPRecorderReader;
+
+    uint8_t *region = nullptr;
+    size_t region_length = 0;
+    bool mapped = false;
+    uint64_t dropped_count = 0;
+};
+
+struct TFModbusTCPRecorderRecord
+{
+    micros_t timestamp;
+    uint8_t unit_id;
+    TFModbusTCPTable table;
+    uint16_t start_address;
+    uint16_t data_count;
+    const void *values; // points into the ring, valid until the next call to next()
+};
+
+// Iterates over the records of a recorder file from oldest to newest. Records
+// that the writer overwrote before they were reached are skipped. While the
+// writer is active the values of a returned record can be overwritten if the
+// writer laps the reader
+class TFModbusTCPRecorderReader
+{
+public:
+    TFModbusTCPRecorderReader() {}
+    ~TFModbusTCPRecorderReader();
+
+    TFModbusTCPRecorderReader(TFModbusTCPRecorderReader const &other) = delete;
+    TFModbusTCPRecorderReader &operator=(TFModbusTCPRecorderReader const &other) = delete;
+
+    bool open(const char *path);
+    bool open(const TFModbusTCPRecorder *recorder); // in-process, for recorders without file
+    void close();
+    void rewind(); // restart at the current tail
+    bool next(TFModbusTCPRecorderRecord *record); // false if no newer committed record exists
+
+private:
+    const uint8_t *region = nullptr;
+    size_t region_length = 0;
+    bool mapped = false;
+    uint64_t position = 0;
+};
@@ -0,0 +1,502 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPRegisterImage.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPRegisterImage[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+#define TF_MODBUS_TCP_REGISTER_IMAGE_MAGIC   0x49524D54u // "TMRI"
+#define TF_MODBUS_TCP_REGISTER_IMAGE_VERSION 1u
+
+// The layout is shared between processes, only use fixed size types
+struct TFModbusTCPRegisterImageHeader
+{
+    uint32_t magic; // written last by the creator
+    uint32_t version;
+    uint32_t block_count;
+    uint32_t region_length;
+};
+
+struct TFModbusTCPRegisterImageBlock
+{
+    uint32_t sequence; // odd while the block is being written
+    uint8_t unit_id;
+    uint8_t table;
+    uint16_t start_address;
+    uint16_t data_count;
+    uint16_t reserved;
+    uint32_t data_offset; // from the start of the region, 8 byte aligned
+};
+
+static bool is_bit_table(TFModbusTCPTable table)
+{
+    return table == TFModbusTCPTable::Coils || table == TFModbusTCPTable::DiscreteInputs;
+}
+
+static size_t get_data_length(TFModbusTCPTable table, uint16_t data_count)
+{
+    return is_bit_table(table) ? (data_count + 7u) / 8u : data_count * 2u;
+}
+
+// The region comes from another process, make sure that all blocks and their
+// data are within the region before trusting the offsets
+static bool is_layout_valid(const TFModbusTCPRegisterImageHeader *header, size_t length)
+{
+    size_t blocks_end = sizeof(TFModbusTCPRegisterImageHeader) + static_cast<size_t>(header->block_count) * sizeof(TFModbusTCPRegisterImageBlock);
+
+    if (header->block_count > (length - sizeof(TFModbusTCPRegisterImageHeader)) / sizeof(TFModbusTCPRegisterImageBlock)) {
+        return false;
+    }
+
+    const TFModbusTCPRegisterImageBlock *blocks = reinterpret_cast<const TFModbusTCPRegisterImageBlock *>(header + 1);
+
+    for (uint32_t i = 0; i < header->block_count; ++i) {
+        const TFModbusTCPRegisterImageBlock *block = &blocks[i];
+
+        if (block->table > static_cast<uint8_t>(TFModbusTCPTable::InputRegisters)
+         || block->data_count == 0
+         || block->data_offset < blocks_end
+         || block->data_offset > length
+         || get_data_length(static_cast<TFModbusTCPTable>(block->table), block->data_count) > length - block->data_offset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void copy_bits(uint8_t *target, uint16_t target_offset, const uint8_t *source, uint16_t source_offset, uint16_t bit_count)
+{
+    for (uint16_t i = 0; i < bit_count; ++i) {
+        uint16_t source_bit = source_offset + i;
+        uint16_t target_bit = target_offset + i;
+
+        if ((source[source_bit / 8] & (1u << (source_bit % 8))) != 0) {
+            target[target_bit / 8] |= static_cast<uint8_t>(1u << (target_bit % 8));
+        }
+        else {
+            target[target_bit / 8] &= static_cast<uint8_t>(~(1u << (target_bit % 8)));
+        }
+    }
+}
+
+TFModbusTCPRegisterImage::~TFModbusTCPRegisterImage()
+{
+    close();
+    free(pending_blocks);
+}
+
+bool TFModbusTCPRegisterImage::add_block(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count)
+{
+    if (header != nullptr) {
+        debugfln("add_block(unit_id=%u start_address=%u) already open", unit_id, start_address);
+        return false;
+    }
+
+    if (data_count == 0 || static_cast<uint32_t>(start_address) + data_count > 65536u) {
+        debugfln("add_block(unit_id=%u start_address=%u data_count=%u) invalid argument", unit_id, start_address, data_count);
+        return false;
+    }
+
+    TFModbusTCPRegisterImageBlockInfo *blocks = static_cast<TFModbusTCPRegisterImageBlockInfo *>(realloc(pending_blocks, (pending_block_count + 1) * sizeof(TFModbusTCPRegisterImageBlockInfo)));
+
+    if (blocks == nullptr) {
+        return false;
+    }
+
+    pending_blocks = blocks;
+    pending_blocks[pending_block_count++] = TFModbusTCPRegisterImageBlockInfo{unit_id, table, start_address, data_count};
+
+    return true;
+}
+
+bool TFModbusTCPRegisterImage::create(const char *name_)
+{
+    if (header != nullptr || pending_block_count == 0) {
+        debugfln("create() already open or no blocks");
+        return false;
+    }
+
+    size_t data_offset = sizeof(TFModbusTCPRegisterImageHeader) + pending_block_count * sizeof(TFModbusTCPRegisterImageBlock);
+
+    data_offset = (data_offset + 7u) & ~static_cast<size_t>(7u);
+
+    size_t length = data_offset;
+
+    for (size_t i = 0; i < pending_block_count; ++i) {
+        length += (get_data_length(pending_blocks[i].table, pending_blocks[i].data_count) + 7u) & ~static_cast<size_t>(7u);
+    }
+
+    void *region = nullptr;
+
+    if (name_ == nullptr) {
+        region = calloc(1, length);
+
+        if (region == nullptr) {
+            debugfln("create() could not allocate %zu bytes", length);
+            return false;
+        }
+    }
+    else {
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+        int fd = shm_open(name_, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0) {
+            debugfln("create() shm_open failed: %s (%d)", strerror(errno), errno);
+            return false;
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(length)) < 0) {
+            debugfln("create() ftruncate failed: %s (%d)", strerror(errno), errno);
+            ::close(fd);
+            shm_unlink(name_);
+            return false;
+        }
+
+        region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        ::close(fd);
+
+        if (region == MAP_FAILED) {
+            debugfln("create() mmap failed: %s (%d)", strerror(errno), errno);
+            shm_unlink(name_);
+            return false;
+        }
+
+        name = strdup(name_);
+        shared = true;
+#else
+        debugfln("create() shared memory not supported");
+        return false;
+#endif
+    }
+
+    uint8_t *base = static_cast<uint8_t *>(region);
+    TFModbusTCPRegisterImageHeader *new_header = static_cast<TFModbusTCPRegisterImageHeader *>(region);
+    TFModbusTCPRegisterImageBlock *blocks = reinterpret_cast<TFModbusTCPRegisterImageBlock *>(base + sizeof(TFModbusTCPRegisterImageHeader));
+
+    for (size_t i = 0; i < pending_block_count; ++i) {
+        const TFModbusTCPRegisterImageBlockInfo &info = pending_blocks[i];
+        TFModbusTCPRegisterImageBlock &block = blocks[i];
+
+        block.sequence      = 0;
+        block.unit_id       = info.unit_id;
+        block.table         = static_cast<uint8_t>(info.table);
+        block.start_address = info.start_address;
+        block.data_count    = info.data_count;
+        block.reserved      = 0;
+        block.data_offset   = static_cast<uint32_t>(data_offset);
+
+        data_offset += (get_data_length(info.table, info.data_count) + 7u) & ~static_cast<size_t>(7u);
+    }
+
+    new_header->version       = TF_MODBUS_TCP_REGISTER_IMAGE_VERSION;
+    new_header->block_count   = static_cast<uint32_t>(pending_block_count);
+    new_header->region_length = static_cast<uint32_t>(length);
+
+    // Readers check the magic first, publish it after the layout
+    __atomic_store_n(&new_header->magic, TF_MODBUS_TCP_REGISTER_IMAGE_MAGIC, __ATOMIC_RELEASE);
+
+    header        = new_header;
+    region_length = length;
+    writable      = true;
+
+    free(pending_blocks);
+    pending_blocks = nullptr;
+    pending_block_count = 0;
+
+    return true;
+}
+
+bool TFModbusTCPRegisterImage::attach(const char *name_, bool writable_)
+{
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+    if (header != nullptr || name_ == nullptr) {
+        debugfln("attach() already open or invalid argument");
+        return false;
+    }
+
+    int fd = shm_open(name_, writable_ ? O_RDWR : O_RDONLY, 0);
+
+    if (fd < 0) {
+        debugfln("attach(name=%s) shm_open failed: %s (%d)", name_, strerror(errno), errno);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(TFModbusTCPRegisterImageHeader)) {
+        debugfln("attach(name=%s) region missing or too short", name_);
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    void *region = mmap(nullptr, length, writable_ ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (region == MAP_FAILED) {
+        debugfln("attach(name=%s) mmap failed: %s (%d)", name_, strerror(errno), errno);
+        return false;
+    }
+
+    TFModbusTCPRegisterImageHeader *new_header = static_cast<TFModbusTCPRegisterImageHeader *>(region);
+
+    if (__atomic_load_n(&new_header->magic, __ATOMIC_ACQUIRE) != TF_MODBUS_TCP_REGISTER_IMAGE_MAGIC
+     || new_header->version != TF_MODBUS_TCP_REGISTER_IMAGE_VERSION
+     || new_header->region_length != length) {
+        debugfln("attach(name=%s) region not initialized or incompatible", name_);
+        munmap(region, length);
+        return false;
+    }
+
+    if (!is_layout_valid(new_header, length)) {
+        debugfln("attach(name=%s) region has invalid block layout", name_);
+        munmap(region, length);
+        return false;
+    }
+
+    header        = new_header;
+    region_length = length;
+    shared        = true;
+    writable      = writable_;
+
+    return true;
+#else
+    (void)name_;
+    (void)writable_;
+
+    debugfln("attach() shared memory not supported");
+    return false;
+#endif
+}
+
+void TFModbusTCPRegisterImage::close()
+{
+    if (header == nullptr) {
+        return;
+    }
+
+    if (shared) {
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+        munmap(header, region_length);
+
+        if (name != nullptr) {
+            shm_unlink(name);
+        }
+#endif
+    }
+    else {
+        free(header);
+    }
+
+    free(name);
+    name = nullptr;
+
+    header        = nullptr;
+    region_length = 0;
+    shared        = false;
+    writable      = false;
+}
+
+size_t TFModbusTCPRegisterImage::get_block_count() const
+{
+    return header != nullptr ? header->block_count : 0;
+}
+
+TFModbusTCPRegisterImageBlock *TFModbusTCPRegisterImage::get_block(size_t block_index) const
+{
+    if (header == nullptr || block_index >= header->block_count) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<TFModbusTCPRegisterImageBlock *>(reinterpret_cast<uint8_t *>(header) + sizeof(TFModbusTCPRegisterImageHeader)) + block_index;
+}
+
+bool TFModbusTCPRegisterImage::get_block_info(size_t block_index, TFModbusTCPRegisterImageBlockInfo *info) const
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr) {
+        return false;
+    }
+
+    info->unit_id       = block->unit_id;
+    info->table         = static_cast<TFModbusTCPTable>(block->table);
+    info->start_address = block->start_address;
+    info->data_count    = block->data_count;
+
+    return true;
+}
+
+ssize_t TFModbusTCPRegisterImage::find_block(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count) const
+{
+    size_t block_count = get_block_count();
+
+    for (size_t i = 0; i < block_count; ++i) {
+        TFModbusTCPRegisterImageBlock *block = get_block(i);
+
+        if (block->unit_id == unit_id
+         && block->table == static_cast<uint8_t>(table)
+         && start_address >= block->start_address
+         && static_cast<uint32_t>(start_address) + data_count <= static_cast<uint32_t>(block->start_address) + block->data_count) {
+            return static_cast<ssize_t>(i);
+        }
+    }
+
+    return -1;
+}
+
+bool TFModbusTCPRegisterImage::write(size_t block_index, const void *values)
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr) {
+        return false;
+    }
+
+    return write(block_index, 0, block->data_count, values);
+}
+
+bool TFModbusTCPRegisterImage::write(size_t block_index, uint16_t offset, uint16_t data_count, const void *values)
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr || !writable || static_cast<uint32_t>(offset) + data_count > block->data_count) {
+        return false;
+    }
+
+    uint8_t *data = reinterpret_cast<uint8_t *>(header) + block->data_offset;
+    uint32_t sequence = __atomic_load_n(&block->sequence, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (is_bit_table(static_cast<TFModbusTCPTable>(block->table))) {
+        copy_bits(data, offset, static_cast<const uint8_t *>(values), 0, data_count);
+    }
+    else {
+        memcpy(data + offset * 2u, values, data_count * 2u);
+    }
+
+    // Skip 0 on wrap around, it means never written
+    __atomic_store_n(&block->sequence, sequence + 2 != 0 ? sequence + 2 : 2, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool TFModbusTCPRegisterImage::read(size_t block_index, void *values, uint32_t *sequence) const
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr) {
+        return false;
+    }
+
+    return read(block_index, 0, block->data_count, values, sequence);
+}
+
+bool TFModbusTCPRegisterImage::read(size_t block_index, uint16_t offset, uint16_t data_count, void *values, uint32_t *sequence) const
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr || static_cast<uint32_t>(offset) + data_count > block->data_count) {
+        return false;
+    }
+
+    bool bits = is_bit_table(static_cast<TFModbusTCPTable>(block->table));
+
+    for (uint32_t tries = 0; tries < TF_MODBUS_TCP_REGISTER_IMAGE_MAX_READ_TRIES; ++tries) {
+        const void *data;
+        uint32_t current = begin_read(block_index, &data);
+
+        if (current == 0) {
+            return false;
+        }
+
+        if (bits) {
+            memset(values, 0, (data_count + 7u) / 8u);
+            copy_bits(static_cast<uint8_t *>(values), 0, static_cast<const uint8_t *>(data), offset, data_count);
+        }
+        else {
+            memcpy(values, static_cast<const uint8_t *>(data) + offset * 2u, data_count * 2u);
+        }
+
+        if (end_read(block_index, current)) {
+            if (sequence != nullptr) {
+                *sequence = current;
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t TFModbusTCPRegisterImage::begin_read(size_t block_index, const void **values) const
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr) {
+        *values = nullptr;
+        return 0;
+    }
+
+    // Writes are short memcpys, spin until the writer is done. A writer that
+    // died in the middle of a write leaves the sequence number odd for good
+    for (uint32_t tries = 0; tries < TF_MODBUS_TCP_REGISTER_IMAGE_MAX_READ_TRIES; ++tries) {
+        uint32_t sequence = __atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE);
+
+        if ((sequence & 1u) == 0) {
+            *values = reinterpret_cast<const uint8_t *>(header) + block->data_offset;
+            return sequence;
+        }
+    }
+
+    *values = nullptr;
+    return 0;
+}
+
+bool TFModbusTCPRegisterImage::end_read(size_t block_index, uint32_t sequence) const
+{
+    TFModbusTCPRegisterImageBlock *block = get_block(block_index);
+
+    if (block == nullptr) {
+        return false;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&block->sequence, __ATOMIC_RELAXED) == sequence;
+}
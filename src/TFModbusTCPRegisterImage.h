@@ -0,0 +1,118 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "TFModbusTCPCommon.h"
+
+// configuration
+#ifndef TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+#if defined(__linux__) || defined(__APPLE__)
+#define TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM 1
+#else
+#define TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM 0
+#endif
+#endif
+
+// How often a reader checks the sequence number of a block that is being
+// written, and how often read() retries a copy that was torn by a write,
+// before giving up. Bounds the wait if the writer died in the middle of a write
+#ifndef TF_MODBUS_TCP_REGISTER_IMAGE_MAX_READ_TRIES
+#define TF_MODBUS_TCP_REGISTER_IMAGE_MAX_READ_TRIES 100000
+#endif
+
+struct TFModbusTCPRegisterImageBlockInfo
+{
+    uint8_t unit_id;
+    TFModbusTCPTable table;
+    uint16_t start_address;
+    uint16_t data_count;
+};
+
+struct TFModbusTCPRegisterImageHeader;
+struct TFModbusTCPRegisterImageBlock;
+
+// A memory region that holds register and bit ranges of devices, laid out per
+// unit, table and block, for consumers in other processes. The writer creates
+// the region after adding all blocks, readers attach to it by name. Registers
+// are stored as uint16_t values in the register byte order of the client that
+// wrote them and bits packed LSB first, both as read by the client.
+//
+// Every block is protected by a seqlock: the writer increments the sequence
+// number before and after updating the block, readers retry if the sequence
+// number was odd or changed while they were reading. Readers need no syscalls
+// and can access the data in place via begin_read() and end_read(). Each block
+// must only have one writer at a time. To publish polls, let the client or the
+// poll scheduler read into a private buffer and call write() from the callback.
+//
+// Without POSIX shared memory support the region can only be created without
+// name, for tasks of the same process
+class TFModbusTCPRegisterImage
+{
+public:
+    TFModbusTCPRegisterImage() {}
+    ~TFModbusTCPRegisterImage();
+
+    TFModbusTCPRegisterImage(TFModbusTCPRegisterImage const &other) = delete;
+    TFModbusTCPRegisterImage &operator=(TFModbusTCPRegisterImage const &other) = delete;
+
+    bool add_block(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count); // before create()
+    bool create(const char *name = nullptr); // shared memory name starting with '/', or nullptr for a private region
+    bool attach(const char *name, bool writable = false);
+    void close(); // the creator also removes the name
+    bool is_open() const { return header != nullptr; }
+
+    size_t get_block_count() const;
+    bool get_block_info(size_t block_index, TFModbusTCPRegisterImageBlockInfo *info) const;
+    ssize_t find_block(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count) const; // -1 if not covered
+
+    // Writer side. Offset and count are in registers or bits
+    bool write(size_t block_index, const void *values);
+    bool write(size_t block_index, uint16_t offset, uint16_t data_count, const void *values);
+
+    // Reader side. A consistent copy of the block or part of it. Returns false
+    // if the block doesn't exist, was never written or no consistent copy
+    // could be made within TF_MODBUS_TCP_REGISTER_IMAGE_MAX_READ_TRIES
+    bool read(size_t block_index, void *values, uint32_t *sequence = nullptr) const;
+    bool read(size_t block_index, uint16_t offset, uint16_t data_count, void *values, uint32_t *sequence = nullptr) const;
+
+    // Zero-copy reader side. begin_read() waits for an ongoing write to finish
+    // and returns the sequence number and a pointer to the data. If end_read()
+    // returns false, then the data changed while being used and has to be read
+    // again. A sequence number of 0 means that the block was never written or
+    // that the ongoing write didn't finish in time, the data is not available
+    uint32_t begin_read(size_t block_index, const void **values) const;
+    bool end_read(size_t block_index, uint32_t sequence) const;
+
+private:
+    TFModbusTCPRegisterImageBlock *get_block(size_t block_index) const;
+
+    TFModbusTCPRegisterImageBlockInfo *pending_blocks = nullptr;
+    size_t pending_block_count = 0;
+    TFModbusTCPRegisterImageHeader *header = nullptr;
+    size_t region_length = 0;
+    bool shared = false;
+    bool writable = false;
+    char *name = nullptr; // only set for the creator
+};
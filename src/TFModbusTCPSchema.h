@@ -0,0 +1,294 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TFModbusTCPClient.h"
+#include "TFModbusTCPCommon.h"
+
+// A register map that is declared as constexpr array of points and turned
+// into a read plan at compile time:
+//
+//   static constexpr TFModbusTCPSchemaPoint points[] = {
+//       {TFModbusTCPTable::HoldingRegisters, 40072, TFModbusTCPSchemaType::Uint16},
+//       {TFModbusTCPTable::HoldingRegisters, 40084, TFModbusTCPSchemaType::Float32},
+//   };
+//
+//   static constexpr auto plan = tf_modbus_tcp_schema_make_plan(points);
+//   static_assert(plan.valid, "Invalid schema");
+//
+//   uint16_t buffer[plan.buffer_register_count];
+//
+// Points of the same table are merged into blocks within the read limit and
+// at most max_gap unused registers apart. Each block is read into its own part
+// of the buffer and the values are decoded by their index in the points array.
+// 32 bit values are stored high word first. The buffer is in host byte order,
+// so the client has to use TFModbusTCPByteOrder::Host. A server can answer
+// requests from a buffer of the same plan with read_registers()
+//
+// The plan is built by a constexpr function with loops and local variables,
+// so tf_modbus_tcp_schema_make_plan() requires C++14, unlike the rest of the
+// library. The types can still be used with C++11
+
+enum class TFModbusTCPSchemaType : uint8_t
+{
+    Uint16,
+    Int16,
+    Uint32,
+    Int32,
+    Float32,
+};
+
+constexpr uint16_t get_tf_modbus_tcp_schema_type_register_count(TFModbusTCPSchemaType type)
+{
+    return type == TFModbusTCPSchemaType::Uint16 || type == TFModbusTCPSchemaType::Int16 ? 1 : 2;
+}
+
+struct TFModbusTCPSchemaPoint
+{
+    TFModbusTCPTable table; // only HoldingRegisters and InputRegisters
+    uint16_t address;
+    TFModbusTCPSchemaType type;
+};
+
+struct TFModbusTCPSchemaBlock
+{
+    TFModbusTCPTable table;
+    uint16_t start_address;
+    uint16_t register_count;
+    uint16_t buffer_offset;
+};
+
+template <size_t PointCount>
+struct TFModbusTCPSchemaPlan
+{
+    bool valid;
+    TFModbusTCPSchemaPoint points[PointCount];
+    uint16_t point_offsets[PointCount]; // buffer offset of each point
+    TFModbusTCPSchemaBlock blocks[PointCount];
+    size_t block_count;
+    size_t buffer_register_count;
+
+    uint16_t get_uint16(const uint16_t *buffer, size_t point_index) const { return buffer[point_offsets[point_index]]; }
+    int16_t get_int16(const uint16_t *buffer, size_t point_index) const { return static_cast<int16_t>(get_uint16(buffer, point_index)); }
+
+    uint32_t get_uint32(const uint16_t *buffer, size_t point_index) const
+    {
+        const uint16_t *value = &buffer[point_offsets[point_index]];
+
+        return (static_cast<uint32_t>(value[0]) << 16) | value[1];
+    }
+
+    int32_t get_int32(const uint16_t *buffer, size_t point_index) const { return static_cast<int32_t>(get_uint32(buffer, point_index)); }
+
+    float get_float32(const uint16_t *buffer, size_t point_index) const
+    {
+        union {
+            uint32_t u32;
+            float f32;
+        } u;
+
+        u.u32 = get_uint32(buffer, point_index);
+
+        return u.f32;
+    }
+
+    void set_uint16(uint16_t *buffer, size_t point_index, uint16_t value) const { buffer[point_offsets[point_index]] = value; }
+    void set_int16(uint16_t *buffer, size_t point_index, int16_t value) const { set_uint16(buffer, point_index, static_cast<uint16_t>(value)); }
+
+    void set_uint32(uint16_t *buffer, size_t point_index, uint32_t value) const
+    {
+        uint16_t *target = &buffer[point_offsets[point_index]];
+
+        target[0] = static_cast<uint16_t>(value >> 16);
+        target[1] = static_cast<uint16_t>(value & 0xFFFF);
+    }
+
+    void set_int32(uint16_t *buffer, size_t point_index, int32_t value) const { set_uint32(buffer, point_index, static_cast<uint32_t>(value)); }
+
+    void set_float32(uint16_t *buffer, size_t point_index, float value) const
+    {
+        union {
+            float f32;
+            uint32_t u32;
+        } u;
+
+        u.f32 = value;
+
+        set_uint32(buffer, point_index, u.u32);
+    }
+
+    // Copies the requested registers from the buffer, for server callbacks.
+    // The range can span adjacent blocks, but has to be fully covered by them
+    TFModbusTCPExceptionCode read_registers(const uint16_t *buffer, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, uint16_t *values) const
+    {
+        uint32_t address = start_address;
+        uint32_t end = address + data_count;
+
+        while (address < end) {
+            const TFModbusTCPSchemaBlock *block = nullptr;
+
+            for (size_t i = 0; i < block_count; ++i) {
+                if (blocks[i].table == table
+                 && address >= blocks[i].start_address
+                 && address < static_cast<uint32_t>(blocks[i].start_address) + blocks[i].register_count) {
+                    block = &blocks[i];
+                    break;
+                }
+            }
+
+            if (block == nullptr) {
+                return TFModbusTCPExceptionCode::IllegalDataAddress;
+            }
+
+            uint32_t block_end = static_cast<uint32_t>(block->start_address) + block->register_count;
+            uint32_t count = (end < block_end ? end : block_end) - address;
+
+            memcpy(values, &buffer[block->buffer_offset + (address - block->start_address)], count * sizeof(uint16_t));
+
+            values  += count;
+            address += count;
+        }
+
+        return TFModbusTCPExceptionCode::Success;
+    }
+};
+
+#if __cplusplus >= 201402L
+template <size_t PointCount>
+constexpr TFModbusTCPSchemaPlan<PointCount> tf_modbus_tcp_schema_make_plan(const TFModbusTCPSchemaPoint (&points)[PointCount], uint16_t max_gap = 0)
+{
+    TFModbusTCPSchemaPlan<PointCount> plan{};
+    size_t order[PointCount] = {};
+
+    plan.valid = true;
+
+    for (size_t i = 0; i < PointCount; ++i) {
+        const TFModbusTCPSchemaPoint &point = points[i];
+
+        plan.points[i] = point;
+
+        if ((point.table != TFModbusTCPTable::HoldingRegisters && point.table != TFModbusTCPTable::InputRegisters)
+         || static_cast<uint32_t>(point.address) + get_tf_modbus_tcp_schema_type_register_count(point.type) > 65536u) {
+            plan.valid = false;
+        }
+
+        // Insertion sort by table and address
+        size_t k = i;
+
+        while (k > 0
+            && (points[order[k - 1]].table > point.table
+             || (points[order[k - 1]].table == point.table && points[order[k - 1]].address > point.address))) {
+            order[k] = order[k - 1];
+            --k;
+        }
+
+        order[k] = i;
+    }
+
+    size_t block_point_start[PointCount] = {}; // index into order of the first point of each block
+
+    for (size_t i = 0; i < PointCount; ++i) {
+        const TFModbusTCPSchemaPoint &point = points[order[i]];
+        uint32_t point_end = static_cast<uint32_t>(point.address) + get_tf_modbus_tcp_schema_type_register_count(point.type);
+
+        if (plan.block_count > 0) {
+            TFModbusTCPSchemaBlock &block = plan.blocks[plan.block_count - 1];
+            uint32_t block_end = static_cast<uint32_t>(block.start_address) + block.register_count;
+            uint32_t merged_end = point_end > block_end ? point_end : block_end;
+
+            if (block.table == point.table
+             && point.address <= block_end + max_gap
+             && merged_end - block.start_address <= TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT) {
+                block.register_count = static_cast<uint16_t>(merged_end - block.start_address);
+                continue;
+            }
+        }
+
+        TFModbusTCPSchemaBlock &block = plan.blocks[plan.block_count];
+
+        block_point_start[plan.block_count] = i;
+
+        block.table          = point.table;
+        block.start_address  = point.address;
+        block.register_count = static_cast<uint16_t>(point_end - point.address);
+
+        ++plan.block_count;
+    }
+
+    for (size_t i = 0; i < plan.block_count; ++i) {
+        TFModbusTCPSchemaBlock &block = plan.blocks[i];
+        size_t point_end = i + 1 < plan.block_count ? block_point_start[i + 1] : PointCount;
+
+        block.buffer_offset = static_cast<uint16_t>(plan.buffer_register_count);
+
+        for (size_t k = block_point_start[i]; k < point_end; ++k) {
+            plan.point_offsets[order[k]] = static_cast<uint16_t>(block.buffer_offset + (points[order[k]].address - block.start_address));
+        }
+
+        plan.buffer_register_count += block.register_count;
+    }
+
+    return plan;
+}
+#else
+template <size_t PointCount>
+TFModbusTCPSchemaPlan<PointCount> tf_modbus_tcp_schema_make_plan(const TFModbusTCPSchemaPoint (&points)[PointCount], uint16_t max_gap = 0)
+{
+    static_assert(PointCount == 0, "tf_modbus_tcp_schema_make_plan() requires C++14 or later");
+
+    (void)points;
+    (void)max_gap;
+
+    return TFModbusTCPSchemaPlan<PointCount>{};
+}
+#endif
+
+// Reads all blocks of the plan one after another. The callback is called once,
+// either after the last block or for the first failed block. Client can be a
+// TFModbusTCPClient or a TFModbusTCPSharedClient. Plan and buffer have to stay
+// valid until the callback was called
+template <typename Client, size_t PointCount>
+void tf_modbus_tcp_schema_read(Client *client, uint8_t unit_id, const TFModbusTCPSchemaPlan<PointCount> *plan, uint16_t *buffer,
+                               micros_t timeout, TFModbusTCPClientTransactionCallback &&callback, size_t block_index = 0)
+{
+    if (block_index >= plan->block_count) {
+        callback(TFModbusTCPClientTransactionResult::Success, nullptr);
+        return;
+    }
+
+    const TFModbusTCPSchemaBlock &block = plan->blocks[block_index];
+    TFModbusTCPFunctionCode function_code = block.table == TFModbusTCPTable::InputRegisters ? TFModbusTCPFunctionCode::ReadInputRegisters
+                                                                                            : TFModbusTCPFunctionCode::ReadHoldingRegisters;
+
+    client->transact(unit_id, function_code, block.start_address, block.register_count, buffer + block.buffer_offset, timeout,
+    [client, unit_id, plan, buffer, timeout, callback, block_index](TFModbusTCPClientTransactionResult result, const char *error_message) mutable {
+        if (result != TFModbusTCPClientTransactionResult::Success) {
+            callback(result, error_message);
+            return;
+        }
+
+        tf_modbus_tcp_schema_read(client, unit_id, plan, buffer, timeout, std::move(callback), block_index + 1);
+    });
+}
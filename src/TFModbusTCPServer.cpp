@@ -21,6 +21,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <lwip/sockets.h>
 #include <algorithm>
@@ -60,6 +61,23 @@ const char *get_tf_modbus_tcp_server_client_disconnect_reason_name(TFModbusTCPSe
     return "<Unknown>";
 }
 
+TFModbusTCPServer::TFModbusTCPServer(TFModbusTCPByteOrder register_byte_order_, size_t max_client_count_) :
+    register_byte_order(register_byte_order_),
+    max_client_count(max_client_count_),
+    clients(new TFModbusTCPServerClient[max_client_count_])
+{
+    for (size_t i = max_client_count; i > 0; --i) {
+        clients[i - 1].next = free_client_head;
+        free_client_head    = &clients[i - 1];
+    }
+}
+
+TFModbusTCPServer::~TFModbusTCPServer()
+{
+    delete[] clients;
+    free(address_ranges);
+}
+
 // non-reentrant
 bool TFModbusTCPServer::start(uint32_t bind_address, uint16_t port,
                               TFModbusTCPServerConnectCallback &&connect_callback,
@@ -94,6 +112,15 @@ bool TFModbusTCPServer::start(uint32_t bind_address, uint16_t port,
         return false;
     }
 
+#ifndef SO_REUSEPORT
+    if (reuse_port) {
+        debugfln("start(bind_address=%s port=%u) SO_REUSEPORT not supported", bind_address_str, port);
+
+        errno = ENOTSUP;
+        return false;
+    }
+#endif
+
     int pending_fd = socket(AF_INET, SOCK_STREAM, 0);
 
     if (pending_fd < 0) {
@@ -118,6 +145,22 @@ bool TFModbusTCPServer::start(uint32_t bind_address, uint16_t port,
         return false;
     }
 
+#ifdef SO_REUSEPORT
+    if (reuse_port) {
+        int reuse_port_value = 1;
+
+        if (setsockopt(pending_fd, SOL_SOCKET, SO_REUSEPORT, &reuse_port_value, sizeof(reuse_port_value)) < 0) {
+            int saved_errno = errno;
+
+            debugfln("start(bind_address=%s port=%u) setsockopt(SO_REUSEPORT) failed: %s (%d)",
+                     bind_address_str, port, strerror(saved_errno), saved_errno);
+
+            errno = saved_errno;
+            return false;
+        }
+    }
+#endif
+
     int flags = fcntl(pending_fd, F_GETFL, 0);
 
     if (flags < 0) {
@@ -218,8 +261,100 @@ bool TFModbusTCPServer::stop()
     return true;
 }
 
+static uint32_t get_address_range_key(uint8_t unit_id, TFModbusTCPTable table, uint16_t address)
+{
+    return (static_cast<uint32_t>(unit_id) << 24) | (static_cast<uint32_t>(table) << 16) | address;
+}
+
+// non-reentrant
+bool TFModbusTCPServer::add_address_range(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count)
+{
+    if (non_reentrant) {
+        debugfln("add_address_range(unit_id=%u table=%s start_address=%u data_count=%u) non-reentrant",
+                 unit_id, get_tf_modbus_tcp_table_name(table), start_address, data_count);
+
+        errno = EWOULDBLOCK;
+        return false;
+    }
+
+    TFNetwork::NonReentrantScope scope(&non_reentrant);
+
+    if (data_count == 0 || static_cast<uint32_t>(start_address) + data_count > 65536) {
+        debugfln("add_address_range(unit_id=%u table=%s start_address=%u data_count=%u) invalid argument",
+                 unit_id, get_tf_modbus_tcp_table_name(table), start_address, data_count);
+
+        errno = EINVAL;
+        return false;
+    }
+
+    TFModbusTCPServerAddressRange *new_address_ranges = static_cast<TFModbusTCPServerAddressRange *>(realloc(address_ranges, (address_range_count + 1) * sizeof(TFModbusTCPServerAddressRange)));
+
+    if (new_address_ranges == nullptr) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    address_ranges = new_address_ranges;
+
+    uint32_t key = get_address_range_key(unit_id, table, start_address);
+    size_t index = 0;
+
+    while (index < address_range_count && get_address_range_key(address_ranges[index].unit_id, address_ranges[index].table, address_ranges[index].first_address) < key) {
+        ++index;
+    }
+
+    memmove(&address_ranges[index + 1], &address_ranges[index], (address_range_count - index) * sizeof(TFModbusTCPServerAddressRange));
+
+    address_ranges[index].unit_id       = unit_id;
+    address_ranges[index].table         = table;
+    address_ranges[index].first_address = start_address;
+    address_ranges[index].last_address  = static_cast<uint16_t>(start_address + data_count - 1);
+
+    ++address_range_count;
+
+    // Merge overlapping and adjacent ranges of the same unit ID and table
+    size_t merged_count = 0;
+
+    for (size_t i = 1; i < address_range_count; ++i) {
+        TFModbusTCPServerAddressRange *merged = &address_ranges[merged_count];
+        TFModbusTCPServerAddressRange *range  = &address_ranges[i];
+
+        if (range->unit_id == merged->unit_id
+         && range->table == merged->table
+         && static_cast<uint32_t>(range->first_address) <= static_cast<uint32_t>(merged->last_address) + 1) {
+            merged->last_address = std::max(merged->last_address, range->last_address);
+        }
+        else {
+            address_ranges[++merged_count] = *range;
+        }
+    }
+
+    address_range_count = merged_count + 1;
+
+    return true;
+}
+
+// non-reentrant
+bool TFModbusTCPServer::clear_address_ranges()
+{
+    if (non_reentrant) {
+        debugfln("clear_address_ranges() non-reentrant");
+
+        errno = EWOULDBLOCK;
+        return false;
+    }
+
+    TFNetwork::NonReentrantScope scope(&non_reentrant);
+
+    free(address_ranges);
+    address_ranges      = nullptr;
+    address_range_count = 0;
+
+    return true;
+}
+
 // non-reentrant
-void TFModbusTCPServer::tick()
+void TFModbusTCPServer::tick(micros_t max_wait)
 {
     if (non_reentrant) {
         debugfln("tick() non-reentrant");
@@ -246,9 +381,23 @@ void TFModbusTCPServer::tick()
         fd_max = std::max(fd_max, socket_fd);
     }
 
+    micros_t wait = last_idle_check + TF_MODBUS_TCP_SERVER_IDLE_CHECK_INTERVAL - now_us();
+
+    if (wait > max_wait) {
+        wait = max_wait;
+    }
+
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    // Response remainders are sent on the next tick, don't delay them
+    if (response_remainder_count > 0) {
+        wait = 0_s;
+    }
+#endif
+
+    int64_t wait_us = wait > 0_s ? static_cast<int64_t>(wait) : 0;
     struct timeval tv;
-    tv.tv_sec  = 0;
-    tv.tv_usec = 0;
+    tv.tv_sec  = wait_us / 1000000;
+    tv.tv_usec = wait_us % 1000000;
 
     int readable_fd_count = select(fd_max + 1, &fdset, nullptr, nullptr, &tv);
 
@@ -257,7 +406,11 @@ void TFModbusTCPServer::tick()
         return;
     }
 
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    if (readable_fd_count == 0 && response_remainder_count == 0 && !deadline_elapsed(last_idle_check + TF_MODBUS_TCP_SERVER_IDLE_CHECK_INTERVAL)) {
+#else
     if (readable_fd_count == 0 && !deadline_elapsed(last_idle_check + TF_MODBUS_TCP_SERVER_IDLE_CHECK_INTERVAL)) {
+#endif
         return;
     }
 
@@ -290,7 +443,7 @@ void TFModbusTCPServer::tick()
             ++client_count;
         }
 
-        if (client_count >= TF_MODBUS_TCP_SERVER_MAX_CLIENT_COUNT && node != &client_sentinel) {
+        if (client_count >= max_client_count && node != &client_sentinel) {
             TFModbusTCPServerClient *client = static_cast<TFModbusTCPServerClient *>(node);
 
             if (deadline_elapsed(client->last_alive + TF_MODBUS_TCP_SERVER_MIN_DISPLACE_DELAY)) {
@@ -303,7 +456,7 @@ void TFModbusTCPServer::tick()
             }
         }
 
-        if (client_count >= TF_MODBUS_TCP_SERVER_MAX_CLIENT_COUNT) {
+        if (client_count >= max_client_count || free_client_head == nullptr) {
             debugfln("tick() no free client for connection (socket_fd=%d peer_address=%s port=%u)", socket_fd, peer_address_str, port);
 
             shutdown(socket_fd, SHUT_RDWR);
@@ -311,10 +464,11 @@ void TFModbusTCPServer::tick()
             disconnect_callback(peer_address, port, TFModbusTCPServerDisconnectReason::NoFreeClient, -1);
         }
         else {
-            TFModbusTCPServerClient *client = new TFModbusTCPServerClient;
+            TFModbusTCPServerClient *client = static_cast<TFModbusTCPServerClient *>(free_client_head);
+            free_client_head                = client->next;
 
-            debugfln("tick() allocating client for connection (client=%p socket_fd=%d peer_address=%s port=%u)",
-                     static_cast<void *>(client), socket_fd, peer_address_str, port);
+            debugfln("tick() allocating client for connection (client=%p slot=%zu socket_fd=%d peer_address=%s port=%u)",
+                     static_cast<void *>(client), static_cast<size_t>(client - clients), socket_fd, peer_address_str, port);
 
             client->socket_fd                      = socket_fd;
             client->peer_address                   = peer_address;
@@ -323,6 +477,11 @@ void TFModbusTCPServer::tick()
             client->pending_request_header_used    = 0;
             client->pending_request_header_checked = false;
             client->pending_request_payload_used   = 0;
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+            client->response_remainder             = nullptr;
+            client->response_remainder_offset      = 0;
+            client->response_remainder_length      = 0;
+#endif
             client->next                           = client_sentinel.next;
             client_sentinel.next                   = client;
         }
@@ -365,7 +524,25 @@ void TFModbusTCPServer::tick()
             continue;
         }
 
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+        if (client->response_remainder_length > 0) {
+            if (!send_response_remainder(client)) {
+                int saved_errno = errno;
+
+                debugfln("tick() disconnecting client due to send error (client=%p errno=%d)",
+                        static_cast<void *>(client), saved_errno);
+
+                node = nullptr;
+                disconnect(client, TFModbusTCPServerDisconnectReason::SocketSendFailed, saved_errno);
+                continue;
+            }
+        }
+
+        // Don't receive the next request before the previous response is fully sent
+        if (readable_fd_count == 0 || !FD_ISSET(client->socket_fd, &fdset) || client->response_remainder_length > 0) {
+#else
         if (readable_fd_count == 0 || !FD_ISSET(client->socket_fd, &fdset)) {
+#endif
             if (finished_tail == nullptr) {
                 finished_head = node;
                 finished_tail = node;
@@ -494,6 +671,11 @@ void TFModbusTCPServer::tick()
             }
         }
 
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+        TFModbusTCPResponse *response           = &shared_response;
+#else
+        TFModbusTCPResponse *response           = &client->response;
+#endif
         TFModbusTCPExceptionCode exception_code = TFModbusTCPExceptionCode::Success;
 
         switch (static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code)) {
@@ -514,23 +696,31 @@ void TFModbusTCPServer::tick()
 
                 uint16_t data_count = ntohs(client->pending_request.payload.data_count);
 
+                TFModbusTCPTable table = client->pending_request.payload.function_code == static_cast<uint8_t>(TFModbusTCPFunctionCode::ReadCoils)
+                                       ? TFModbusTCPTable::Coils : TFModbusTCPTable::DiscreteInputs;
+
                 if (data_count < TF_MODBUS_TCP_MIN_READ_COIL_COUNT
                  || data_count > TF_MODBUS_TCP_MAX_READ_COIL_COUNT) {
                     exception_code = TFModbusTCPExceptionCode::IllegalDataValue;
                 }
+                else if (!is_address_range_valid(client->pending_request.header.unit_id, table, ntohs(client->pending_request.payload.start_address), data_count)) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                }
                 else {
-                    client->response.payload.byte_count  = (data_count + 7) / 8;
-                    client->response.header.frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                         + offsetof(TFModbusTCPResponsePayload, coil_values)
-                                                         + client->response.payload.byte_count;
+                    response->payload.byte_count  = (data_count + 7) / 8;
+                    response->header.frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                  + offsetof(TFModbusTCPResponsePayload, coil_values)
+                                                  + response->payload.byte_count;
 
                     exception_code = request_callback(client->pending_request.header.unit_id,
                                                       static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
                                                       ntohs(client->pending_request.payload.start_address),
                                                       data_count,
-                                                      client->response.payload.coil_values);
+                                                      response->payload.coil_values);
 
-                    client->response.payload.coil_values[client->response.payload.byte_count - 1] &= (1u << (data_count % 8)) - 1;
+                    if ((data_count % 8) != 0) {
+                        response->payload.coil_values[response->payload.byte_count - 1] &= (1u << (data_count % 8)) - 1;
+                    }
                 }
             }
 
@@ -553,25 +743,31 @@ void TFModbusTCPServer::tick()
 
                 uint16_t data_count = ntohs(client->pending_request.payload.data_count);
 
+                TFModbusTCPTable table = client->pending_request.payload.function_code == static_cast<uint8_t>(TFModbusTCPFunctionCode::ReadHoldingRegisters)
+                                       ? TFModbusTCPTable::HoldingRegisters : TFModbusTCPTable::InputRegisters;
+
                 if (data_count < TF_MODBUS_TCP_MIN_READ_REGISTER_COUNT
                  || data_count > TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT) {
                     exception_code = TFModbusTCPExceptionCode::IllegalDataValue;
                 }
+                else if (!is_address_range_valid(client->pending_request.header.unit_id, table, ntohs(client->pending_request.payload.start_address), data_count)) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                }
                 else {
-                    client->response.payload.byte_count  = data_count * 2;
-                    client->response.header.frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                         + offsetof(TFModbusTCPResponsePayload, register_values)
-                                                         + client->response.payload.byte_count;
+                    response->payload.byte_count  = data_count * 2;
+                    response->header.frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                  + offsetof(TFModbusTCPResponsePayload, register_values)
+                                                  + response->payload.byte_count;
 
                     exception_code = request_callback(client->pending_request.header.unit_id,
                                                       static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
                                                       ntohs(client->pending_request.payload.start_address),
                                                       data_count,
-                                                      client->response.payload.register_values);
+                                                      response->payload.register_values);
 
                     if (register_byte_order == TFModbusTCPByteOrder::Host) {
                         for (size_t i = 0; i < data_count; ++i) {
-                            client->response.payload.register_values[i] = htons(client->response.payload.register_values[i]);
+                            response->payload.register_values[i] = htons(response->payload.register_values[i]);
                         }
                     }
                 }
@@ -598,11 +794,14 @@ void TFModbusTCPServer::tick()
                 if (data_value != 0x0000 && data_value != 0xFF00) {
                     exception_code = TFModbusTCPExceptionCode::IllegalDataValue;
                 }
+                else if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::Coils, ntohs(client->pending_request.payload.start_address), 1)) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                }
                 else {
-                    client->response.header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                           + offsetof(TFModbusTCPResponsePayload, or_mask);
-                    client->response.payload.start_address = client->pending_request.payload.start_address;
-                    client->response.payload.data_value    = client->pending_request.payload.data_value;
+                    response->header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                    + offsetof(TFModbusTCPResponsePayload, or_mask);
+                    response->payload.start_address = client->pending_request.payload.start_address;
+                    response->payload.data_value    = client->pending_request.payload.data_value;
 
                     uint8_t coil_values[1] = {static_cast<uint8_t>(data_value == 0xFF00 ? 1 : 0)};
 
@@ -630,22 +829,27 @@ void TFModbusTCPServer::tick()
                     continue;
                 }
 
-                client->response.header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                       + offsetof(TFModbusTCPResponsePayload, or_mask);
-                client->response.payload.start_address = client->pending_request.payload.start_address;
-                client->response.payload.data_value    = client->pending_request.payload.data_value;
+                if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::HoldingRegisters, ntohs(client->pending_request.payload.start_address), 1)) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                }
+                else {
+                    response->header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                    + offsetof(TFModbusTCPResponsePayload, or_mask);
+                    response->payload.start_address = client->pending_request.payload.start_address;
+                    response->payload.data_value    = client->pending_request.payload.data_value;
 
-                uint16_t register_values[1] = {client->pending_request.payload.data_value};
+                    uint16_t register_values[1] = {client->pending_request.payload.data_value};
 
-                if (register_byte_order == TFModbusTCPByteOrder::Host) {
-                    register_values[0] = ntohs(register_values[0]);
-                }
+                    if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                        register_values[0] = ntohs(register_values[0]);
+                    }
 
-                exception_code = request_callback(client->pending_request.header.unit_id,
-                                                  TFModbusTCPFunctionCode::WriteMultipleRegisters,
-                                                  ntohs(client->pending_request.payload.start_address),
-                                                  1,
-                                                  register_values);
+                    exception_code = request_callback(client->pending_request.header.unit_id,
+                                                      TFModbusTCPFunctionCode::WriteMultipleRegisters,
+                                                      ntohs(client->pending_request.payload.start_address),
+                                                      1,
+                                                      register_values);
+                }
             }
 
             break;
@@ -686,20 +890,25 @@ void TFModbusTCPServer::tick()
                         continue;
                     }
 
-                    client->response.header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                           + offsetof(TFModbusTCPResponsePayload, or_mask);
-                    client->response.payload.start_address = client->pending_request.payload.start_address;
-                    client->response.payload.data_count    = client->pending_request.payload.data_count;
-
-                    if ((data_count % 8) != 0) {
-                        client->pending_request.payload.coil_values[client->pending_request.payload.byte_count - 1] &= (1u << (data_count % 8)) - 1;
+                    if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::Coils, ntohs(client->pending_request.payload.start_address), data_count)) {
+                        exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
                     }
+                    else {
+                        response->header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                        + offsetof(TFModbusTCPResponsePayload, or_mask);
+                        response->payload.start_address = client->pending_request.payload.start_address;
+                        response->payload.data_count    = client->pending_request.payload.data_count;
+
+                        if ((data_count % 8) != 0) {
+                            client->pending_request.payload.coil_values[client->pending_request.payload.byte_count - 1] &= (1u << (data_count % 8)) - 1;
+                        }
 
-                    exception_code = request_callback(client->pending_request.header.unit_id,
-                                                      static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
-                                                      ntohs(client->pending_request.payload.start_address),
-                                                      data_count,
-                                                      client->pending_request.payload.coil_values);
+                        exception_code = request_callback(client->pending_request.header.unit_id,
+                                                          static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
+                                                          ntohs(client->pending_request.payload.start_address),
+                                                          data_count,
+                                                          client->pending_request.payload.coil_values);
+                    }
                 }
             }
 
@@ -741,22 +950,27 @@ void TFModbusTCPServer::tick()
                         continue;
                     }
 
-                    client->response.header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                           + offsetof(TFModbusTCPResponsePayload, or_mask);
-                    client->response.payload.start_address = client->pending_request.payload.start_address;
-                    client->response.payload.data_count    = client->pending_request.payload.data_count;
-
-                    if (register_byte_order == TFModbusTCPByteOrder::Host) {
-                        for (size_t i = 0; i < data_count; ++i) {
-                            client->pending_request.payload.register_values[i] = ntohs(client->pending_request.payload.register_values[i]);
-                        }
+                    if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::HoldingRegisters, ntohs(client->pending_request.payload.start_address), data_count)) {
+                        exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
                     }
+                    else {
+                        response->header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                        + offsetof(TFModbusTCPResponsePayload, or_mask);
+                        response->payload.start_address = client->pending_request.payload.start_address;
+                        response->payload.data_count    = client->pending_request.payload.data_count;
+
+                        if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                            for (size_t i = 0; i < data_count; ++i) {
+                                client->pending_request.payload.register_values[i] = ntohs(client->pending_request.payload.register_values[i]);
+                            }
+                        }
 
-                    exception_code = request_callback(client->pending_request.header.unit_id,
-                                                      static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
-                                                      ntohs(client->pending_request.payload.start_address),
-                                                      data_count,
-                                                      client->pending_request.payload.register_values);
+                        exception_code = request_callback(client->pending_request.header.unit_id,
+                                                          static_cast<TFModbusTCPFunctionCode>(client->pending_request.payload.function_code),
+                                                          ntohs(client->pending_request.payload.start_address),
+                                                          data_count,
+                                                          client->pending_request.payload.register_values);
+                    }
                 }
             }
 
@@ -776,24 +990,111 @@ void TFModbusTCPServer::tick()
                     continue;
                 }
 
-                client->response.header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                       + offsetof(TFModbusTCPResponsePayload, sentinel);
-                client->response.payload.start_address = client->pending_request.payload.start_address;
-                client->response.payload.and_mask      = client->pending_request.payload.and_mask;
-                client->response.payload.or_mask       = client->pending_request.payload.or_mask;
+                if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::HoldingRegisters, ntohs(client->pending_request.payload.start_address), 1)) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                }
+                else {
+                    response->header.frame_length   = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                    + offsetof(TFModbusTCPResponsePayload, sentinel);
+                    response->payload.start_address = client->pending_request.payload.start_address;
+                    response->payload.and_mask      = client->pending_request.payload.and_mask;
+                    response->payload.or_mask       = client->pending_request.payload.or_mask;
+
+                    uint16_t register_values[2] = {client->pending_request.payload.and_mask, client->pending_request.payload.or_mask};
+
+                    if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                        register_values[0] = ntohs(register_values[0]);
+                        register_values[1] = ntohs(register_values[1]);
+                    }
+
+                    exception_code = request_callback(client->pending_request.header.unit_id,
+                                                      TFModbusTCPFunctionCode::MaskWriteRegister,
+                                                      ntohs(client->pending_request.payload.start_address),
+                                                      2,
+                                                      register_values);
+                }
+            }
+
+            break;
+
+        case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+            {
+                uint16_t min_frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                          + offsetof(TFModbusTCPRequestPayload, write_register_values)
+                                          + (TF_MODBUS_TCP_MIN_WRITE_REGISTER_COUNT * 2);
+
+                if (frame_length < min_frame_length) {
+                    debugfln("tick() disconnecting client due to protocol error, frame length too short (client=%p frame_length=%u min_frame_length=%u)",
+                             static_cast<void *>(client), frame_length, min_frame_length);
+
+                    node = nullptr;
+                    disconnect(client, TFModbusTCPServerDisconnectReason::ProtocolError, -1);
+                    continue;
+                }
 
-                uint16_t register_values[2] = {client->pending_request.payload.and_mask, client->pending_request.payload.or_mask};
+                uint16_t read_data_count  = ntohs(client->pending_request.payload.data_count);
+                uint16_t write_data_count = ntohs(client->pending_request.payload.write_data_count);
 
-                if (register_byte_order == TFModbusTCPByteOrder::Host) {
-                    register_values[0] = ntohs(register_values[0]);
-                    register_values[1] = ntohs(register_values[1]);
+                if (read_data_count < TF_MODBUS_TCP_MIN_READ_REGISTER_COUNT
+                 || read_data_count > TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT
+                 || write_data_count < TF_MODBUS_TCP_MIN_WRITE_REGISTER_COUNT
+                 || write_data_count > TF_MODBUS_TCP_MAX_READ_WRITE_WRITE_REGISTER_COUNT
+                 || client->pending_request.payload.write_byte_count != write_data_count * 2) {
+                    exception_code = TFModbusTCPExceptionCode::IllegalDataValue;
                 }
+                else {
+                    uint16_t expected_frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                   + offsetof(TFModbusTCPRequestPayload, write_register_values)
+                                                   + client->pending_request.payload.write_byte_count;
+
+                    if (frame_length != expected_frame_length) {
+                        debugfln("tick() disconnecting client due to protocol error, frame length mismatch (client=%p frame_length=%u expected_frame_length=%u)",
+                                 static_cast<void *>(client), frame_length, expected_frame_length);
+
+                        node = nullptr;
+                        disconnect(client, TFModbusTCPServerDisconnectReason::ProtocolError, -1);
+                        continue;
+                    }
 
-                exception_code = request_callback(client->pending_request.header.unit_id,
-                                                  TFModbusTCPFunctionCode::MaskWriteRegister,
-                                                  ntohs(client->pending_request.payload.start_address),
-                                                  2,
-                                                  register_values);
+                    uint16_t read_start_address  = ntohs(client->pending_request.payload.start_address);
+                    uint16_t write_start_address = ntohs(client->pending_request.payload.write_start_address);
+
+                    if (!is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::HoldingRegisters, read_start_address, read_data_count)
+                     || !is_address_range_valid(client->pending_request.header.unit_id, TFModbusTCPTable::HoldingRegisters, write_start_address, write_data_count)) {
+                        exception_code = TFModbusTCPExceptionCode::IllegalDataAddress;
+                    }
+                    else {
+                        response->payload.byte_count  = read_data_count * 2;
+                        response->header.frame_length = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                      + offsetof(TFModbusTCPResponsePayload, register_values)
+                                                      + response->payload.byte_count;
+
+                        if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                            for (size_t i = 0; i < write_data_count; ++i) {
+                                client->pending_request.payload.write_register_values[i] = ntohs(client->pending_request.payload.write_register_values[i]);
+                            }
+                        }
+
+                        TFModbusTCPServerReadWriteMultipleRegistersValues values;
+
+                        values.write_start_address   = write_start_address;
+                        values.write_data_count      = write_data_count;
+                        values.write_register_values = reinterpret_cast<uint16_t *>(client->pending_request.payload.bytes + offsetof(TFModbusTCPRequestPayload, write_register_values));
+                        values.read_register_values  = reinterpret_cast<uint16_t *>(response->payload.bytes + offsetof(TFModbusTCPResponsePayload, register_values));
+
+                        exception_code = request_callback(client->pending_request.header.unit_id,
+                                                          TFModbusTCPFunctionCode::ReadWriteMultipleRegisters,
+                                                          read_start_address,
+                                                          read_data_count,
+                                                          &values);
+
+                        if (register_byte_order == TFModbusTCPByteOrder::Host) {
+                            for (size_t i = 0; i < read_data_count; ++i) {
+                                response->payload.register_values[i] = htons(response->payload.register_values[i]);
+                            }
+                        }
+                    }
+                }
             }
 
             break;
@@ -804,21 +1105,21 @@ void TFModbusTCPServer::tick()
         }
 
         if (exception_code != TFModbusTCPExceptionCode::ForceTimeout) {
-            client->response.payload.function_code  = client->pending_request.payload.function_code;
+            response->payload.function_code  = client->pending_request.payload.function_code;
 
             if (exception_code != TFModbusTCPExceptionCode::Success) {
-                client->response.header.frame_length     = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
-                                                         + offsetof(TFModbusTCPResponsePayload, exception_sentinel);
-                client->response.payload.function_code  |= 0x80;
-                client->response.payload.exception_code  = static_cast<uint8_t>(exception_code);
+                response->header.frame_length     = TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH
+                                                  + offsetof(TFModbusTCPResponsePayload, exception_sentinel);
+                response->payload.function_code  |= 0x80;
+                response->payload.exception_code  = static_cast<uint8_t>(exception_code);
             }
 
-            client->response.header.transaction_id = client->pending_request.header.transaction_id;
-            client->response.header.protocol_id    = client->pending_request.header.protocol_id;
-            client->response.header.frame_length   = htons(client->response.header.frame_length);
-            client->response.header.unit_id        = client->pending_request.header.unit_id;
+            response->header.transaction_id = client->pending_request.header.transaction_id;
+            response->header.protocol_id    = client->pending_request.header.protocol_id;
+            response->header.frame_length   = htons(response->header.frame_length);
+            response->header.unit_id        = client->pending_request.header.unit_id;
 
-            if (!send_response(client)) {
+            if (!send_response(client, response)) {
                 int saved_errno = errno;
 
                 debugfln("tick() disconnecting client due to send error (client=%p errno=%d)",
@@ -843,13 +1144,59 @@ void TFModbusTCPServer::disconnect(TFModbusTCPServerClient *client, TFModbusTCPS
     shutdown(client->socket_fd, SHUT_RDWR);
     close(client->socket_fd);
     disconnect_callback(client->peer_address, client->port, reason, error_number);
-    delete client;
+
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    if (client->response_remainder_length > 0) {
+        client->response_remainder_length = 0;
+        --response_remainder_count;
+    }
+
+    free(client->response_remainder);
+    client->response_remainder = nullptr;
+#endif
+
+    client->socket_fd = -1;
+    client->next      = free_client_head;
+    free_client_head  = client;
+}
+
+bool TFModbusTCPServer::is_address_range_valid(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count) const
+{
+    if (address_range_count == 0) {
+        return true;
+    }
+
+    // Find the last range that starts at or before the start address
+    uint32_t key = get_address_range_key(unit_id, table, start_address);
+    size_t low   = 0;
+    size_t high  = address_range_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (get_address_range_key(address_ranges[middle].unit_id, address_ranges[middle].table, address_ranges[middle].first_address) <= key) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    if (low == 0) {
+        return false;
+    }
+
+    const TFModbusTCPServerAddressRange *range = &address_ranges[low - 1];
+
+    return range->unit_id == unit_id
+        && range->table == table
+        && static_cast<uint32_t>(start_address) + data_count - 1 <= range->last_address;
 }
 
-bool TFModbusTCPServer::send_response(TFModbusTCPServerClient *client)
+bool TFModbusTCPServer::send_response(TFModbusTCPServerClient *client, TFModbusTCPResponse *response)
 {
-    uint8_t *buffer        = client->response.bytes;
-    size_t length          = sizeof(client->response.header) - TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH + ntohs(client->response.header.frame_length);
+    uint8_t *buffer        = response->bytes;
+    size_t length          = sizeof(response->header) - TF_MODBUS_TCP_FRAME_IN_HEADER_LENGTH + ntohs(response->header.frame_length);
     size_t buffer_send     = 0;
     size_t tries_remaining = TF_MODBUS_TCP_SERVER_MAX_SEND_TRIES;
 
@@ -869,5 +1216,47 @@ bool TFModbusTCPServer::send_response(TFModbusTCPServerClient *client)
         buffer_send += result;
     }
 
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    if (buffer_send < length) {
+        if (client->response_remainder == nullptr) {
+            client->response_remainder = static_cast<uint8_t *>(malloc(sizeof(TFModbusTCPResponse)));
+
+            if (client->response_remainder == nullptr) {
+                errno = ENOMEM;
+                return false;
+            }
+        }
+
+        client->response_remainder_offset = 0;
+        client->response_remainder_length = length - buffer_send;
+
+        debugfln("send_response() keeping response remainder (client=%p response_remainder_length=%zu)",
+                 static_cast<void *>(client), client->response_remainder_length);
+
+        memcpy(client->response_remainder, buffer + buffer_send, client->response_remainder_length);
+        ++response_remainder_count;
+    }
+#endif
+
+    return true;
+}
+
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+bool TFModbusTCPServer::send_response_remainder(TFModbusTCPServerClient *client)
+{
+    ssize_t result = send(client->socket_fd, client->response_remainder + client->response_remainder_offset, client->response_remainder_length, MSG_NOSIGNAL);
+
+    if (result < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    client->response_remainder_offset += result;
+    client->response_remainder_length -= result;
+
+    if (client->response_remainder_length == 0) {
+        --response_remainder_count;
+    }
+
     return true;
 }
+#endif
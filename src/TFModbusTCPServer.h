@@ -46,6 +46,14 @@
 #define TF_MODBUS_TCP_SERVER_MAX_SEND_TRIES      10
 #endif
 
+// All clients build their response in one buffer owned by the server. The
+// unsent part of a partially sent response is moved to a per-client heap
+// buffer. It is allocated on the first partial send and then reused until
+// the client disconnects
+#ifndef TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+#define TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER 0
+#endif
+
 enum class TFModbusTCPServerDisconnectReason
 {
     NoFreeClient,
@@ -64,6 +72,17 @@ typedef std::function<void(uint32_t peer_address, uint16_t port)> TFModbusTCPSer
 
 typedef std::function<void(uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number)> TFModbusTCPServerDisconnectCallback;
 
+// Passed as data_values for Read/Write Multiple Registers (23). The start_address
+// and data_count arguments describe the read part of the request. The write
+// part has to be applied before the read part is filled in
+struct TFModbusTCPServerReadWriteMultipleRegistersValues
+{
+    uint16_t write_start_address;
+    uint16_t write_data_count;
+    uint16_t *write_register_values;
+    uint16_t *read_register_values;
+};
+
 typedef std::function<TFModbusTCPExceptionCode(uint8_t unit_id,
                                                TFModbusTCPFunctionCode function_code,
                                                uint16_t start_address,
@@ -85,13 +104,28 @@ struct TFModbusTCPServerClient : public TFModbusTCPServerClientNode
     size_t pending_request_header_used;
     bool pending_request_header_checked;
     size_t pending_request_payload_used;
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    uint8_t *response_remainder; // nullptr until the first partial send
+    size_t response_remainder_offset;
+    size_t response_remainder_length; // 0 if nothing is left to send
+#else
     TFModbusTCPResponse response;
+#endif
+};
+
+struct TFModbusTCPServerAddressRange
+{
+    uint8_t unit_id;
+    TFModbusTCPTable table;
+    uint16_t first_address;
+    uint16_t last_address;
 };
 
 class TFModbusTCPServer final
 {
 public:
-    TFModbusTCPServer(TFModbusTCPByteOrder register_byte_order_) : register_byte_order(register_byte_order_) {}
+    TFModbusTCPServer(TFModbusTCPByteOrder register_byte_order_, size_t max_client_count_ = TF_MODBUS_TCP_SERVER_MAX_CLIENT_COUNT);
+    ~TFModbusTCPServer();
 
     TFModbusTCPServer(TFModbusTCPServer const &other) = delete;
     TFModbusTCPServer &operator=(TFModbusTCPServer const &other) = delete;
@@ -101,18 +135,47 @@ public:
                TFModbusTCPServerDisconnectCallback &&disconnect_callback,
                TFModbusTCPServerRequestCallback &&request_callback); // non-reentrant
     bool stop(); // non-reentrant
-    void tick(); // non-reentrant
+
+    // Blocks in select() for up to max_wait until a socket is readable, but
+    // not beyond the next idle check. For a thread that only ticks the server
+    void tick(micros_t max_wait = 0_s); // non-reentrant
+
+    // Once at least one address range is added, requests that are not fully
+    // covered by an address range of their unit ID and table get answered with
+    // an IllegalDataAddress exception without calling the request callback
+    bool add_address_range(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count); // non-reentrant
+    bool clear_address_ranges(); // non-reentrant
+
+    // Sets SO_REUSEPORT on the listening socket, so that several servers can
+    // listen on the same port and the kernel spreads new connections over
+    // them. Applies to the next start(), which fails with ENOTSUP if the
+    // platform doesn't support SO_REUSEPORT
+    void set_reuse_port(bool reuse_port_) { reuse_port = reuse_port_; }
 
 private:
     void disconnect(TFModbusTCPServerClient *client, TFModbusTCPServerDisconnectReason reason, int error_number);
-    bool send_response(TFModbusTCPServerClient *client);
+    bool is_address_range_valid(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count) const;
+    bool send_response(TFModbusTCPServerClient *client, TFModbusTCPResponse *response);
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    bool send_response_remainder(TFModbusTCPServerClient *client);
+#endif
 
     TFModbusTCPByteOrder register_byte_order;
+    size_t max_client_count;
+    TFModbusTCPServerClient *clients; // slab of max_client_count entries, allocated once
+    TFModbusTCPServerClientNode *free_client_head = nullptr;
     bool non_reentrant       = false;
+    bool reuse_port          = false;
     int server_fd            = -1;
     micros_t last_idle_check = 0_s;
     TFModbusTCPServerConnectCallback connect_callback;
     TFModbusTCPServerDisconnectCallback disconnect_callback;
     TFModbusTCPServerRequestCallback request_callback;
     TFModbusTCPServerClientNode client_sentinel;
+    TFModbusTCPServerAddressRange *address_ranges = nullptr; // sorted by unit ID, table and first address, non-overlapping
+    size_t address_range_count                    = 0;
+#if TF_MODBUS_TCP_SERVER_SHARED_RESPONSE_BUFFER
+    TFModbusTCPResponse shared_response;
+    size_t response_remainder_count = 0;
+#endif
 };
@@ -0,0 +1,379 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPServerRegisterBank.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPWriteRing[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+#define TF_MODBUS_TCP_WRITE_RING_MAGIC   0x52574D54u // "TMWR"
+#define TF_MODBUS_TCP_WRITE_RING_VERSION 1u
+
+// The layout is shared between processes, only use fixed size types. Head and
+// tail are free running and on separate cache lines
+struct TFModbusTCPWriteRingHeader
+{
+    uint32_t magic; // written last by the creator
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t region_length;
+    uint8_t padding0[48];
+    uint32_t head; // written by the producer
+    uint32_t dropped_count;
+    uint8_t padding1[56];
+    uint32_t tail; // written by the consumer
+    uint8_t padding2[60];
+};
+
+static TFModbusTCPWriteRingEntry *get_entries(TFModbusTCPWriteRingHeader *header)
+{
+    return reinterpret_cast<TFModbusTCPWriteRingEntry *>(reinterpret_cast<uint8_t *>(header) + sizeof(TFModbusTCPWriteRingHeader));
+}
+
+TFModbusTCPWriteRing::~TFModbusTCPWriteRing()
+{
+    close();
+}
+
+bool TFModbusTCPWriteRing::create(const char *name_, uint32_t capacity)
+{
+    if (header != nullptr || capacity == 0) {
+        debugfln("create() already open or invalid argument");
+        return false;
+    }
+
+    size_t length = sizeof(TFModbusTCPWriteRingHeader) + capacity * sizeof(TFModbusTCPWriteRingEntry);
+    void *region = nullptr;
+
+    if (name_ == nullptr) {
+        region = calloc(1, length);
+
+        if (region == nullptr) {
+            debugfln("create() could not allocate %zu bytes", length);
+            return false;
+        }
+    }
+    else {
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+        int fd = shm_open(name_, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+        if (fd < 0) {
+            debugfln("create() shm_open failed: %s (%d)", strerror(errno), errno);
+            return false;
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(length)) < 0) {
+            debugfln("create() ftruncate failed: %s (%d)", strerror(errno), errno);
+            ::close(fd);
+            shm_unlink(name_);
+            return false;
+        }
+
+        region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        ::close(fd);
+
+        if (region == MAP_FAILED) {
+            debugfln("create() mmap failed: %s (%d)", strerror(errno), errno);
+            shm_unlink(name_);
+            return false;
+        }
+
+        name = strdup(name_);
+        shared = true;
+#else
+        debugfln("create() shared memory not supported");
+        return false;
+#endif
+    }
+
+    TFModbusTCPWriteRingHeader *new_header = static_cast<TFModbusTCPWriteRingHeader *>(region);
+
+    new_header->version       = TF_MODBUS_TCP_WRITE_RING_VERSION;
+    new_header->capacity      = capacity;
+    new_header->region_length = static_cast<uint32_t>(length);
+
+    __atomic_store_n(&new_header->magic, TF_MODBUS_TCP_WRITE_RING_MAGIC, __ATOMIC_RELEASE);
+
+    header        = new_header;
+    region_length = length;
+
+    return true;
+}
+
+bool TFModbusTCPWriteRing::attach(const char *name_)
+{
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+    if (header != nullptr || name_ == nullptr) {
+        debugfln("attach() already open or invalid argument");
+        return false;
+    }
+
+    int fd = shm_open(name_, O_RDWR, 0);
+
+    if (fd < 0) {
+        debugfln("attach(name=%s) shm_open failed: %s (%d)", name_, strerror(errno), errno);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(TFModbusTCPWriteRingHeader)) {
+        debugfln("attach(name=%s) region missing or too short", name_);
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    void *region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (region == MAP_FAILED) {
+        debugfln("attach(name=%s) mmap failed: %s (%d)", name_, strerror(errno), errno);
+        return false;
+    }
+
+    TFModbusTCPWriteRingHeader *new_header = static_cast<TFModbusTCPWriteRingHeader *>(region);
+
+    if (__atomic_load_n(&new_header->magic, __ATOMIC_ACQUIRE) != TF_MODBUS_TCP_WRITE_RING_MAGIC
+     || new_header->version != TF_MODBUS_TCP_WRITE_RING_VERSION
+     || new_header->region_length != length
+     || new_header->capacity == 0
+     || sizeof(TFModbusTCPWriteRingHeader) + static_cast<uint64_t>(new_header->capacity) * sizeof(TFModbusTCPWriteRingEntry) != length) {
+        debugfln("attach(name=%s) region not initialized or incompatible", name_);
+        munmap(region, length);
+        return false;
+    }
+
+    header        = new_header;
+    region_length = length;
+    shared        = true;
+
+    return true;
+#else
+    (void)name_;
+
+    debugfln("attach() shared memory not supported");
+    return false;
+#endif
+}
+
+void TFModbusTCPWriteRing::close()
+{
+    if (header == nullptr) {
+        return;
+    }
+
+    if (shared) {
+#if TF_MODBUS_TCP_REGISTER_IMAGE_POSIX_SHM
+        munmap(header, region_length);
+
+        if (name != nullptr) {
+            shm_unlink(name);
+        }
+#endif
+    }
+    else {
+        free(header);
+    }
+
+    free(name);
+    name = nullptr;
+
+    header        = nullptr;
+    region_length = 0;
+    shared        = false;
+}
+
+bool TFModbusTCPWriteRing::push(const TFModbusTCPWriteRingEntry *entry)
+{
+    if (header == nullptr) {
+        return false;
+    }
+
+    uint32_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= header->capacity) {
+        __atomic_store_n(&header->dropped_count, __atomic_load_n(&header->dropped_count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    memcpy(&get_entries(header)[head % header->capacity], entry, sizeof(TFModbusTCPWriteRingEntry));
+
+    __atomic_store_n(&header->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool TFModbusTCPWriteRing::pop(TFModbusTCPWriteRingEntry *entry)
+{
+    if (header == nullptr) {
+        return false;
+    }
+
+    uint32_t tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(entry, &get_entries(header)[tail % header->capacity], sizeof(TFModbusTCPWriteRingEntry));
+
+    __atomic_store_n(&header->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+uint32_t TFModbusTCPWriteRing::get_dropped_count() const
+{
+    return header != nullptr ? __atomic_load_n(&header->dropped_count, __ATOMIC_RELAXED) : 0;
+}
+
+bool TFModbusTCPServerRegisterBank::add_address_ranges(TFModbusTCPServer *server) const
+{
+    size_t block_count = image->get_block_count();
+    bool success = block_count > 0;
+
+    for (size_t i = 0; i < block_count; ++i) {
+        TFModbusTCPRegisterImageBlockInfo info;
+
+        if (!image->get_block_info(i, &info)
+         || !server->add_address_range(info.unit_id, info.table, info.start_address, info.data_count)) {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+TFModbusTCPExceptionCode TFModbusTCPServerRegisterBank::read(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, void *values) const
+{
+    ssize_t block_index = image->find_block(unit_id, table, start_address, data_count);
+
+    if (block_index < 0) {
+        return TFModbusTCPExceptionCode::IllegalDataAddress;
+    }
+
+    TFModbusTCPRegisterImageBlockInfo info;
+
+    image->get_block_info(static_cast<size_t>(block_index), &info);
+
+    if (!image->read(static_cast<size_t>(block_index), start_address - info.start_address, data_count, values)) {
+        // Not written by the owning process yet
+        return TFModbusTCPExceptionCode::ServerDeviceBusy;
+    }
+
+    return TFModbusTCPExceptionCode::Success;
+}
+
+TFModbusTCPExceptionCode TFModbusTCPServerRegisterBank::write(uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, const void *values)
+{
+    if (ring == nullptr) {
+        return TFModbusTCPExceptionCode::IllegalFunction;
+    }
+
+    TFModbusTCPTable table = function_code == TFModbusTCPFunctionCode::WriteMultipleCoils ? TFModbusTCPTable::Coils : TFModbusTCPTable::HoldingRegisters;
+    uint16_t address_count = function_code == TFModbusTCPFunctionCode::MaskWriteRegister ? 1 : data_count;
+
+    if (image->find_block(unit_id, table, start_address, address_count) < 0) {
+        return TFModbusTCPExceptionCode::IllegalDataAddress;
+    }
+
+    TFModbusTCPWriteRingEntry entry;
+    size_t values_length = table == TFModbusTCPTable::Coils ? (data_count + 7u) / 8u : data_count * 2u;
+
+    if (values_length > sizeof(entry.coil_values)) {
+        return TFModbusTCPExceptionCode::IllegalDataValue;
+    }
+
+    entry.unit_id       = unit_id;
+    entry.function_code = static_cast<uint8_t>(function_code);
+    entry.start_address = start_address;
+    entry.data_count    = data_count;
+    entry.reserved      = 0;
+
+    memcpy(entry.coil_values, values, values_length);
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+
+    if (!ring->push(&entry)) {
+        return TFModbusTCPExceptionCode::ServerDeviceBusy;
+    }
+
+    return TFModbusTCPExceptionCode::Success;
+}
+
+TFModbusTCPExceptionCode TFModbusTCPServerRegisterBank::handle_request(uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address,
+                                                                       uint16_t data_count, void *data_values)
+{
+    switch (function_code) {
+    case TFModbusTCPFunctionCode::ReadCoils:
+        return read(unit_id, TFModbusTCPTable::Coils, start_address, data_count, data_values);
+
+    case TFModbusTCPFunctionCode::ReadDiscreteInputs:
+        return read(unit_id, TFModbusTCPTable::DiscreteInputs, start_address, data_count, data_values);
+
+    case TFModbusTCPFunctionCode::ReadHoldingRegisters:
+        return read(unit_id, TFModbusTCPTable::HoldingRegisters, start_address, data_count, data_values);
+
+    case TFModbusTCPFunctionCode::ReadInputRegisters:
+        return read(unit_id, TFModbusTCPTable::InputRegisters, start_address, data_count, data_values);
+
+    case TFModbusTCPFunctionCode::WriteMultipleCoils:
+    case TFModbusTCPFunctionCode::WriteMultipleRegisters:
+    case TFModbusTCPFunctionCode::MaskWriteRegister:
+        return write(unit_id, function_code, start_address, data_count, data_values);
+
+    case TFModbusTCPFunctionCode::ReadWriteMultipleRegisters:
+        {
+            TFModbusTCPServerReadWriteMultipleRegistersValues *values = static_cast<TFModbusTCPServerReadWriteMultipleRegistersValues *>(data_values);
+
+            // The write is not applied yet, the read returns the current
+            // image. Read first, so that a failing read does not leave a
+            // write in the ring for a request that is answered with an
+            // exception
+            TFModbusTCPExceptionCode exception_code = read(unit_id, TFModbusTCPTable::HoldingRegisters, start_address, data_count, values->read_register_values);
+
+            if (exception_code != TFModbusTCPExceptionCode::Success) {
+                return exception_code;
+            }
+
+            return write(unit_id, TFModbusTCPFunctionCode::WriteMultipleRegisters,
+                         values->write_start_address, values->write_data_count, values->write_register_values);
+        }
+
+    default:
+        return TFModbusTCPExceptionCode::IllegalFunction;
+    }
+}
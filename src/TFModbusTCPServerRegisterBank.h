@@ -0,0 +1,113 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <mutex>
+
+#include "TFModbusTCPCommon.h"
+#include "TFModbusTCPRegisterImage.h"
+#include "TFModbusTCPServer.h"
+
+// configuration
+#ifndef TF_MODBUS_TCP_WRITE_RING_CAPACITY
+#define TF_MODBUS_TCP_WRITE_RING_CAPACITY 64
+#endif
+
+#define TF_MODBUS_TCP_WRITE_RING_ENTRY_VALUES_LENGTH 246 // 123 registers or 1968 coils
+
+// A write request from a master. Registers are stored as uint16_t values in
+// the register byte order of the server and coils packed LSB first. Function
+// code is WriteMultipleCoils, WriteMultipleRegisters or MaskWriteRegister. For
+// MaskWriteRegister the values are the and-mask and the or-mask
+struct TFModbusTCPWriteRingEntry
+{
+    uint8_t unit_id;
+    uint8_t function_code;
+    uint16_t start_address;
+    uint16_t data_count;
+    uint16_t reserved;
+    union {
+        uint8_t coil_values[TF_MODBUS_TCP_WRITE_RING_ENTRY_VALUES_LENGTH];
+        uint16_t register_values[TF_MODBUS_TCP_WRITE_RING_ENTRY_VALUES_LENGTH / 2];
+    };
+};
+
+struct TFModbusTCPWriteRingHeader;
+
+// Lock-free single producer, single consumer ring of write requests in shared
+// memory. The server pushes, the process that owns the register image pops
+// and applies the writes. Without POSIX shared memory support the ring can
+// only be created without name, for tasks of the same process
+class TFModbusTCPWriteRing
+{
+public:
+    TFModbusTCPWriteRing() {}
+    ~TFModbusTCPWriteRing();
+
+    TFModbusTCPWriteRing(TFModbusTCPWriteRing const &other) = delete;
+    TFModbusTCPWriteRing &operator=(TFModbusTCPWriteRing const &other) = delete;
+
+    bool create(const char *name = nullptr, uint32_t capacity = TF_MODBUS_TCP_WRITE_RING_CAPACITY);
+    bool attach(const char *name);
+    void close(); // the creator also removes the name
+    bool is_open() const { return header != nullptr; }
+
+    bool push(const TFModbusTCPWriteRingEntry *entry); // false if full
+    bool pop(TFModbusTCPWriteRingEntry *entry);        // false if empty
+    uint32_t get_dropped_count() const;                // pushes that failed because the ring was full
+
+private:
+    TFModbusTCPWriteRingHeader *header = nullptr;
+    size_t region_length = 0;
+    bool shared = false;
+    char *name = nullptr; // only set for the creator
+};
+
+// Serves a TFModbusTCPServer from a register image that another process keeps
+// up to date. Reads are answered straight from the image. Writes are pushed to
+// the write ring and only become visible once the owning process applied them
+// to its devices and the image. If the ring is full, writes are answered with
+// a ServerDeviceBusy exception. The server has to use the same register byte
+// order as the client that fills the image. handle_request() is thread-safe,
+// so one bank can serve all workers of a TFModbusTCPThreadedServer
+class TFModbusTCPServerRegisterBank
+{
+public:
+    TFModbusTCPServerRegisterBank(const TFModbusTCPRegisterImage *image_, TFModbusTCPWriteRing *ring_ = nullptr) : image(image_), ring(ring_) {}
+
+    // Adds the blocks of the image as address ranges of the server. Call
+    // after the image was attached and before the server is started
+    bool add_address_ranges(TFModbusTCPServer *server) const;
+
+    // Request callback for TFModbusTCPServer::start()
+    TFModbusTCPExceptionCode handle_request(uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address,
+                                            uint16_t data_count, void *data_values);
+
+private:
+    TFModbusTCPExceptionCode read(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count, void *values) const;
+    TFModbusTCPExceptionCode write(uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, const void *values);
+
+    const TFModbusTCPRegisterImage *image;
+    TFModbusTCPWriteRing *ring;
+    std::mutex ring_mutex; // the ring has a single producer
+};
@@ -0,0 +1,42 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include "TFGenericTCPShardedClientPool.h"
+#include "TFModbusTCPClientPool.h"
+
+class TFModbusTCPShardedClientPool : public TFGenericTCPShardedClientPool
+{
+public:
+    TFModbusTCPShardedClientPool(TFModbusTCPByteOrder register_byte_order_, size_t shard_count_,
+                                 size_t max_slot_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT,
+                                 size_t max_share_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT) :
+        TFGenericTCPShardedClientPool(shard_count_), register_byte_order(register_byte_order_),
+        max_slot_count(max_slot_count_), max_share_count(max_share_count_) {}
+
+protected:
+    TFGenericTCPClientPool *create_pool() override { return new TFModbusTCPClientPool(register_byte_order, max_slot_count, max_share_count); }
+
+private:
+    TFModbusTCPByteOrder register_byte_order;
+    size_t max_slot_count;
+    size_t max_share_count;
+};
@@ -0,0 +1,82 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "TFGenericTCPSubmitQueue.h"
+#include "TFModbusTCPClient.h"
+
+#define TF_MODBUS_TCP_SUBMIT_ERROR_MESSAGE_LENGTH 64
+
+// Submits a transaction from any thread. The queue has to be drained by the
+// thread that ticks the client or its pool. Without completion queue the
+// callback runs on the ticking thread. With completion queue the callback runs
+// on the submitting thread during its next poll() of the completion queue,
+// then the error message is a copy truncated to 63 characters. The completion
+// queue is single producer: all clients submitted with the same completion
+// queue have to be ticked by the same network thread. Client can be
+// a TFModbusTCPClient or a TFModbusTCPSharedClient and has to stay valid until
+// the callback was called. Returns false if the submit or completion queue is
+// full, then the callback is not called
+template <typename Client>
+bool tf_modbus_tcp_submit_transact(TFGenericTCPSubmitQueue *queue, Client *client, uint8_t unit_id, TFModbusTCPFunctionCode function_code,
+                                   uint16_t start_address, uint16_t data_count, void *buffer, micros_t timeout,
+                                   TFModbusTCPClientTransactionCallback &&callback, TFGenericTCPCompletionQueue *completion_queue = nullptr)
+{
+    if (completion_queue == nullptr) {
+        return queue->post([client, unit_id, function_code, start_address, data_count, buffer, timeout, callback]() mutable {
+            client->transact(unit_id, function_code, start_address, data_count, buffer, timeout, std::move(callback));
+        });
+    }
+
+    if (!completion_queue->reserve()) {
+        return false;
+    }
+
+    bool posted = queue->post([client, unit_id, function_code, start_address, data_count, buffer, timeout, callback, completion_queue]() mutable {
+        client->transact(unit_id, function_code, start_address, data_count, buffer, timeout,
+        [callback, completion_queue](TFModbusTCPClientTransactionResult result, const char *error_message) mutable {
+            struct ErrorMessage {
+                bool valid;
+                char text[TF_MODBUS_TCP_SUBMIT_ERROR_MESSAGE_LENGTH];
+            } copy;
+
+            copy.valid = error_message != nullptr;
+
+            if (copy.valid) {
+                strncpy(copy.text, error_message, sizeof(copy.text) - 1);
+                copy.text[sizeof(copy.text) - 1] = '\0';
+            }
+
+            completion_queue->push([callback, result, copy]() {
+                callback(result, copy.valid ? copy.text : nullptr);
+            });
+        });
+    });
+
+    if (!posted) {
+        completion_queue->unreserve();
+    }
+
+    return posted;
+}
@@ -0,0 +1,155 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFModbusTCPThreadedServer.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "TFNetwork.h"
+
+#define debugfln(fmt, ...) tf_network_debugfln("TFModbusTCPThreadedServer[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
+
+struct TFModbusTCPThreadedServerWorker
+{
+    TFModbusTCPServer *server;
+    std::thread thread;
+};
+
+TFModbusTCPThreadedServer::TFModbusTCPThreadedServer(TFModbusTCPByteOrder register_byte_order_, size_t worker_count_, size_t max_client_count_per_worker) :
+    worker_count(worker_count_ > 0 ? worker_count_ : 1),
+    workers(new TFModbusTCPThreadedServerWorker[worker_count])
+{
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers[i].server = new TFModbusTCPServer(register_byte_order_, max_client_count_per_worker);
+
+        // A single worker doesn't share its port
+        workers[i].server->set_reuse_port(worker_count > 1);
+    }
+}
+
+TFModbusTCPThreadedServer::~TFModbusTCPThreadedServer()
+{
+    stop();
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        delete workers[i].server;
+    }
+
+    delete[] workers;
+}
+
+bool TFModbusTCPThreadedServer::start(uint32_t bind_address, uint16_t port,
+                                      TFModbusTCPServerConnectCallback &&connect_callback,
+                                      TFModbusTCPServerDisconnectCallback &&disconnect_callback,
+                                      TFModbusTCPServerRequestCallback &&request_callback)
+{
+    if (running.load()) {
+        debugfln("start(port=%u) already running", port);
+
+        errno = EALREADY;
+        return false;
+    }
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        // Every server gets its own copy of the callbacks
+        TFModbusTCPServerConnectCallback worker_connect_callback = connect_callback;
+        TFModbusTCPServerDisconnectCallback worker_disconnect_callback = disconnect_callback;
+        TFModbusTCPServerRequestCallback worker_request_callback = request_callback;
+
+        if (!workers[i].server->start(bind_address, port, std::move(worker_connect_callback), std::move(worker_disconnect_callback), std::move(worker_request_callback))) {
+            int saved_errno = errno;
+
+            debugfln("start(port=%u) worker %zu failed: %s (%d)", port, i, strerror(saved_errno), saved_errno);
+
+            while (i > 0) {
+                workers[--i].server->stop();
+            }
+
+            errno = saved_errno;
+            return false;
+        }
+    }
+
+    running.store(true);
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        TFModbusTCPServer *server = workers[i].server;
+
+        workers[i].thread = std::thread([this, server]() {
+            while (running.load(std::memory_order_relaxed)) {
+                server->tick(TF_MODBUS_TCP_THREADED_SERVER_MAX_WAIT_DURATION);
+            }
+        });
+    }
+
+    return true;
+}
+
+bool TFModbusTCPThreadedServer::stop()
+{
+    if (!running.exchange(false)) {
+        errno = ESRCH;
+        return false;
+    }
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers[i].thread.join();
+    }
+
+    // The worker threads are gone, disconnect callbacks run on this thread
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers[i].server->stop();
+    }
+
+    return true;
+}
+
+bool TFModbusTCPThreadedServer::add_address_range(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count)
+{
+    if (running.load()) {
+        errno = EBUSY;
+        return false;
+    }
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        if (!workers[i].server->add_address_range(unit_id, table, start_address, data_count)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TFModbusTCPThreadedServer::clear_address_ranges()
+{
+    if (running.load()) {
+        errno = EBUSY;
+        return false;
+    }
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        if (!workers[i].server->clear_address_ranges()) {
+            return false;
+        }
+    }
+
+    return true;
+}
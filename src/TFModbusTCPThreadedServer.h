@@ -0,0 +1,74 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+
+#include "TFModbusTCPServer.h"
+
+// configuration
+
+// Longest time a worker blocks on its sockets before it checks whether the
+// server got stopped, bounds how long stop() takes
+#ifndef TF_MODBUS_TCP_THREADED_SERVER_MAX_WAIT_DURATION
+#define TF_MODBUS_TCP_THREADED_SERVER_MAX_WAIT_DURATION 100_ms
+#endif
+
+struct TFModbusTCPThreadedServerWorker;
+
+// Runs one TFModbusTCPServer per worker thread, each with its own listening
+// socket on the same port via SO_REUSEPORT and its own client table. The
+// kernel spreads new connections over the workers, a connection stays with
+// its worker. Each worker blocks in select() on its listening and client
+// sockets between ticks.
+//
+// The callbacks are called concurrently from all worker threads and have to
+// be thread-safe. A request callback that only reads shared data and writes
+// through TFModbusTCPServerRegisterBank fulfills this
+class TFModbusTCPThreadedServer
+{
+public:
+    TFModbusTCPThreadedServer(TFModbusTCPByteOrder register_byte_order_, size_t worker_count_,
+                              size_t max_client_count_per_worker = TF_MODBUS_TCP_SERVER_MAX_CLIENT_COUNT);
+    ~TFModbusTCPThreadedServer();
+
+    TFModbusTCPThreadedServer(TFModbusTCPThreadedServer const &other) = delete;
+    TFModbusTCPThreadedServer &operator=(TFModbusTCPThreadedServer const &other) = delete;
+
+    bool start(uint32_t bind_address, uint16_t port,
+               TFModbusTCPServerConnectCallback &&connect_callback,
+               TFModbusTCPServerDisconnectCallback &&disconnect_callback,
+               TFModbusTCPServerRequestCallback &&request_callback);
+    bool stop();
+    bool is_running() const { return running.load(); }
+
+    bool add_address_range(uint8_t unit_id, TFModbusTCPTable table, uint16_t start_address, uint16_t data_count); // while stopped
+    bool clear_address_ranges(); // while stopped
+
+    size_t get_worker_count() const { return worker_count; }
+
+private:
+    size_t worker_count;
+    TFModbusTCPThreadedServerWorker *workers; // worker_count entries
+    std::atomic<bool> running{false};
+};
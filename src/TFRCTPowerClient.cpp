@@ -19,34 +19,38 @@
 
 #include "TFRCTPowerClient.h"
 
+#include <errno.h>
 #include <math.h>
 #include <lwip/sockets.h>
 
 #include "TFNetwork.h"
+#include "TFRCTPowerCommon.h"
 
 #define debugfln(fmt, ...) tf_network_debugfln("TFRCTPowerClient[%p]::" fmt, static_cast<void *>(this) __VA_OPT__(,) __VA_ARGS__)
 
-static uint16_t crc16ccitt(uint8_t *buffer, size_t length)
+struct TFRCTPowerClientSubscriber
 {
-    uint32_t checksum = 0xFFFF;
-
-    for (size_t i = 0; i < length; ++i) {
-        for (size_t k = 0; k < 8; ++k) {
-            bool bit = (buffer[i] >> (7 - k) & 1) == 1;
-            bool c15 = ((checksum >> 15) & 1) == 1;
-
-            checksum <<= 1;
-
-            if (c15 ^ bit) {
-                checksum ^= 0x1021;
-            }
-        }
-
-        checksum &= 0xFFFF;
-    }
-
-    return checksum & 0xFFFF;
-}
+    TFRCTPowerClientSubscription *subscription;
+    const void *owner;
+    micros_t period;
+    float deadband;
+    float reported_value; // NAN until the first report
+    bool removed;
+    TFRCTPowerClientSubscriptionCallback callback;
+    TFRCTPowerClientSubscriber *next;
+};
+
+struct TFRCTPowerClientSubscription
+{
+    uint32_t id;
+    micros_t period; // shortest period of all subscribers
+    micros_t read_deadline;
+    bool read_pending;
+    float value;
+    micros_t timestamp; // 0_s until the first successful read
+    TFRCTPowerClientSubscriber *subscriber_head;
+    TFRCTPowerClientSubscription *next;
+};
 
 const char *get_tf_rct_power_client_transaction_result_name(TFRCTPowerClientTransactionResult result)
 {
@@ -85,6 +89,25 @@ const char *get_tf_rct_power_client_transaction_result_name(TFRCTPowerClientTran
     return "<Unknown>";
 }
 
+TFRCTPowerClient::~TFRCTPowerClient()
+{
+    while (subscription_head != nullptr) {
+        TFRCTPowerClientSubscription *subscription = subscription_head;
+
+        subscription_head = subscription->next;
+
+        while (subscription->subscriber_head != nullptr) {
+            TFRCTPowerClientSubscriber *subscriber = subscription->subscriber_head;
+
+            subscription->subscriber_head = subscriber->next;
+
+            delete subscriber;
+        }
+
+        delete subscription;
+    }
+}
+
 void TFRCTPowerClient::read(uint32_t id, micros_t timeout, TFRCTPowerClientTransactionCallback &&callback)
 {
     if (!callback) {
@@ -119,17 +142,164 @@ void TFRCTPowerClient::read(uint32_t id, micros_t timeout, TFRCTPowerClientTrans
 
     transaction->id       = id;
     transaction->timeout  = timeout;
+    transaction->deadline = 0_s;
     transaction->callback = std::move(callback);
     transaction->next     = nullptr;
 
     *tail_ptr = transaction;
 }
 
+void TFRCTPowerClient::set_pending_transaction_window(size_t window)
+{
+    if (window < 1) {
+        window = 1;
+    }
+    else if (window > TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT) {
+        window = TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT;
+    }
+
+    pending_transaction_window = window;
+}
+
+TFRCTPowerClientSubscriber *TFRCTPowerClient::subscribe(uint32_t id, micros_t period, float deadband,
+                                                         TFRCTPowerClientSubscriptionCallback &&callback,
+                                                         const void *owner /*= nullptr*/)
+{
+    if (!callback || period <= 0_s || deadband < 0.0f) {
+        debugfln("subscribe(id=0x%08x) invalid argument", id);
+        return nullptr;
+    }
+
+    TFRCTPowerClientSubscription *subscription = find_subscription(id);
+
+    if (subscription == nullptr) {
+        // Spread the first reads over the period by Fibonacci hashing a
+        // counter, so subscriptions made at the same time don't stay in sync
+        uint16_t phase = static_cast<uint16_t>(subscription_phase++ * 40503u);
+
+        subscription = new TFRCTPowerClientSubscription;
+
+        subscription->id              = id;
+        subscription->period          = period;
+        subscription->read_deadline   = calculate_deadline(micros_t{static_cast<int64_t>(period) * phase / 65536});
+        subscription->read_pending    = false;
+        subscription->value           = NAN;
+        subscription->timestamp       = 0_s;
+        subscription->subscriber_head = nullptr;
+        subscription->next            = subscription_head;
+
+        subscription_head = subscription;
+    }
+    else if (period < subscription->period) {
+        subscription->period = period;
+
+        micros_t read_deadline = calculate_deadline(period);
+
+        if (read_deadline < subscription->read_deadline) {
+            subscription->read_deadline = read_deadline;
+        }
+    }
+
+    TFRCTPowerClientSubscriber *subscriber = new TFRCTPowerClientSubscriber;
+
+    subscriber->subscription   = subscription;
+    subscriber->owner          = owner;
+    subscriber->period         = period;
+    subscriber->deadband       = deadband;
+    subscriber->reported_value = NAN;
+    subscriber->removed        = false;
+    subscriber->callback       = std::move(callback);
+    subscriber->next           = subscription->subscriber_head;
+
+    subscription->subscriber_head = subscriber;
+
+    return subscriber;
+}
+
+bool TFRCTPowerClient::unsubscribe(TFRCTPowerClientSubscriber *subscriber)
+{
+    for (TFRCTPowerClientSubscription *subscription = subscription_head; subscription != nullptr; subscription = subscription->next) {
+        for (TFRCTPowerClientSubscriber *other = subscription->subscriber_head; other != nullptr; other = other->next) {
+            if (other == subscriber && !subscriber->removed) {
+                subscriber->removed = true;
+                unsubscribe_pending = true;
+
+                remove_unsubscribed();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void TFRCTPowerClient::unsubscribe_all(const void *owner)
+{
+    for (TFRCTPowerClientSubscription *subscription = subscription_head; subscription != nullptr; subscription = subscription->next) {
+        for (TFRCTPowerClientSubscriber *subscriber = subscription->subscriber_head; subscriber != nullptr; subscriber = subscriber->next) {
+            if (subscriber->owner == owner && !subscriber->removed) {
+                subscriber->removed = true;
+                unsubscribe_pending = true;
+            }
+        }
+    }
+
+    remove_unsubscribed();
+}
+
+bool TFRCTPowerClient::get_cached_value(uint32_t id, float *value, micros_t *timestamp) const
+{
+    TFRCTPowerClientSubscription *subscription = find_subscription(id);
+
+    if (subscription == nullptr || subscription->timestamp == 0_s) {
+        return false;
+    }
+
+    if (value != nullptr) {
+        *value = subscription->value;
+    }
+
+    if (timestamp != nullptr) {
+        *timestamp = subscription->timestamp;
+    }
+
+    return true;
+}
+
+size_t TFRCTPowerClient::get_outstanding_request_count() const
+{
+    size_t count = pending_transaction_count;
+
+    for (TFRCTPowerClientTransaction *transaction = scheduled_transaction_head; transaction != nullptr; transaction = transaction->next) {
+        ++count;
+    }
+
+    return count;
+}
+
+bool TFRCTPowerClient::is_send_pending() const
+{
+    if (socket_fd < 0 || pending_transaction_count >= pending_transaction_window) {
+        return false;
+    }
+
+    // Reads of an already pending ID are held back, see send_scheduled_transactions()
+    for (TFRCTPowerClientTransaction *transaction = scheduled_transaction_head; transaction != nullptr; transaction = transaction->next) {
+        if (find_pending_transaction(transaction->id) == nullptr) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void TFRCTPowerClient::close_hook()
 {
     last_received_byte = 0;
     bootloader_magic_number = 0;
     bootloader_last_detected = 0_s;
+    receive_buffer_used = 0;
+    receive_buffer_offset = 0;
 
     reset_pending_response();
     finish_all_transactions(TFRCTPowerClientTransactionResult::Aborted);
@@ -138,57 +308,79 @@ void TFRCTPowerClient::close_hook()
 void TFRCTPowerClient::tick_hook()
 {
     check_pending_transaction_timeout();
+    read_due_subscriptions();
+    send_scheduled_transactions();
+}
+
+void TFRCTPowerClient::send_scheduled_transactions()
+{
+    uint8_t escaped_requests[TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT * (1 + 8 * 2)];
+    size_t escaped_requests_length = 0;
+    TFRCTPowerClientTransaction **pending_tail_ptr = &pending_transaction_head;
+
+    while (*pending_tail_ptr != nullptr) {
+        pending_tail_ptr = &(*pending_tail_ptr)->next;
+    }
+
+    TFRCTPowerClientTransaction **scheduled_ptr = &scheduled_transaction_head;
+
+    while (pending_transaction_count < pending_transaction_window && *scheduled_ptr != nullptr) {
+        TFRCTPowerClientTransaction *transaction = *scheduled_ptr;
 
-    if (pending_transaction == nullptr && scheduled_transaction_head != nullptr) {
-        pending_transaction          = scheduled_transaction_head;
-        scheduled_transaction_head   = scheduled_transaction_head->next;
-        pending_transaction->next    = nullptr;
-        pending_transaction_deadline = calculate_deadline(pending_transaction->timeout);
+        // Leave a read of an already pending ID scheduled, but send the reads behind it
+        if (find_pending_transaction(transaction->id) != nullptr) {
+            scheduled_ptr = &transaction->next;
+            continue;
+        }
+
+        *scheduled_ptr        = transaction->next;
+        transaction->next     = nullptr;
+        transaction->deadline = calculate_deadline(transaction->timeout);
+
+        *pending_tail_ptr = transaction;
+        pending_tail_ptr  = &transaction->next;
+        ++pending_transaction_count;
 
         uint8_t request[8];
 
         request[0] = 1; // command: read
         request[1] = 4; // length
-        request[2] = (uint8_t)((pending_transaction->id >> 24) & 0xFF);
-        request[3] = (uint8_t)((pending_transaction->id >> 16) & 0xFF);
-        request[4] = (uint8_t)((pending_transaction->id >>  8) & 0xFF);
-        request[5] = (uint8_t)((pending_transaction->id >>  0) & 0xFF);
+        request[2] = (uint8_t)((transaction->id >> 24) & 0xFF);
+        request[3] = (uint8_t)((transaction->id >> 16) & 0xFF);
+        request[4] = (uint8_t)((transaction->id >>  8) & 0xFF);
+        request[5] = (uint8_t)((transaction->id >>  0) & 0xFF);
 
-        uint32_t checksum = crc16ccitt(request, 6);
+        uint32_t checksum = tf_rct_power_crc16ccitt(request, 6);
 
         request[6] = (checksum >> 8) & 0xFF;
         request[7] = (checksum >> 0) & 0xFF;
 
-        uint8_t escaped_request[1 + 8 * 2] = "+";
-        size_t escaped_request_length = 1;
+        escaped_requests[escaped_requests_length++] = '+';
 
         for (size_t i = 0; i < sizeof(request); ++i) {
             if (request[i] == '+' || request[i] == '-') {
-                escaped_request[escaped_request_length++] = '-';
+                escaped_requests[escaped_requests_length++] = '-';
             }
 
-            escaped_request[escaped_request_length++] = request[i];
+            escaped_requests[escaped_requests_length++] = request[i];
         }
+    }
 
-        if (!send(escaped_request, escaped_request_length)) {
-            int saved_errno = errno;
-            finish_pending_transaction(TFRCTPowerClientTransactionResult::SendFailed, NAN);
-            disconnect(TFGenericTCPClientDisconnectReason::SocketSendFailed, saved_errno);
+    if (escaped_requests_length > 0 && !send(escaped_requests, escaped_requests_length)) {
+        int saved_errno = errno;
+
+        while (pending_transaction_head != nullptr) {
+            finish_pending_transaction(pending_transaction_head, TFRCTPowerClientTransactionResult::SendFailed, NAN);
         }
+
+        disconnect(TFGenericTCPClientDisconnectReason::SocketSendFailed, saved_errno);
     }
 }
 
 bool TFRCTPowerClient::receive_hook()
 {
-    micros_t deadline = calculate_deadline(10_ms);
-
-    while (sizeof(pending_response) - pending_response_used > 0) {
-        if (deadline_elapsed(deadline)) {
-            return true;
-        }
-
-        uint8_t received_byte;
-        ssize_t result = recv(&received_byte, 1);
+    if (receive_buffer_offset >= receive_buffer_used) {
+        ssize_t result = recv(receive_buffer, sizeof(receive_buffer));
 
         if (result < 0) {
             if (errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -203,50 +395,19 @@ bool TFRCTPowerClient::receive_hook()
             return false;
         }
 
-        bootloader_magic_number = (bootloader_magic_number << 8) | received_byte;
+        debugfln("Received %zd bytes", result);
 
-        if (bootloader_magic_number == 0x50F705AB) {
-            bootloader_last_detected = now_us();
-        }
-
-        debugfln("received_byte %u 0x%02x %s| last_received_byte %u 0x%02x %s",
-                 received_byte, received_byte, received_byte == '+' ? "+ " : (received_byte == '-' ? "- " : ""),
-                 last_received_byte, last_received_byte, last_received_byte == '+' ? "+ " : (last_received_byte == '-' ? "- " : ""));
-
-        if (wait_for_start) {
-            if (received_byte == '+' && last_received_byte != '-') {
-                debugfln("Received expected start byte");
-                wait_for_start = false;
-            }
-        }
-        else if (received_byte == '+') {
-            if (last_received_byte == '-') {
-                pending_response[pending_response_used++] = received_byte;
-            }
-            else {
-                debugfln("Received unexpected start byte, starting new response");
-                pending_response_used = 0;
-            }
-        }
-        else if (received_byte == '-') {
-            if (last_received_byte == '-') {
-                pending_response[pending_response_used++] = received_byte;
-            }
-        }
-        else {
-            pending_response[pending_response_used++] = received_byte;
-        }
+        receive_buffer_used   = static_cast<size_t>(result);
+        receive_buffer_offset = 0;
+    }
 
-        last_received_byte = received_byte;
+    // Parse until a response is complete, leftover bytes are parsed by the next call
+    while (receive_buffer_offset < receive_buffer_used && pending_response_used < sizeof(pending_response)) {
+        parse_received_byte(receive_buffer[receive_buffer_offset++]);
+    }
 
-        if (pending_response_used == 1 && pending_response[0] != 5) {
-            debugfln("Received response with unexpected command %u, ignoring response", pending_response[0]);
-            reset_pending_response();
-        }
-        else if (pending_response_used == 2 && pending_response[1] != 8) {
-            debugfln("Received response with unexpected length %u, ignoring response", pending_response[1]);
-            reset_pending_response();
-        }
+    if (pending_response_used < sizeof(pending_response)) {
+        return true;
     }
 
     uint32_t id = ((uint32_t)pending_response[2] << 24) |
@@ -254,12 +415,14 @@ bool TFRCTPowerClient::receive_hook()
                   ((uint32_t)pending_response[4] <<  8) |
                   ((uint32_t)pending_response[5] <<  0);
 
-    if (pending_transaction == nullptr || pending_transaction->id != id) {
+    TFRCTPowerClientTransaction *transaction = find_pending_transaction(id);
+
+    if (transaction == nullptr) {
         reset_pending_response();
         return true;
     }
 
-    uint16_t actual_checksum   = crc16ccitt(pending_response, pending_response_used - 2);
+    uint16_t actual_checksum   = tf_rct_power_crc16ccitt(pending_response, pending_response_used - 2);
     uint16_t expected_checksum = ((uint16_t)pending_response[pending_response_used - 2] << 8) | pending_response[pending_response_used - 1];
 
     if (actual_checksum != expected_checksum) {
@@ -269,7 +432,7 @@ bool TFRCTPowerClient::receive_hook()
                  id, actual_checksum, expected_checksum);
 
         reset_pending_response();
-        finish_pending_transaction(TFRCTPowerClientTransactionResult::ChecksumMismatch, NAN);
+        finish_pending_transaction(transaction, TFRCTPowerClientTransactionResult::ChecksumMismatch, NAN);
         return true;
     }
 
@@ -286,27 +449,51 @@ bool TFRCTPowerClient::receive_hook()
     debugfln("Received response for ID 0x%08x with value %f", id, u.value);
 
     reset_pending_response();
-    finish_pending_transaction(TFRCTPowerClientTransactionResult::Success, u.value);
+    finish_pending_transaction(transaction, TFRCTPowerClientTransactionResult::Success, u.value);
     return true;
 }
 
-void TFRCTPowerClient::finish_pending_transaction(TFRCTPowerClientTransactionResult result, float value)
+TFRCTPowerClientTransaction *TFRCTPowerClient::find_pending_transaction(uint32_t id) const
+{
+    for (TFRCTPowerClientTransaction *transaction = pending_transaction_head; transaction != nullptr; transaction = transaction->next) {
+        if (transaction->id == id) {
+            return transaction;
+        }
+    }
+
+    return nullptr;
+}
+
+void TFRCTPowerClient::finish_pending_transaction(TFRCTPowerClientTransaction *transaction, TFRCTPowerClientTransactionResult result, float value)
 {
-    if (pending_transaction != nullptr) {
-        TFRCTPowerClientTransactionCallback callback = std::move(pending_transaction->callback);
-        pending_transaction->callback = nullptr;
+    TFRCTPowerClientTransaction **transaction_ptr = &pending_transaction_head;
 
-        delete pending_transaction;
-        pending_transaction          = nullptr;
-        pending_transaction_deadline = 0_s;
+    while (*transaction_ptr != nullptr && *transaction_ptr != transaction) {
+        transaction_ptr = &(*transaction_ptr)->next;
+    }
 
-        callback(result, value);
+    if (*transaction_ptr == nullptr) {
+        return;
     }
+
+    *transaction_ptr = transaction->next;
+    --pending_transaction_count;
+
+    record_request_result(result == TFRCTPowerClientTransactionResult::Success, result == TFRCTPowerClientTransactionResult::Timeout);
+
+    TFRCTPowerClientTransactionCallback callback = std::move(transaction->callback);
+    transaction->callback = nullptr;
+
+    delete transaction;
+
+    callback(result, value);
 }
 
 void TFRCTPowerClient::finish_all_transactions(TFRCTPowerClientTransactionResult result)
 {
-    finish_pending_transaction(result, NAN);
+    while (pending_transaction_head != nullptr) {
+        finish_pending_transaction(pending_transaction_head, result, NAN);
+    }
 
     TFRCTPowerClientTransaction *scheduled_transaction = scheduled_transaction_head;
     scheduled_transaction_head = nullptr;
@@ -326,8 +513,18 @@ void TFRCTPowerClient::finish_all_transactions(TFRCTPowerClientTransactionResult
 
 void TFRCTPowerClient::check_pending_transaction_timeout()
 {
-    if (pending_transaction != nullptr && deadline_elapsed(pending_transaction_deadline)) {
-        finish_pending_transaction(TFRCTPowerClientTransactionResult::Timeout, NAN);
+    TFRCTPowerClientTransaction *transaction = pending_transaction_head;
+
+    while (transaction != nullptr) {
+        if (deadline_elapsed(transaction->deadline)) {
+            finish_pending_transaction(transaction, TFRCTPowerClientTransactionResult::Timeout, NAN);
+
+            // The callback might have changed the list, start over
+            transaction = pending_transaction_head;
+        }
+        else {
+            transaction = transaction->next;
+        }
     }
 }
 
@@ -336,3 +533,188 @@ void TFRCTPowerClient::reset_pending_response()
     wait_for_start        = true;
     pending_response_used = 0;
 }
+
+void TFRCTPowerClient::parse_received_byte(uint8_t received_byte)
+{
+    bootloader_magic_number = (bootloader_magic_number << 8) | received_byte;
+
+    if (bootloader_magic_number == 0x50F705AB) {
+        bootloader_last_detected = now_us();
+    }
+
+    uint8_t previous_byte = last_received_byte;
+
+    // An escaped byte cannot escape the next byte, otherwise an escaped '-'
+    // followed by an escaped '+' or '-' would be misread
+    last_received_byte = previous_byte == '-' ? 0 : received_byte;
+
+    if (wait_for_start) {
+        if (received_byte == '+' && previous_byte != '-') {
+            wait_for_start = false;
+        }
+    }
+    else if (received_byte == '+') {
+        if (previous_byte == '-') {
+            pending_response[pending_response_used++] = received_byte;
+        }
+        else {
+            debugfln("Received unexpected start byte, starting new response");
+            pending_response_used = 0;
+        }
+    }
+    else if (received_byte == '-') {
+        if (previous_byte == '-') {
+            pending_response[pending_response_used++] = received_byte;
+        }
+    }
+    else {
+        pending_response[pending_response_used++] = received_byte;
+    }
+
+    if (pending_response_used == 1 && pending_response[0] != 5) {
+        debugfln("Received response with unexpected command %u, ignoring response", pending_response[0]);
+        reset_pending_response();
+    }
+    else if (pending_response_used == 2 && pending_response[1] != 8) {
+        debugfln("Received response with unexpected length %u, ignoring response", pending_response[1]);
+        reset_pending_response();
+    }
+}
+
+TFRCTPowerClientSubscription *TFRCTPowerClient::find_subscription(uint32_t id) const
+{
+    for (TFRCTPowerClientSubscription *subscription = subscription_head; subscription != nullptr; subscription = subscription->next) {
+        if (subscription->id == id) {
+            return subscription;
+        }
+    }
+
+    return nullptr;
+}
+
+void TFRCTPowerClient::read_due_subscriptions()
+{
+    while (get_outstanding_request_count() < pending_transaction_window) {
+        TFRCTPowerClientSubscription *due_subscription = nullptr;
+
+        // Read the most overdue subscription first
+        for (TFRCTPowerClientSubscription *subscription = subscription_head; subscription != nullptr; subscription = subscription->next) {
+            if (!subscription->read_pending
+             && deadline_elapsed(subscription->read_deadline)
+             && (due_subscription == nullptr || subscription->read_deadline < due_subscription->read_deadline)) {
+                due_subscription = subscription;
+            }
+        }
+
+        if (due_subscription == nullptr) {
+            return;
+        }
+
+        // Keep the phase of the subscription, unless it fell behind
+        due_subscription->read_pending  = true;
+        due_subscription->read_deadline = due_subscription->read_deadline + due_subscription->period;
+
+        if (deadline_elapsed(due_subscription->read_deadline)) {
+            due_subscription->read_deadline = calculate_deadline(due_subscription->period);
+        }
+
+        uint32_t id = due_subscription->id;
+
+        read(id, TF_RCT_POWER_CLIENT_SUBSCRIPTION_READ_TIMEOUT,
+        [this, id](TFRCTPowerClientTransactionResult result, float value) {
+            // Look the subscription up again, it might have been removed while
+            // the read was pending. Then the result is dropped
+            TFRCTPowerClientSubscription *subscription = find_subscription(id);
+
+            if (subscription == nullptr) {
+                debugfln("Subscription for ID 0x%08x was removed during read, dropping result", id);
+                return;
+            }
+
+            subscription->read_pending = false;
+
+            if (result != TFRCTPowerClientTransactionResult::Success) {
+                debugfln("Subscription read for ID 0x%08x failed: %s", id, get_tf_rct_power_client_transaction_result_name(result));
+                return;
+            }
+
+            update_subscription(subscription, value);
+        });
+    }
+}
+
+void TFRCTPowerClient::update_subscription(TFRCTPowerClientSubscription *subscription, float value)
+{
+    subscription->value     = value;
+    subscription->timestamp = now_us();
+
+    // Subscribers might unsubscribe from their callbacks, defer the removal
+    bool was_notifying = subscription_notifying;
+    subscription_notifying = true;
+
+    for (TFRCTPowerClientSubscriber *subscriber = subscription->subscriber_head; subscriber != nullptr; subscriber = subscriber->next) {
+        if (subscriber->removed) {
+            continue;
+        }
+
+        bool changed;
+
+        if (isnan(value) || isnan(subscriber->reported_value)) {
+            changed = isnan(value) != isnan(subscriber->reported_value);
+        }
+        else {
+            changed = fabsf(value - subscriber->reported_value) > subscriber->deadband;
+        }
+
+        if (changed) {
+            subscriber->reported_value = value;
+            subscriber->callback(value, subscription->timestamp);
+        }
+    }
+
+    subscription_notifying = was_notifying;
+
+    remove_unsubscribed();
+}
+
+void TFRCTPowerClient::remove_unsubscribed()
+{
+    if (!unsubscribe_pending || subscription_notifying) {
+        return;
+    }
+
+    unsubscribe_pending = false;
+
+    TFRCTPowerClientSubscription **subscription_ptr = &subscription_head;
+
+    while (*subscription_ptr != nullptr) {
+        TFRCTPowerClientSubscription *subscription = *subscription_ptr;
+        TFRCTPowerClientSubscriber **subscriber_ptr = &subscription->subscriber_head;
+        micros_t period = 0_s;
+
+        while (*subscriber_ptr != nullptr) {
+            TFRCTPowerClientSubscriber *subscriber = *subscriber_ptr;
+
+            if (subscriber->removed) {
+                *subscriber_ptr = subscriber->next;
+                delete subscriber;
+                continue;
+            }
+
+            if (period == 0_s || subscriber->period < period) {
+                period = subscriber->period;
+            }
+
+            subscriber_ptr = &subscriber->next;
+        }
+
+        if (subscription->subscriber_head == nullptr) {
+            *subscription_ptr = subscription->next;
+            delete subscription; // a pending read drops its result, see read_due_subscriptions()
+            continue;
+        }
+
+        subscription->period = period;
+        subscription_ptr = &subscription->next;
+    }
+}
@@ -24,8 +24,25 @@
 #include "TFGenericTCPClient.h"
 
 // configuration
+// Both counts limit how many objects can be read within one round trip. The
+// defaults allow reading a typical set of about 40 objects at once. Reduce
+// them on memory constrained targets, the batch send uses a stack buffer of
+// 17 bytes per pending transaction
 #ifndef TF_RCT_POWER_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT
-#define TF_RCT_POWER_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT 8
+#define TF_RCT_POWER_CLIENT_MAX_SCHEDULED_TRANSACTION_COUNT 48
+#endif
+
+// Upper limit for the pending transaction window, see TFRCTPowerClient::set_pending_transaction_window()
+#ifndef TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT
+#define TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT 48
+#endif
+
+#ifndef TF_RCT_POWER_CLIENT_RECEIVE_BUFFER_SIZE
+#define TF_RCT_POWER_CLIENT_RECEIVE_BUFFER_SIZE 128
+#endif
+
+#ifndef TF_RCT_POWER_CLIENT_SUBSCRIPTION_READ_TIMEOUT
+#define TF_RCT_POWER_CLIENT_SUBSCRIPTION_READ_TIMEOUT 2_s
 #endif
 
 enum class TFRCTPowerClientTransactionResult
@@ -46,10 +63,16 @@ const char *get_tf_rct_power_client_transaction_result_name(TFRCTPowerClientTran
 
 typedef std::function<void(TFRCTPowerClientTransactionResult result, float value)> TFRCTPowerClientTransactionCallback;
 
+typedef std::function<void(float value, micros_t timestamp)> TFRCTPowerClientSubscriptionCallback;
+
+struct TFRCTPowerClientSubscription;
+struct TFRCTPowerClientSubscriber;
+
 struct TFRCTPowerClientTransaction
 {
     uint32_t id;
     micros_t timeout;
+    micros_t deadline; // only valid while pending
     TFRCTPowerClientTransactionCallback callback;
     TFRCTPowerClientTransaction *next;
 };
@@ -58,20 +81,55 @@ class TFRCTPowerClient final : public TFGenericTCPClient
 {
 public:
     TFRCTPowerClient() {}
+    ~TFRCTPowerClient();
 
     void read(uint32_t id, micros_t timeout, TFRCTPowerClientTransactionCallback &&callback);
 
+    // Reads the ID at least every period while connected. All subscribers of
+    // an ID share one read at the shortest period of them. The callback is
+    // only called if the value differs from the last value reported to this
+    // subscriber by more than deadband. Subscription reads are only scheduled
+    // while the pending transaction window has room, so they don't crowd out
+    // other reads. The owner is used by unsubscribe_all()
+    TFRCTPowerClientSubscriber *subscribe(uint32_t id, micros_t period, float deadband,
+                                          TFRCTPowerClientSubscriptionCallback &&callback,
+                                          const void *owner = nullptr);
+    bool unsubscribe(TFRCTPowerClientSubscriber *subscriber);
+    void unsubscribe_all(const void *owner);
+
+    // Returns false if the ID is not subscribed or was not read yet
+    bool get_cached_value(uint32_t id, float *value, micros_t *timestamp) const;
+
+    size_t get_outstanding_request_count() const override;
+    size_t get_in_flight_request_count() const override { return pending_transaction_count; }
+    bool is_send_pending() const override;
+
+    // Responses carry the ID they belong to. Up to window reads are sent
+    // without waiting for the responses of the previous ones. Scheduled reads
+    // are sent in a batch, but a read is held back while another read of the
+    // same ID is pending, because the responses would be ambiguous
+    void set_pending_transaction_window(size_t window);
+    size_t get_pending_transaction_window() const { return pending_transaction_window; }
+
 private:
     void close_hook() override;
     void tick_hook() override;
     bool receive_hook() override;
-    void finish_pending_transaction(TFRCTPowerClientTransactionResult result, float value);
+    void send_scheduled_transactions();
+    TFRCTPowerClientTransaction *find_pending_transaction(uint32_t id) const;
+    void finish_pending_transaction(TFRCTPowerClientTransaction *transaction, TFRCTPowerClientTransactionResult result, float value);
     void finish_all_transactions(TFRCTPowerClientTransactionResult result);
     void check_pending_transaction_timeout();
     void reset_pending_response();
+    void parse_received_byte(uint8_t received_byte);
+    TFRCTPowerClientSubscription *find_subscription(uint32_t id) const;
+    void read_due_subscriptions();
+    void update_subscription(TFRCTPowerClientSubscription *subscription, float value);
+    void remove_unsubscribed();
 
-    TFRCTPowerClientTransaction *pending_transaction        = nullptr;
-    micros_t pending_transaction_deadline                   = 0_s;
+    TFRCTPowerClientTransaction *pending_transaction_head   = nullptr;
+    size_t pending_transaction_count                        = 0;
+    size_t pending_transaction_window                       = TF_RCT_POWER_CLIENT_MAX_PENDING_TRANSACTION_COUNT;
     TFRCTPowerClientTransaction *scheduled_transaction_head = nullptr;
     bool wait_for_start                                     = true;
     uint8_t last_received_byte                              = 0;
@@ -79,18 +137,40 @@ private:
     size_t pending_response_used                            = 0;
     uint32_t bootloader_magic_number                        = 0;
     micros_t bootloader_last_detected                       = 0_s;
+    uint8_t receive_buffer[TF_RCT_POWER_CLIENT_RECEIVE_BUFFER_SIZE];
+    size_t receive_buffer_used                              = 0;
+    size_t receive_buffer_offset                            = 0; // bytes before offset are already parsed
+    TFRCTPowerClientSubscription *subscription_head         = nullptr;
+    uint16_t subscription_phase                             = 0;
+    bool unsubscribe_pending                                = false;
+    bool subscription_notifying                             = false;
 };
 
 class TFRCTPowerSharedClient final : public TFGenericTCPSharedClient
 {
 public:
-    TFRCTPowerSharedClient(TFRCTPowerClient *client_) : TFGenericTCPSharedClient(client_), client(client_) {}
+    TFRCTPowerSharedClient(TFRCTPowerClient *client_) : TFGenericTCPSharedClient(client_) {}
+    ~TFRCTPowerSharedClient() { static_cast<TFRCTPowerClient *>(get_primary_client())->unsubscribe_all(this); }
 
     void read(uint32_t id, micros_t timeout, TFRCTPowerClientTransactionCallback &&callback)
     {
-        client->read(id, timeout, std::move(callback));
+        static_cast<TFRCTPowerClient *>(select_client())->read(id, timeout, std::move(callback));
     }
 
-private:
-    TFRCTPowerClient *client;
+    // Subscriptions are kept on the primary connection, so all shared clients
+    // of the same endpoint share their reads. They are removed on release
+    TFRCTPowerClientSubscriber *subscribe(uint32_t id, micros_t period, float deadband, TFRCTPowerClientSubscriptionCallback &&callback)
+    {
+        return static_cast<TFRCTPowerClient *>(get_primary_client())->subscribe(id, period, deadband, std::move(callback), this);
+    }
+
+    bool unsubscribe(TFRCTPowerClientSubscriber *subscriber)
+    {
+        return static_cast<TFRCTPowerClient *>(get_primary_client())->unsubscribe(subscriber);
+    }
+
+    bool get_cached_value(uint32_t id, float *value, micros_t *timestamp) const
+    {
+        return static_cast<TFRCTPowerClient *>(get_primary_client())->get_cached_value(id, value, timestamp);
+    }
 };
@@ -24,7 +24,9 @@
 class TFRCTPowerClientPool : public TFGenericTCPClientPool
 {
 public:
-    TFRCTPowerClientPool() {}
+    TFRCTPowerClientPool(size_t max_slot_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SLOT_COUNT,
+                         size_t max_share_count_ = TF_GENERIC_TCP_CLIENT_POOL_MAX_SHARE_COUNT) :
+        TFGenericTCPClientPool(max_slot_count_, max_share_count_) {}
 
 protected:
     TFGenericTCPClient *create_client() override;
@@ -0,0 +1,109 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "TFRCTPowerCommon.h"
+
+#if TF_RCT_POWER_CRC16_TABLE_COUNT != 0 && TF_RCT_POWER_CRC16_TABLE_COUNT != 1 && TF_RCT_POWER_CRC16_TABLE_COUNT != 4
+#error "TF_RCT_POWER_CRC16_TABLE_COUNT has to be 0, 1 or 4"
+#endif
+
+#if TF_RCT_POWER_CRC16_TABLE_COUNT == 0
+
+uint16_t tf_rct_power_crc16ccitt(const uint8_t *buffer, size_t length)
+{
+    uint32_t checksum = 0xFFFF;
+
+    for (size_t i = 0; i < length; ++i) {
+        for (size_t k = 0; k < 8; ++k) {
+            bool bit = (buffer[i] >> (7 - k) & 1) == 1;
+            bool c15 = ((checksum >> 15) & 1) == 1;
+
+            checksum <<= 1;
+
+            if (c15 ^ bit) {
+                checksum ^= 0x1021;
+            }
+        }
+
+        checksum &= 0xFFFF;
+    }
+
+    return checksum & 0xFFFF;
+}
+
+#else
+
+// The tables are generated at compile time with C++11 constexpr rules, so
+// they end up in flash instead of RAM. Each entry is computed by a recursive
+// single return function and the preprocessor expands the 256 entries
+
+static constexpr uint16_t crc16_shift(uint32_t checksum, size_t bit_count)
+{
+    return bit_count == 0 ? static_cast<uint16_t>(checksum & 0xFFFF)
+                          : crc16_shift((checksum & 0x8000) != 0 ? (checksum << 1) ^ 0x1021 : checksum << 1, bit_count - 1);
+}
+
+// CRC of byte i followed by n zero bytes
+static constexpr uint16_t crc16_entry(size_t n, uint32_t i)
+{
+    return n == 0 ? crc16_shift(i << 8, 8)
+                  : static_cast<uint16_t>((crc16_entry(n - 1, i) << 8) ^ crc16_entry(0, crc16_entry(n - 1, i) >> 8));
+}
+
+#define CRC16_ENTRIES_4(n, i)  crc16_entry(n, i), crc16_entry(n, i + 1), crc16_entry(n, i + 2), crc16_entry(n, i + 3)
+#define CRC16_ENTRIES_16(n, i) CRC16_ENTRIES_4(n, i), CRC16_ENTRIES_4(n, i + 4), CRC16_ENTRIES_4(n, i + 8), CRC16_ENTRIES_4(n, i + 12)
+#define CRC16_ENTRIES_64(n, i) CRC16_ENTRIES_16(n, i), CRC16_ENTRIES_16(n, i + 16), CRC16_ENTRIES_16(n, i + 32), CRC16_ENTRIES_16(n, i + 48)
+#define CRC16_ENTRIES_256(n)   CRC16_ENTRIES_64(n, 0), CRC16_ENTRIES_64(n, 64), CRC16_ENTRIES_64(n, 128), CRC16_ENTRIES_64(n, 192)
+
+static constexpr uint16_t crc16_tables[TF_RCT_POWER_CRC16_TABLE_COUNT][256] = {
+    {CRC16_ENTRIES_256(0)},
+#if TF_RCT_POWER_CRC16_TABLE_COUNT == 4
+    {CRC16_ENTRIES_256(1)},
+    {CRC16_ENTRIES_256(2)},
+    {CRC16_ENTRIES_256(3)},
+#endif
+};
+
+static_assert(crc16_tables[0][1] == 0x1021, "CRC16 table has unexpected content");
+static_assert(crc16_tables[0][255] == 0x1EF0, "CRC16 table has unexpected content");
+
+uint16_t tf_rct_power_crc16ccitt(const uint8_t *buffer, size_t length)
+{
+    uint16_t checksum = 0xFFFF;
+    size_t i = 0;
+
+#if TF_RCT_POWER_CRC16_TABLE_COUNT == 4
+    for (; i + 4 <= length; i += 4) {
+        checksum ^= static_cast<uint16_t>((buffer[i] << 8) | buffer[i + 1]);
+        checksum  = crc16_tables[3][checksum >> 8]
+                  ^ crc16_tables[2][checksum & 0xFF]
+                  ^ crc16_tables[1][buffer[i + 2]]
+                  ^ crc16_tables[0][buffer[i + 3]];
+    }
+#endif
+
+    for (; i < length; ++i) {
+        checksum = static_cast<uint16_t>((checksum << 8) ^ crc16_tables[0][(checksum >> 8) ^ buffer[i]]);
+    }
+
+    return checksum;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// configuration
+
+// Number of 256 entry CRC lookup tables: 0 selects the bit-serial
+// implementation for size optimized builds, 1 a single table (512 bytes) and
+// 4 slicing-by-4 (2048 bytes)
+#ifndef TF_RCT_POWER_CRC16_TABLE_COUNT
+#define TF_RCT_POWER_CRC16_TABLE_COUNT 1
+#endif
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, not reflected
+uint16_t tf_rct_power_crc16ccitt(const uint8_t *buffer, size_t length);
@@ -1,6 +1,25 @@
 #!/bin/sh
 COMPILE="g++ -O2 -ggdb -I . -Wall -Wextra -DTF_NETWORK_DEBUG_LOG=1 -I ../../tftools/src ../../tftools/src/TFTools/Micros.cpp ../src/TFNetwork.cpp"
-$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp test_client.cpp -o test_client
-$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFGenericTCPClientPool.cpp ../src/TFModbusTCPClientPool.cpp test_pool.cpp -o test_pool
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp test_client.cpp -o test_client
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFGenericTCPClientPool.cpp ../src/TFModbusTCPClientPool.cpp test_pool.cpp -o test_pool
 $COMPILE ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp test_server.cpp -o test_server
 $COMPILE ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp test_sun_spec.cpp -o test_sun_spec
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFGenericTCPClientPool.cpp ../src/TFModbusTCPClientPool.cpp ../src/TFModbusTCPServer.cpp test_pool_latency.cpp -o test_pool_latency
+$COMPILE ../src/TFRCTPowerCommon.cpp test_rct_power_crc.cpp -o test_rct_power_crc
+$COMPILE -DTF_RCT_POWER_CRC16_TABLE_COUNT=0 ../src/TFRCTPowerCommon.cpp test_rct_power_crc.cpp -o test_rct_power_crc_bitwise
+$COMPILE -DTF_RCT_POWER_CRC16_TABLE_COUNT=4 ../src/TFRCTPowerCommon.cpp test_rct_power_crc.cpp -o test_rct_power_crc_slicing
+$COMPILE ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPRegisterImage.cpp test_register_image.cpp -o test_register_image
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp ../src/TFModbusTCPRegisterImage.cpp ../src/TFModbusTCPServerRegisterBank.cpp test_register_bank.cpp -o test_register_bank
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp ../src/TFModbusTCPThreadedServer.cpp test_threaded_server.cpp -o test_threaded_server
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp ../src/TFModbusTCPPollScheduler.cpp test_poll_scheduler.cpp -o test_poll_scheduler
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp test_schema.cpp -o test_schema
+$COMPILE ../src/TFModbusTCPChangeDetector.cpp test_change_detector.cpp -o test_change_detector
+$COMPILE ../src/TFModbusTCPFleetStore.cpp test_fleet_store.cpp -o test_fleet_store
+$COMPILE ../src/TFModbusTCPRecorder.cpp test_recorder.cpp -o test_recorder
+$COMPILE -fsanitize=thread ../src/TFGenericTCPSubmitQueue.cpp test_submit_queue.cpp -o test_submit_queue
+$COMPILE -DTF_GENERIC_TCP_SHARDED_CLIENT_POOL_MAX_WAIT_DURATION=1_s ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFGenericTCPClientPool.cpp ../src/TFModbusTCPClientPool.cpp ../src/TFGenericTCPShardedClientPool.cpp ../src/TFModbusTCPServer.cpp test_sharded_client_pool.cpp -o test_sharded_client_pool
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp test_server_address_ranges.cpp -o test_server_address_ranges
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp ../src/TFModbusTCPServer.cpp test_client_scheduling.cpp -o test_client_scheduling
+$COMPILE -DTF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD=3 -DTF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_PROBE_INTERVAL=300_ms ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp test_circuit_breaker.cpp -o test_circuit_breaker
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFRCTPowerClient.cpp ../src/TFRCTPowerCommon.cpp test_rct_power_client.cpp -o test_rct_power_client
+$COMPILE ../src/TFGenericTCPClient.cpp ../src/TFGenericTCPSubmitQueue.cpp ../src/TFModbusTCPClient.cpp ../src/TFModbusTCPCommon.cpp test_prepared_transaction.cpp -o test_prepared_transaction
@@ -0,0 +1,153 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <TFTools/Micros.h>
+#include "../src/TFModbusTCPChangeDetector.h"
+
+#define REGISTER_COUNT 70
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+struct Range
+{
+    uint16_t start_address;
+    uint16_t data_count;
+};
+
+static int failure_count = 0;
+static uint16_t values[REGISTER_COUNT];
+static Range ranges[REGISTER_COUNT];
+static size_t range_count;
+
+static size_t update(TFModbusTCPChangeDetector *detector)
+{
+    range_count = 0;
+
+    return detector->update(values,
+    [](uint16_t start_address, uint16_t data_count, const uint16_t *range_values) {
+        // The callback gets the new values of the range
+        check(memcmp(range_values, &values[start_address - 100], data_count * sizeof(uint16_t)) == 0);
+
+        ranges[range_count].start_address = start_address;
+        ranges[range_count].data_count    = data_count;
+        ++range_count;
+    });
+}
+
+static bool has_range(size_t index, uint16_t start_address, uint16_t data_count)
+{
+    return index < range_count && ranges[index].start_address == start_address && ranges[index].data_count == data_count;
+}
+
+int main()
+{
+    TFModbusTCPChangeDetector detector;
+
+    check(!detector.begin(100, 0));
+    check(detector.begin(100, REGISTER_COUNT, 1));
+
+    // The first update reports the whole range
+    check(update(&detector) == 1);
+    check(has_range(0, 100, REGISTER_COUNT));
+    check(detector.get_changed_count() == REGISTER_COUNT);
+    check(detector.get_changed_bitmap()[0] == 0xFFFFFFFF);
+    check(detector.get_changed_bitmap()[1] == 0xFFFFFFFF);
+    check(detector.get_changed_bitmap()[2] == 0x3F);
+
+    check(update(&detector) == 0);
+    check(range_count == 0);
+    check(detector.get_changed_count() == 0);
+
+    // 100 and 102 are one unchanged register apart and merged with max_gap 1,
+    // 110, 133 and the last register are separate ranges
+    values[0]  = 1;
+    values[2]  = 1;
+    values[10] = 1;
+    values[33] = 1;
+    values[69] = 5;
+
+    check(update(&detector) == 4);
+    check(has_range(0, 100, 3));
+    check(has_range(1, 110, 1));
+    check(has_range(2, 133, 1));
+    check(has_range(3, 169, 1));
+    check(detector.get_changed_count() == 5);
+    check(detector.get_changed_bitmap()[0] == ((1u << 0) | (1u << 2) | (1u << 10)));
+    check(detector.get_changed_bitmap()[1] == (1u << 1));
+    check(detector.get_changed_bitmap()[2] == (1u << 5));
+
+    // Two unchanged registers in between exceed max_gap
+    values[20] = 2;
+    values[23] = 2;
+
+    check(update(&detector) == 2);
+    check(has_range(0, 120, 1));
+    check(has_range(1, 123, 1));
+
+    // After reset() the whole range is reported again
+    detector.reset();
+
+    check(update(&detector) == 1);
+    check(has_range(0, 100, REGISTER_COUNT));
+
+    detector.end();
+
+    // Without gap every changed register is its own range
+    check(detector.begin(0, 4));
+
+    values[0] = 0;
+    values[1] = 0;
+    values[2] = 0;
+    values[3] = 0;
+
+    check(detector.update(values) == 1);
+
+    values[1] = 1;
+    values[3] = 1;
+
+    check(detector.update(values) == 2);
+    check(detector.get_changed_bitmap()[0] == 0xA);
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
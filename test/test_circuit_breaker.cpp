@@ -0,0 +1,299 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPClient.h"
+
+// Build with -DTF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD=3 and
+// -DTF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_PROBE_INTERVAL=300_ms
+#if TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD != 3
+#error "test_circuit_breaker requires TF_MODBUS_TCP_CLIENT_CIRCUIT_BREAKER_THRESHOLD=3"
+#endif
+
+#define PORT 1512
+#define TIMEOUT 50_ms
+#define PROBE_WAIT_US 350000 // a bit longer than the probe interval
+#define REQUEST_LENGTH 12
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static TFModbusTCPClient *client;
+static char results[64];
+static size_t result_count = 0;
+static size_t done_count = 0;
+
+static void read()
+{
+    static uint16_t buffer[1];
+    size_t index = result_count++;
+
+    results[index] = '?';
+    results[index + 1] = '\0';
+
+    client->transact(1, TFModbusTCPFunctionCode::ReadHoldingRegisters, 0, 1, buffer, TIMEOUT,
+    [index](TFModbusTCPClientTransactionResult result, const char *error_message) {
+        (void)error_message;
+
+        switch (result) {
+        case TFModbusTCPClientTransactionResult::Success:            results[index] = 'S'; break;
+        case TFModbusTCPClientTransactionResult::Timeout:            results[index] = 'T'; break;
+        case TFModbusTCPClientTransactionResult::CircuitBreakerOpen: results[index] = 'B'; break;
+        default:                                                     results[index] = '?'; break;
+        }
+
+        ++done_count;
+    });
+}
+
+static void reset()
+{
+    results[0] = '\0';
+    result_count = 0;
+    done_count = 0;
+}
+
+static void run()
+{
+    while (done_count < result_count) {
+        client->tick();
+        usleep(100);
+    }
+}
+
+static TFModbusTCPClientCircuitBreakerState get_state()
+{
+    return client->get_circuit_breaker_state();
+}
+
+// Drops all requests the silent server received so far
+static void drop_requests(int peer_fd)
+{
+    uint8_t request[REQUEST_LENGTH * 16];
+
+    while (recv(peer_fd, request, sizeof(request), MSG_DONTWAIT) > 0) {
+    }
+}
+
+// Answers the next request with a one register response
+static void answer_request(int peer_fd)
+{
+    uint8_t request[REQUEST_LENGTH];
+    size_t used = 0;
+
+    while (used < sizeof(request)) {
+        client->tick();
+
+        ssize_t length = recv(peer_fd, request + used, sizeof(request) - used, MSG_DONTWAIT);
+
+        if (length > 0) {
+            used += static_cast<size_t>(length);
+        }
+
+        usleep(100);
+    }
+
+    uint8_t response[11] = {request[0], request[1], 0, 0, 0, 5, request[6], 3, 2, 0x12, 0x34};
+
+    check(send(peer_fd, response, sizeof(response), 0) == sizeof(response));
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    // A server that accepts the connection, but only answers on request
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    struct sockaddr_in addr_in;
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr_in, 0, sizeof(addr_in));
+    addr_in.sin_family      = AF_INET;
+    addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_in.sin_port        = htons(PORT);
+
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr_in), sizeof(addr_in)) < 0 || listen(listen_fd, 1) < 0) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    TFModbusTCPClient modbus_client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client = &modbus_client;
+
+    client->connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client->tick();
+        usleep(100);
+    }
+
+    int peer_fd = accept(listen_fd, nullptr, nullptr);
+
+    check(peer_fd >= 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Closed);
+
+    // Closed -> Open: the third consecutive timeout opens the circuit breaker
+    // and fails the seven transactions still queued behind it
+    reset();
+
+    for (int i = 0; i < 10; ++i) {
+        read();
+    }
+
+    run();
+    check(strcmp(results, "TTTBBBBBBB") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Open);
+
+    // Open: new transactions fail until the probe interval elapsed
+    reset();
+    read();
+    run();
+    check(strcmp(results, "B") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Open);
+
+    // Open -> HalfOpen: the first transaction after the probe interval is the
+    // probe, further transactions fail while it is pending
+    usleep(PROBE_WAIT_US);
+    drop_requests(peer_fd);
+    reset();
+    read();
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::HalfOpen);
+    read();
+    check(strcmp(results, "?B") == 0);
+
+    // HalfOpen -> Closed: the probe gets a response
+    answer_request(peer_fd);
+    run();
+    check(strcmp(results, "SB") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Closed);
+
+    // Closed again: the timeout count starts over
+    reset();
+    read();
+    read();
+    run();
+    check(strcmp(results, "TT") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Closed);
+
+    reset();
+    read();
+    run();
+    check(strcmp(results, "T") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Open);
+
+    // HalfOpen -> Open: a probe that times out opens the circuit breaker
+    // again for another probe interval
+    usleep(PROBE_WAIT_US);
+    reset();
+    read();
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::HalfOpen);
+    run();
+    check(strcmp(results, "T") == 0);
+    check(get_state() == TFModbusTCPClientCircuitBreakerState::Open);
+
+    reset();
+    read();
+    run();
+    check(strcmp(results, "B") == 0);
+
+    client->disconnect();
+    close(peer_fd);
+    close(listen_fd);
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
@@ -79,6 +79,8 @@ int main()
 
     uint16_t read_register_buffer[2] = {0, 0};
     uint16_t write_register_buffer;
+    uint16_t read_write_read_buffer[2] = {0, 0};
+    uint16_t read_write_write_buffer[2];
     uint8_t read_coil_buffer[2] = {0, 0};
     uint8_t write_coil_buffer;
     char *resolve_host = nullptr;
@@ -194,6 +196,21 @@ int main()
                                   error_message != nullptr ? error_message : "");
             });
 
+            read_write_write_buffer[0] = 1234;
+            read_write_write_buffer[1] = 4321;
+
+            TFNetwork::logfln("read/write registers...");
+            client.transact(1, TFModbusTCPFunctionCode::ReadWriteMultipleRegisters, 3344, 2, read_write_read_buffer, 5566, 2, read_write_write_buffer, 1_s,
+            [&read_write_read_buffer](TFModbusTCPClientTransactionResult result, const char *error_message) {
+                TFNetwork::logfln("read/write registers: %s (%d)%s%s [%u %u]",
+                                  get_tf_modbus_tcp_client_transaction_result_name(result),
+                                  static_cast<int>(result),
+                                  error_message != nullptr ? " / " : "",
+                                  error_message != nullptr ? error_message : "",
+                                  read_write_read_buffer[0],
+                                  read_write_read_buffer[1]);
+            });
+
             write_coil_buffer = 1;
 
             TFNetwork::logfln("write coil...");
@@ -0,0 +1,255 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPServer.h"
+#include "../src/TFModbusTCPClient.h"
+
+#define PORT 1511
+#define MAX_ORDER_LENGTH 64
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// The server records the start address of each request in the order it was
+// received. The client only sends one request at a time, so that is the order
+// in which the client dequeued the transactions
+static char order[MAX_ORDER_LENGTH + 1];
+static size_t order_length = 0;
+static size_t done_count = 0;
+
+static void transact(TFModbusTCPSharedClient *shared_client, char name, std::function<void(void)> &&done = nullptr)
+{
+    static uint16_t buffer[1];
+
+    shared_client->transact(1, TFModbusTCPFunctionCode::ReadHoldingRegisters, static_cast<uint16_t>(name), 1, buffer, 1_s,
+    [done](TFModbusTCPClientTransactionResult result, const char *error_message) {
+        (void)error_message;
+
+        check(result == TFModbusTCPClientTransactionResult::Success);
+        ++done_count;
+
+        if (done) {
+            done();
+        }
+    });
+}
+
+static void run(TFModbusTCPClient *client, TFModbusTCPServer *server, size_t count)
+{
+    while (done_count < count) {
+        client->tick();
+        server->tick();
+        usleep(100);
+    }
+}
+
+static void reset()
+{
+    order[0] = '\0';
+    order_length = 0;
+    done_count = 0;
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        (void)peer_address;
+        (void)port;
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        (void)peer_address;
+        (void)port;
+        (void)reason;
+        (void)error_number;
+    },
+    [](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        (void)unit_id;
+        (void)function_code;
+
+        memset(data_values, 0, data_count * 2);
+
+        if (order_length < MAX_ORDER_LENGTH) {
+            order[order_length++] = static_cast<char>(start_address);
+            order[order_length] = '\0';
+        }
+
+        return TFModbusTCPExceptionCode::Success;
+    })) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client.connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    TFModbusTCPSharedClient a(&client);
+    TFModbusTCPSharedClient b(&client);
+
+    a.set_weight(1);
+    b.set_weight(3);
+
+    // Queued before the first tick, so nothing is sent before both queues are
+    // complete. The queue of a is served first, because it was created first
+    reset();
+
+    for (int i = 0; i < 4; ++i) {
+        transact(&a, 'a');
+    }
+
+    for (int i = 0; i < 12; ++i) {
+        transact(&b, 'b');
+    }
+
+    run(&client, &server, 16);
+    check(strcmp(order, "abbbabbbabbbabbb") == 0);
+    printf("weights 1:3 order %s\n", order);
+
+    // The queue of b runs empty after one of its three transactions and is
+    // removed. Refilled from the completion callback, it is appended as the
+    // last queue of the round and starts over with a full deficit of three
+    // instead of spending the two left over
+    reset();
+
+    for (int i = 0; i < 3; ++i) {
+        transact(&a, 'a');
+    }
+
+    transact(&b, 'b', [&b]() {
+        for (int i = 0; i < 6; ++i) {
+            transact(&b, 'B');
+        }
+    });
+
+    run(&client, &server, 10);
+    check(strcmp(order, "abBBBaBBBa") == 0);
+    printf("refilled queue order %s\n", order);
+
+    // A queue that is added after the last queue of the round spent its
+    // deficit is served next, before the round wraps around to the head
+    reset();
+
+    for (int i = 0; i < 2; ++i) {
+        transact(&b, 'b');
+    }
+
+    transact(&b, 'b', [&a]() {
+        transact(&a, 'a');
+        transact(&a, 'a');
+    });
+
+    for (int i = 0; i < 3; ++i) {
+        transact(&b, 'B');
+    }
+
+    run(&client, &server, 8);
+    check(strcmp(order, "bbbaBBBa") == 0);
+    printf("joined queue order %s\n", order);
+
+    client.disconnect();
+    server.stop();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <TFTools/Micros.h>
+#include "../src/TFModbusTCPFleetStore.h"
+
+#define DEVICE_COUNT 500
+#define LARGE_DEVICE_COUNT 100000
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static void to_registers(uint32_t value, uint16_t *registers)
+{
+    registers[0] = static_cast<uint16_t>(value >> 16);
+    registers[1] = static_cast<uint16_t>(value & 0xFFFF);
+}
+
+static void test_aggregates()
+{
+    TFModbusTCPFleetStore store(DEVICE_COUNT);
+    ssize_t power = store.add_column(TFModbusTCPSchemaType::Float32);
+    ssize_t energy = store.add_column(TFModbusTCPSchemaType::Int32, 0.1f);
+
+    check(power == 0);
+    check(energy == 1);
+
+    // Power is the device index, energy is -device index for every other device
+    for (size_t device = 0; device < DEVICE_COUNT; ++device) {
+        float value = static_cast<float>(device);
+        uint32_t u32;
+        uint16_t registers[2];
+
+        memcpy(&u32, &value, sizeof(u32));
+        to_registers(u32, registers);
+        check(store.set_registers(device, power, registers));
+
+        if (device % 2 == 0) {
+            to_registers(static_cast<uint32_t>(-static_cast<int32_t>(device) * 10), registers);
+            check(store.set_registers(device, energy, registers));
+        }
+    }
+
+    check(store.get_valid_count(power) == DEVICE_COUNT);
+    check(store.get_sum(power) == 124750.0f);
+
+    // Invalid entries are not part of the aggregates
+    store.invalidate(499, power);
+
+    check(!store.is_valid(499, power));
+    check(store.get_valid_count(power) == DEVICE_COUNT - 1);
+    check(store.get_sum(power) == 124251.0f);
+    check(store.get_average(power) == 124251.0f / (DEVICE_COUNT - 1));
+
+    float min;
+    float max;
+
+    check(store.get_valid_count(energy) == DEVICE_COUNT / 2);
+    check(store.get_min(energy, &min));
+    check(store.get_max(energy, &max));
+    check(fabsf(min + 498.0f) < 0.01f);
+    check(fabsf(max) < 0.01f);
+    check(fabsf(store.get_average(energy) + 249.0f) < 0.01f);
+
+    // A snapshot doesn't follow later changes
+    TFModbusTCPFleetSnapshot snapshot;
+
+    check(store.take_snapshot(&snapshot));
+
+    store.set(0, power, 1000.0f);
+
+    check(snapshot.get_device_count() == DEVICE_COUNT);
+    check(snapshot.get_column(power)[0] == 0.0f);
+    check(snapshot.get_sum(power) == 124251.0f);
+
+    // NaN invalidates the entry
+    store.set(1, power, NAN);
+
+    check(!store.is_valid(1, power));
+
+    // Adding a column keeps the existing ones, a column without valid entries
+    // has no average, minimum or maximum
+    ssize_t status = store.add_column(TFModbusTCPSchemaType::Uint16);
+
+    check(status == 2);
+    check(store.get_column(power)[0] == 1000.0f);
+    check(isnan(store.get_average(status)));
+    check(!store.get_min(status, &min));
+    check(!store.get_max(status, &max));
+}
+
+// A single float accumulator is off by about 0.03% here
+static void test_sum_precision()
+{
+    TFModbusTCPFleetStore store(LARGE_DEVICE_COUNT);
+    ssize_t power = store.add_column(TFModbusTCPSchemaType::Float32);
+    double expected = 0.0;
+
+    for (size_t device = 0; device < LARGE_DEVICE_COUNT; ++device) {
+        float value = 1000.0f + static_cast<float>(device % 7) * 0.1f;
+
+        store.set(device, power, value);
+        expected += value;
+    }
+
+    double relative_error = fabs(store.get_sum(power) - expected) / expected;
+
+    printf("sum of %d values: relative error %g\n", LARGE_DEVICE_COUNT, relative_error);
+
+    check(relative_error < 1e-6);
+}
+
+int main()
+{
+    test_aggregates();
+    test_sum_precision();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPServer.h"
+#include "../src/TFModbusTCPClient.h"
+#include "../src/TFModbusTCPPollScheduler.h"
+
+#define PORT 1503
+#define TIMEOUT_UNIT_ID 3
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static bool is_bit_set(const uint8_t *bits, size_t index)
+{
+    return (bits[index / 8] & (1u << (index % 8))) != 0;
+}
+
+static void connect_client(TFModbusTCPClient *client, TFModbusTCPServer *server)
+{
+    bool connected = false;
+
+    client->connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client->tick();
+        server->tick();
+        usleep(100);
+    }
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+    uint32_t request_count = 0;
+
+    // Registers read as unit ID * 1000 + address, every third bit is set
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        (void)peer_address;
+        (void)port;
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        (void)peer_address;
+        (void)port;
+        (void)reason;
+        (void)error_number;
+    },
+    [&request_count](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        if (unit_id == TIMEOUT_UNIT_ID) {
+            return TFModbusTCPExceptionCode::ForceTimeout;
+        }
+
+        ++request_count;
+
+        if (function_code == TFModbusTCPFunctionCode::ReadCoils) {
+            uint8_t *bits = static_cast<uint8_t *>(data_values);
+
+            memset(bits, 0, (data_count + 7u) / 8u);
+
+            for (uint16_t i = 0; i < data_count; ++i) {
+                if ((start_address + i) % 3 == 0) {
+                    bits[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+                }
+            }
+        }
+        else {
+            for (uint16_t i = 0; i < data_count; ++i) {
+                static_cast<uint16_t *>(data_values)[i] = unit_id * 1000 + start_address + i;
+            }
+        }
+
+        return TFModbusTCPExceptionCode::Success;
+    })) {
+        TFNetwork::logfln("server start failed: %s (%d)", strerror(errno), errno);
+        return 1;
+    }
+
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    TFModbusTCPClient timeout_client(TFModbusTCPByteOrder::Host);
+
+    connect_client(&client, &server);
+    connect_client(&timeout_client, &server);
+
+    TFModbusTCPPollScheduler scheduler(&client);
+    uint16_t registers_100[10] = {};
+    uint16_t registers_110[5]  = {};
+    uint16_t registers_200[5]  = {};
+    uint16_t input_registers[4] = {};
+    uint8_t coils_3[2]         = {};
+    uint8_t coils_13[1]        = {};
+    uint32_t callback_count    = 0;
+
+    // Adjacent entries of the same unit, table and period are merged: 100-109
+    // and 110-114 form one block, 200-204 another, coils 3-12 and 13-17 a third
+    // and the input registers with a different unit and period the fourth
+    check(scheduler.add(1, TFModbusTCPTable::HoldingRegisters, 100, 10, 100_ms, registers_100,
+    [&callback_count](TFModbusTCPClientTransactionResult result) {
+        if (result == TFModbusTCPClientTransactionResult::Success) {
+            ++callback_count;
+        }
+    }));
+    check(scheduler.add(1, TFModbusTCPTable::HoldingRegisters, 110, 5, 100_ms, registers_110));
+    check(scheduler.add(1, TFModbusTCPTable::HoldingRegisters, 200, 5, 100_ms, registers_200));
+    check(scheduler.add(1, TFModbusTCPTable::Coils, 3, 10, 100_ms, coils_3));
+    check(scheduler.add(1, TFModbusTCPTable::Coils, 13, 5, 100_ms, coils_13));
+    check(scheduler.add(2, TFModbusTCPTable::InputRegisters, 0, 4, 50_ms, input_registers));
+    check(!scheduler.add(1, TFModbusTCPTable::HoldingRegisters, 0, TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT + 1, 100_ms, registers_100));
+    check(scheduler.start());
+    check(!scheduler.add(1, TFModbusTCPTable::HoldingRegisters, 0, 1, 100_ms, registers_100));
+    check(scheduler.get_block_count() == 4);
+
+    // Reads to this unit never get a response, so they overrun and are still
+    // in flight when the scheduler is stopped
+    TFModbusTCPPollScheduler timeout_scheduler(&timeout_client);
+    uint16_t timeout_registers[1];
+
+    check(timeout_scheduler.add(TIMEOUT_UNIT_ID, TFModbusTCPTable::HoldingRegisters, 0, 1, 30_ms, timeout_registers));
+    check(timeout_scheduler.start());
+
+    micros_t deadline = calculate_deadline(1_s);
+
+    while (!deadline_elapsed(deadline)) {
+        scheduler.tick();
+        timeout_scheduler.tick();
+        client.tick();
+        timeout_client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    // Three blocks every 100 ms and one every 50 ms
+    printf("requests %u, callbacks %u, overruns %u / %u\n", request_count, callback_count,
+           scheduler.get_overrun_count(), timeout_scheduler.get_overrun_count());
+
+    check(request_count >= 45 && request_count <= 55);
+    check(callback_count >= 9 && callback_count <= 11);
+    check(scheduler.get_overrun_count() == 0);
+    check(timeout_scheduler.get_overrun_count() > 0);
+
+    for (uint16_t i = 0; i < 10; ++i) {
+        check(registers_100[i] == 1100 + i);
+    }
+
+    for (uint16_t i = 0; i < 5; ++i) {
+        check(registers_110[i] == 1110 + i);
+        check(registers_200[i] == 1200 + i);
+    }
+
+    for (uint16_t i = 0; i < 4; ++i) {
+        check(input_registers[i] == 2000 + i);
+    }
+
+    for (size_t i = 0; i < 10; ++i) {
+        check(is_bit_set(coils_3, i) == ((3 + i) % 3 == 0));
+    }
+
+    for (size_t i = 0; i < 5; ++i) {
+        check(is_bit_set(coils_13, i) == ((13 + i) % 3 == 0));
+    }
+
+    // Bits past the end of an entry are cleared
+    check((coils_3[1] >> 2) == 0);
+    check((coils_13[0] >> 5) == 0);
+
+    // The plan has to outlive the stopped scheduler until the read in flight
+    // timed out, because the client still writes to the block buffer
+    timeout_scheduler.stop();
+    check(!timeout_scheduler.is_running());
+
+    deadline = calculate_deadline(200_ms);
+
+    while (!deadline_elapsed(deadline)) {
+        timeout_client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    scheduler.stop();
+    client.disconnect();
+    timeout_client.disconnect();
+    server.stop();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
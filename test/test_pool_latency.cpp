@@ -0,0 +1,241 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPClient.h"
+#include "../src/TFModbusTCPClientPool.h"
+#include "../src/TFModbusTCPServer.h"
+
+#define PORT 1502
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+static TFModbusTCPClientPool pool(TFModbusTCPByteOrder::Host);
+
+static void tick_until(const bool *done)
+{
+    micros_t deadline = calculate_deadline(5_s);
+
+    while (!*done && !deadline_elapsed(deadline)) {
+        pool.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    if (!*done) {
+        TFNetwork::logfln("timeout");
+        exit(1);
+    }
+}
+
+static void tick_for(micros_t duration)
+{
+    micros_t deadline = calculate_deadline(duration);
+
+    while (!deadline_elapsed(deadline)) {
+        pool.tick();
+        server.tick();
+        usleep(100);
+    }
+}
+
+// Acquires a share, does one read and reports how long it took to get connected
+static TFGenericTCPSharedClient *measure_acquire(const char *label, const char *host)
+{
+    TFGenericTCPSharedClient *shared_client = nullptr;
+    micros_t connect_duration = 0_s;
+    bool done = false;
+    uint16_t buffer[2] = {0, 0};
+    micros_t start = now_us();
+
+    pool.acquire(host, PORT,
+    [&shared_client, &connect_duration, &done, &buffer, start](TFGenericTCPClientConnectResult result, int error_number, TFGenericTCPSharedClient *client, TFGenericTCPClientPoolShareLevel level) {
+        connect_duration = now_us() - start;
+
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        TFNetwork::logfln("connected level=%s", get_tf_generic_tcp_client_pool_share_level_name(level));
+
+        shared_client = client;
+
+        static_cast<TFModbusTCPSharedClient *>(client)->transact(1, TFModbusTCPFunctionCode::ReadHoldingRegisters, 1000, 2, buffer, 1_s,
+        [&done](TFModbusTCPClientTransactionResult result, const char *error_message) {
+            if (result != TFModbusTCPClientTransactionResult::Success) {
+                TFNetwork::logfln("read failed: %s%s%s",
+                                  get_tf_modbus_tcp_client_transaction_result_name(result),
+                                  error_message != nullptr ? " / " : "",
+                                  error_message != nullptr ? error_message : "");
+                exit(1);
+            }
+
+            done = true;
+        });
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number, TFGenericTCPSharedClient *client, TFGenericTCPClientPoolShareLevel level) {
+        TFNetwork::logfln("disconnected client=%p level=%s: %s / %s (%d)",
+                          static_cast<void *>(client),
+                          get_tf_generic_tcp_client_pool_share_level_name(level),
+                          get_tf_generic_tcp_client_disconnect_reason_name(reason),
+                          strerror(error_number),
+                          error_number);
+    });
+
+    tick_until(&done);
+
+    TFNetwork::logfln("%-28s acquire latency %6lli us, first read after %6lli us",
+                      label,
+                      static_cast<long long>(static_cast<int64_t>(connect_duration)),
+                      static_cast<long long>(static_cast<int64_t>(now_us() - start)));
+
+    return shared_client;
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        printf("%li | ", static_cast<int64_t>(now_us()));
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        hostent *result = gethostbyname(host);
+
+        if (result == nullptr) {
+            callback(0, h_errno);
+        }
+        else {
+            callback(((struct in_addr *)result->h_addr)->s_addr, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        char peer_address_str[TF_NETWORK_IPV4_NTOA_BUFFER_LENGTH];
+        TFNetwork::ipv4_ntoa(peer_address_str, sizeof(peer_address_str), peer_address);
+        TFNetwork::logfln("server: connected peer_address=%s port=%u", peer_address_str, port);
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        char peer_address_str[TF_NETWORK_IPV4_NTOA_BUFFER_LENGTH];
+        TFNetwork::ipv4_ntoa(peer_address_str, sizeof(peer_address_str), peer_address);
+        TFNetwork::logfln("server: disconnected peer_address=%s port=%u reason=%s error_number=%d",
+                          peer_address_str, port,
+                          get_tf_modbus_tcp_server_client_disconnect_reason_name(reason),
+                          error_number);
+    },
+    [](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        (void)unit_id;
+        (void)function_code;
+
+        for (uint16_t i = 0; i < data_count; ++i) {
+            static_cast<uint16_t *>(data_values)[i] = start_address + i;
+        }
+
+        return TFModbusTCPExceptionCode::Success;
+    })) {
+        TFNetwork::logfln("server start failed: %s (%d)", strerror(errno), errno);
+        return 1;
+    }
+
+    TFGenericTCPSharedClient *shared_client;
+
+    // without linger every acquire after the last release connects again
+    shared_client = measure_acquire("cold", "localhost");
+    pool.release(shared_client);
+    tick_for(100_ms);
+
+    shared_client = measure_acquire("reacquire without linger", "localhost");
+    pool.release(shared_client);
+    tick_for(100_ms);
+
+    // with linger the connection survives the release
+    pool.set_linger_duration(10_s);
+
+    shared_client = measure_acquire("cold with linger", "localhost");
+    pool.release(shared_client);
+    tick_for(100_ms);
+
+    shared_client = measure_acquire("reacquire with linger", "localhost");
+    pool.release(shared_client, true); // forced release does not linger
+    tick_for(100_ms);
+
+    // prewarm connects ahead of the first acquire
+    bool prewarmed = false;
+
+    pool.prewarm("127.0.0.1", PORT, 10_s,
+    [&prewarmed](TFGenericTCPClientConnectResult result, int error_number) {
+        TFNetwork::logfln("prewarm: %s / %s (%d)",
+                          get_tf_generic_tcp_client_connect_result_name(result),
+                          strerror(error_number),
+                          error_number);
+
+        prewarmed = true;
+    });
+
+    tick_until(&prewarmed);
+
+    shared_client = measure_acquire("acquire after prewarm", "127.0.0.1");
+    pool.release(shared_client, true);
+    tick_for(100_ms);
+
+    server.stop();
+
+    return 0;
+}
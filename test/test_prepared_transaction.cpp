@@ -0,0 +1,348 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPClient.h"
+
+#define PORT 1514
+#define REQUEST_LENGTH 12
+#define READ_COUNT 5
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// The test acts as the server on the accepted peer socket, so it sees the
+// transaction IDs and can send malformed responses
+static TFModbusTCPClient *client;
+static int peer_fd = -1;
+
+struct Transaction
+{
+    bool done;
+    TFModbusTCPClientTransactionResult result;
+};
+
+static void transact(const TFModbusTCPClientPreparedTransaction *prepared, void *buffer, Transaction *transaction)
+{
+    transaction->done = false;
+
+    client->transact(prepared, buffer, 1_s,
+    [transaction](TFModbusTCPClientTransactionResult result, const char *error_message) {
+        (void)error_message;
+
+        transaction->done   = true;
+        transaction->result = result;
+    });
+}
+
+static void run(const Transaction *transaction)
+{
+    micros_t deadline = now_us() + 1_s;
+
+    while (!transaction->done && now_us() < deadline) {
+        client->tick();
+        usleep(100);
+    }
+
+    check(transaction->done);
+}
+
+static bool receive_request(uint8_t *request)
+{
+    size_t used = 0;
+    micros_t deadline = now_us() + 1_s;
+
+    while (used < REQUEST_LENGTH && now_us() < deadline) {
+        client->tick();
+
+        ssize_t length = recv(peer_fd, request + used, REQUEST_LENGTH - used, MSG_DONTWAIT);
+
+        if (length > 0) {
+            used += static_cast<size_t>(length);
+        }
+
+        usleep(100);
+    }
+
+    return used == REQUEST_LENGTH;
+}
+
+static void send_response(const uint8_t *request, uint8_t byte_count, const uint8_t *data, size_t data_length)
+{
+    uint8_t response[7 + 2 + 256];
+    size_t frame_length = 1 + 2 + data_length; // unit ID, function code, byte count, data
+
+    response[0] = request[0];
+    response[1] = request[1];
+    response[2] = 0;
+    response[3] = 0;
+    response[4] = static_cast<uint8_t>(frame_length >> 8);
+    response[5] = static_cast<uint8_t>(frame_length);
+    response[6] = request[6];
+    response[7] = request[7];
+    response[8] = byte_count;
+
+    memcpy(response + 9, data, data_length);
+
+    ssize_t length = static_cast<ssize_t>(9 + data_length);
+
+    check(send(peer_fd, response, static_cast<size_t>(length), 0) == length);
+}
+
+static void test_prepare_arguments()
+{
+    TFModbusTCPClientPreparedTransaction prepared;
+
+    check(!TFModbusTCPClient::prepare_transaction(nullptr, 1, TFModbusTCPFunctionCode::ReadHoldingRegisters, 0, 1));
+
+    // Only reads can be prepared
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::WriteSingleCoil, 0, 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::WriteSingleRegister, 0, 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::WriteMultipleCoils, 0, 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::WriteMultipleRegisters, 0, 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::MaskWriteRegister, 0, 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadWriteMultipleRegisters, 0, 1));
+
+    // Counts outside the range of the function code
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadCoils, 0, 0));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadDiscreteInputs, 0, TF_MODBUS_TCP_MAX_READ_COIL_COUNT + 1));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadHoldingRegisters, 0, 0));
+    check(!TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadInputRegisters, 0, TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT + 1));
+
+    check(TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadDiscreteInputs, 0, TF_MODBUS_TCP_MAX_READ_COIL_COUNT));
+    check(prepared.expected_byte_count == TF_MODBUS_TCP_MAX_READ_COIL_BYTE_COUNT);
+    check(TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadInputRegisters, 0, TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT));
+    check(prepared.expected_byte_count == TF_MODBUS_TCP_MAX_READ_REGISTER_COUNT * 2);
+}
+
+static void test_prepared_register_reads()
+{
+    TFModbusTCPClientPreparedTransaction prepared;
+    const uint8_t expected_frame[REQUEST_LENGTH] = {0, 0, 0, 0, 0, 6, 7, 3, 0x12, 0x34, 0, 2};
+    uint16_t previous_transaction_id = 0;
+
+    check(TFModbusTCPClient::prepare_transaction(&prepared, 7, TFModbusTCPFunctionCode::ReadHoldingRegisters, 0x1234, 2));
+    check(memcmp(prepared.frame + 2, expected_frame + 2, REQUEST_LENGTH - 2) == 0);
+
+    // The same prepared transaction is sent repeatedly, each time with the next
+    // transaction ID patched in
+    for (int i = 0; i < READ_COUNT; ++i) {
+        uint16_t buffer[2] = {0, 0};
+        uint8_t request[REQUEST_LENGTH];
+        Transaction transaction;
+
+        transact(&prepared, buffer, &transaction);
+        check(receive_request(request));
+        check(memcmp(request + 2, expected_frame + 2, REQUEST_LENGTH - 2) == 0);
+
+        uint16_t transaction_id = static_cast<uint16_t>((request[0] << 8) | request[1]);
+
+        if (i > 0) {
+            check(transaction_id == static_cast<uint16_t>(previous_transaction_id + 1));
+        }
+
+        previous_transaction_id = transaction_id;
+
+        const uint8_t data[4] = {0xAB, static_cast<uint8_t>(i), 0xCD, static_cast<uint8_t>(i + 1)};
+
+        send_response(request, sizeof(data), data, sizeof(data));
+        run(&transaction);
+        check(transaction.result == TFModbusTCPClientTransactionResult::Success);
+        check(buffer[0] == (0xAB00 | i));
+        check(buffer[1] == (0xCD00 | (i + 1)));
+    }
+}
+
+static void test_prepared_coil_read()
+{
+    TFModbusTCPClientPreparedTransaction prepared;
+    uint8_t buffer[2] = {0, 0};
+    uint8_t request[REQUEST_LENGTH];
+    Transaction transaction;
+
+    check(TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadCoils, 0, 10));
+    transact(&prepared, buffer, &transaction);
+    check(receive_request(request));
+    check(request[7] == 1);
+
+    // Bits beyond the 10th coil are cleared
+    const uint8_t data[2] = {0xA5, 0xFF};
+
+    send_response(request, sizeof(data), data, sizeof(data));
+    run(&transaction);
+    check(transaction.result == TFModbusTCPClientTransactionResult::Success);
+    check(buffer[0] == 0xA5);
+    check(buffer[1] == 0x03);
+}
+
+static void test_prepared_byte_count_mismatch()
+{
+    TFModbusTCPClientPreparedTransaction prepared;
+    uint16_t buffer[1] = {0};
+    uint8_t request[REQUEST_LENGTH];
+    Transaction transaction;
+
+    check(TFModbusTCPClient::prepare_transaction(&prepared, 1, TFModbusTCPFunctionCode::ReadInputRegisters, 0, 1));
+    transact(&prepared, buffer, &transaction);
+    check(receive_request(request));
+
+    // The response is long enough, but announces two registers instead of one
+    const uint8_t data[4] = {1, 2, 3, 4};
+
+    send_response(request, sizeof(data), data, sizeof(data));
+    run(&transaction);
+    check(transaction.result == TFModbusTCPClientTransactionResult::ResponseByteCountMismatch);
+    check(buffer[0] == 0);
+
+    // The connection stays usable
+    transact(&prepared, buffer, &transaction);
+    check(receive_request(request));
+    send_response(request, 2, data, 2);
+    run(&transaction);
+    check(transaction.result == TFModbusTCPClientTransactionResult::Success);
+    check(buffer[0] == 0x0102);
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    now_us(); // set the baseline
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    struct sockaddr_in addr_in;
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr_in, 0, sizeof(addr_in));
+    addr_in.sin_family      = AF_INET;
+    addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_in.sin_port        = htons(PORT);
+
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr_in), sizeof(addr_in)) < 0 || listen(listen_fd, 1) < 0) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    TFModbusTCPClient modbus_client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client = &modbus_client;
+
+    client->connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client->tick();
+        usleep(100);
+    }
+
+    peer_fd = accept(listen_fd, nullptr, nullptr);
+
+    if (peer_fd < 0) {
+        printf("accept failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    test_prepare_arguments();
+    test_prepared_register_reads();
+    test_prepared_coil_read();
+    test_prepared_byte_count_mismatch();
+
+    client->disconnect();
+    close(peer_fd);
+    close(listen_fd);
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
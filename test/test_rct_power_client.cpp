@@ -0,0 +1,619 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFRCTPowerClient.h"
+#include "../src/TFRCTPowerCommon.h"
+
+#define PORT 1513
+#define MAX_REQUEST_COUNT 16
+#define MAX_ESCAPED_RESPONSE_LENGTH (1 + 12 * 2)
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// The test acts as the inverter on the accepted peer socket, so it controls
+// exactly which bytes the client receives in which recv
+static TFRCTPowerClient *client;
+static int peer_fd = -1;
+
+struct Read
+{
+    bool done;
+    TFRCTPowerClientTransactionResult result;
+    float value;
+};
+
+static void read(uint32_t id, Read *read)
+{
+    read->done = false;
+
+    client->read(id, 1_s,
+    [read](TFRCTPowerClientTransactionResult result, float value) {
+        read->done   = true;
+        read->result = result;
+        read->value  = value;
+    });
+}
+
+static void tick_for(micros_t duration)
+{
+    micros_t deadline = now_us() + duration;
+
+    while (now_us() < deadline) {
+        client->tick();
+        usleep(100);
+    }
+}
+
+static void run(const Read *read)
+{
+    micros_t deadline = now_us() + 1_s;
+
+    while (!read->done && now_us() < deadline) {
+        client->tick();
+        usleep(100);
+    }
+
+    check(read->done);
+}
+
+static float float_from_bits(uint32_t bits)
+{
+    float value;
+
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+static size_t escape_frame(const uint8_t *frame, size_t frame_length, uint8_t *escaped)
+{
+    size_t escaped_length = 0;
+
+    escaped[escaped_length++] = '+';
+
+    for (size_t i = 0; i < frame_length; ++i) {
+        if (frame[i] == '+' || frame[i] == '-') {
+            escaped[escaped_length++] = '-';
+        }
+
+        escaped[escaped_length++] = frame[i];
+    }
+
+    return escaped_length;
+}
+
+static size_t make_response(uint32_t id, float value, uint8_t *escaped, bool corrupt_checksum = false)
+{
+    uint8_t frame[12];
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    frame[0] = 5; // command: response
+    frame[1] = 8; // length
+    frame[2] = static_cast<uint8_t>(id >> 24);
+    frame[3] = static_cast<uint8_t>(id >> 16);
+    frame[4] = static_cast<uint8_t>(id >> 8);
+    frame[5] = static_cast<uint8_t>(id);
+    frame[6] = static_cast<uint8_t>(bits >> 24);
+    frame[7] = static_cast<uint8_t>(bits >> 16);
+    frame[8] = static_cast<uint8_t>(bits >> 8);
+    frame[9] = static_cast<uint8_t>(bits);
+
+    uint16_t checksum = tf_rct_power_crc16ccitt(frame, 10);
+
+    if (corrupt_checksum) {
+        checksum ^= 0x0101;
+    }
+
+    frame[10] = static_cast<uint8_t>(checksum >> 8);
+    frame[11] = static_cast<uint8_t>(checksum);
+
+    return escape_frame(frame, sizeof(frame), escaped);
+}
+
+static void send_bytes(const uint8_t *buffer, size_t length)
+{
+    check(send(peer_fd, buffer, length, 0) == static_cast<ssize_t>(length));
+}
+
+// Ticks the client for a while and returns the IDs of all read requests it
+// sent meanwhile
+static size_t receive_requests(uint32_t *ids, size_t max_count)
+{
+    uint8_t buffer[MAX_REQUEST_COUNT * (1 + 8 * 2)];
+    size_t buffer_used = 0;
+    micros_t deadline = now_us() + 20_ms;
+
+    while (now_us() < deadline) {
+        client->tick();
+
+        ssize_t length = recv(peer_fd, buffer + buffer_used, sizeof(buffer) - buffer_used, MSG_DONTWAIT);
+
+        if (length > 0) {
+            buffer_used += static_cast<size_t>(length);
+        }
+
+        usleep(100);
+    }
+
+    size_t count = 0;
+    size_t offset = 0;
+
+    while (offset < buffer_used) {
+        uint8_t request[8];
+        size_t request_used = 0;
+
+        check(buffer[offset] == '+');
+        ++offset;
+
+        while (offset < buffer_used && request_used < sizeof(request)) {
+            if (buffer[offset] == '-') {
+                ++offset;
+            }
+
+            request[request_used++] = buffer[offset++];
+        }
+
+        check(request_used == sizeof(request));
+        check(request[0] == 1 && request[1] == 4);
+        check(tf_rct_power_crc16ccitt(request, 6) == ((request[6] << 8) | request[7]));
+
+        if (count < max_count) {
+            ids[count] = (static_cast<uint32_t>(request[2]) << 24)
+                       | (static_cast<uint32_t>(request[3]) << 16)
+                       | (static_cast<uint32_t>(request[4]) << 8)
+                       | request[5];
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+static void test_split_frames()
+{
+    // ID and value contain '+' and '-' bytes, so the frame contains escape
+    // sequences and some splits fall between an escape byte and the byte it
+    // escapes
+    const uint32_t id = 0x2B2D2B2D;
+    const float value = float_from_bits(0x422D2B2D);
+    uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+    size_t response_length = make_response(id, value, response);
+
+    check(response_length > 1 + 12);
+
+    for (size_t split = 1; split < response_length; ++split) {
+        Read r;
+        uint32_t ids[MAX_REQUEST_COUNT];
+
+        read(id, &r);
+        check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id);
+
+        send_bytes(response, split);
+        tick_for(2_ms);
+        check(!r.done);
+
+        send_bytes(response + split, response_length - split);
+        run(&r);
+        check(r.result == TFRCTPowerClientTransactionResult::Success);
+        check(r.value == value);
+    }
+}
+
+static void test_checksum_mismatch()
+{
+    const uint32_t id = 0x12345678;
+    uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+    uint32_t ids[MAX_REQUEST_COUNT];
+    Read r;
+
+    read(id, &r);
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id);
+    send_bytes(response, make_response(id, 1.5f, response, true));
+    run(&r);
+    check(r.result == TFRCTPowerClientTransactionResult::ChecksumMismatch);
+
+    // The parser is back in sync for the next response
+    read(id, &r);
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id);
+    send_bytes(response, make_response(id, 2.5f, response));
+    run(&r);
+    check(r.result == TFRCTPowerClientTransactionResult::Success);
+    check(r.value == 2.5f);
+}
+
+static void test_back_to_back_frames()
+{
+    const uint32_t id_a = 0x0000002B;
+    const uint32_t id_b = 0x0000002D;
+    uint8_t responses[MAX_ESCAPED_RESPONSE_LENGTH * 2];
+    size_t responses_length = 0;
+    uint32_t ids[MAX_REQUEST_COUNT];
+    Read r_a;
+    Read r_b;
+
+    read(id_a, &r_a);
+    read(id_b, &r_b);
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 2);
+
+    // Both responses arrive in one recv, in reverse order
+    responses_length += make_response(id_b, -20.0f, responses + responses_length);
+    responses_length += make_response(id_a, 10.0f, responses + responses_length);
+    send_bytes(responses, responses_length);
+
+    run(&r_a);
+    run(&r_b);
+    check(r_a.result == TFRCTPowerClientTransactionResult::Success);
+    check(r_a.value == 10.0f);
+    check(r_b.result == TFRCTPowerClientTransactionResult::Success);
+    check(r_b.value == -20.0f);
+}
+
+static void test_duplicate_ids()
+{
+    const uint32_t id_a = 0x11111111;
+    const uint32_t id_b = 0x22222222;
+    uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+    uint32_t ids[MAX_REQUEST_COUNT];
+    Read r_a1;
+    Read r_a2;
+    Read r_b;
+
+    // The second read of A is held back until the first one got its response,
+    // but must not hold back the read of B behind it
+    read(id_a, &r_a1);
+    read(id_a, &r_a2);
+    read(id_b, &r_b);
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 2 && ids[0] == id_a && ids[1] == id_b);
+    check(client->get_in_flight_request_count() == 2);
+    check(client->get_outstanding_request_count() == 3);
+
+    send_bytes(response, make_response(id_a, 1.0f, response));
+    run(&r_a1);
+    check(r_a1.result == TFRCTPowerClientTransactionResult::Success);
+    check(r_a1.value == 1.0f);
+    check(!r_a2.done);
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id_a);
+
+    send_bytes(response, make_response(id_b, 2.0f, response));
+    run(&r_b);
+    send_bytes(response, make_response(id_a, 3.0f, response));
+    run(&r_a2);
+    check(r_b.result == TFRCTPowerClientTransactionResult::Success);
+    check(r_b.value == 2.0f);
+    check(r_a2.result == TFRCTPowerClientTransactionResult::Success);
+    check(r_a2.value == 3.0f);
+    check(client->get_outstanding_request_count() == 0);
+}
+
+#define MAX_REPORT_COUNT 32
+
+struct Reports
+{
+    size_t count;
+    float values[MAX_REPORT_COUNT];
+};
+
+static TFRCTPowerClientSubscriber *subscribe(uint32_t id, micros_t period, float deadband, Reports *reports,
+                                             std::function<void(void)> &&after_report = nullptr)
+{
+    reports->count = 0;
+
+    return client->subscribe(id, period, deadband,
+    [reports, after_report](float value, micros_t timestamp) {
+        check(timestamp > 0_s);
+
+        if (reports->count < MAX_REPORT_COUNT) {
+            reports->values[reports->count] = value;
+        }
+
+        ++reports->count;
+
+        if (after_report) {
+            after_report();
+        }
+    });
+}
+
+// Answers all subscription reads for the duration with the next values and
+// returns how many reads were answered
+static size_t serve_reads(uint32_t id, micros_t duration, float *next_value)
+{
+    micros_t deadline = now_us() + duration;
+    size_t count = 0;
+
+    while (now_us() < deadline) {
+        uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+        uint32_t ids[MAX_REQUEST_COUNT];
+        size_t request_count = receive_requests(ids, MAX_REQUEST_COUNT);
+
+        for (size_t i = 0; i < request_count; ++i) {
+            check(ids[i] == id);
+            send_bytes(response, make_response(id, (*next_value)++, response));
+        }
+
+        count += request_count;
+    }
+
+    tick_for(2_ms);
+
+    return count;
+}
+
+static void serve_read(uint32_t id, float value)
+{
+    uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+    uint32_t ids[MAX_REQUEST_COUNT];
+
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id);
+    send_bytes(response, make_response(id, value, response));
+    tick_for(2_ms);
+}
+
+static void test_subscription_deadband()
+{
+    const uint32_t id = 0x33333333;
+    const float values[] = {10.0f, 10.5f, 11.5f, 11.8f, 9.0f};
+    Reports reports;
+    Reports all_reports;
+    float value;
+    micros_t timestamp;
+
+    // Each subscriber filters against the last value reported to it
+    TFRCTPowerClientSubscriber *subscriber = subscribe(id, 10_ms, 1.0f, &reports);
+    TFRCTPowerClientSubscriber *all_subscriber = subscribe(id, 10_ms, 0.0f, &all_reports);
+
+    check(subscriber != nullptr && all_subscriber != nullptr);
+    check(!client->get_cached_value(id, &value, &timestamp));
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        serve_read(id, values[i]);
+        check(client->get_cached_value(id, &value, &timestamp));
+        check(value == values[i]);
+    }
+
+    check(reports.count == 3);
+    check(reports.values[0] == 10.0f);
+    check(reports.values[1] == 11.5f);
+    check(reports.values[2] == 9.0f);
+    check(all_reports.count == 5);
+
+    check(client->unsubscribe(subscriber));
+    check(client->unsubscribe(all_subscriber));
+    check(!client->get_cached_value(id, nullptr, nullptr));
+
+    // Answer a read that might have been pending on unsubscribe
+    float next_value = 0.0f;
+
+    serve_reads(id, 20_ms, &next_value);
+    check(reports.count == 3);
+    check(all_reports.count == 5);
+}
+
+static void test_subscription_shortest_period()
+{
+    const uint32_t id = 0x44444444;
+    float next_value = 0.0f;
+    Reports slow_reports;
+    Reports fast_reports;
+
+    // The fast subscriber speeds up the reads for both subscribers
+    TFRCTPowerClientSubscriber *slow_subscriber = subscribe(id, 1_s, 0.0f, &slow_reports);
+    TFRCTPowerClientSubscriber *fast_subscriber = subscribe(id, 20_ms, 0.0f, &fast_reports);
+    size_t fast_count = serve_reads(id, 300_ms, &next_value);
+
+    check(fast_count >= 5);
+    check(slow_reports.count == fast_count);
+    check(fast_reports.count == fast_count);
+
+    // Without it the period falls back to the slow one. A pending read and
+    // one more read due at the fast period might still happen
+    check(client->unsubscribe(fast_subscriber));
+    check(serve_reads(id, 300_ms, &next_value) <= 2);
+    check(serve_reads(id, 300_ms, &next_value) == 0);
+    check(fast_reports.count == fast_count);
+
+    check(client->unsubscribe(slow_subscriber));
+    serve_reads(id, 20_ms, &next_value);
+}
+
+static void test_unsubscribe_in_callback()
+{
+    const uint32_t id = 0x55555555;
+    Reports first_reports;
+    Reports second_reports;
+    TFRCTPowerClientSubscriber *first_subscriber = subscribe(id, 10_ms, 0.0f, &first_reports);
+    TFRCTPowerClientSubscriber *second_subscriber = nullptr;
+
+    // Subscribers are notified newest first. The second subscriber removes
+    // both, so the first one isn't notified anymore and the removal is
+    // deferred until the notification is done
+    second_subscriber = subscribe(id, 10_ms, 0.0f, &second_reports,
+    [&first_subscriber, &second_subscriber]() {
+        check(client->unsubscribe(second_subscriber));
+        check(!client->unsubscribe(second_subscriber));
+        check(client->unsubscribe(first_subscriber));
+    });
+
+    serve_read(id, 1.0f);
+    check(second_reports.count == 1);
+    check(first_reports.count == 0);
+    check(!client->get_cached_value(id, nullptr, nullptr));
+
+    // The subscription is gone, so there are no more reads
+    uint32_t ids[MAX_REQUEST_COUNT];
+
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 0);
+}
+
+static void test_unsubscribe_during_read()
+{
+    const uint32_t id = 0x66666666;
+    uint8_t response[MAX_ESCAPED_RESPONSE_LENGTH];
+    uint32_t ids[MAX_REQUEST_COUNT];
+    Reports reports;
+    TFRCTPowerClientSubscriber *subscriber = subscribe(id, 10_ms, 0.0f, &reports);
+
+    check(receive_requests(ids, MAX_REQUEST_COUNT) == 1 && ids[0] == id);
+    check(client->unsubscribe(subscriber));
+
+    // The pending read still completes, but drops its result
+    send_bytes(response, make_response(id, 1.0f, response));
+    tick_for(2_ms);
+    check(reports.count == 0);
+    check(client->get_outstanding_request_count() == 0);
+    check(!client->get_cached_value(id, nullptr, nullptr));
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    now_us(); // set the baseline
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    struct sockaddr_in addr_in;
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr_in, 0, sizeof(addr_in));
+    addr_in.sin_family      = AF_INET;
+    addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_in.sin_port        = htons(PORT);
+
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr_in), sizeof(addr_in)) < 0 || listen(listen_fd, 1) < 0) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    TFRCTPowerClient rct_power_client;
+    bool connected = false;
+
+    client = &rct_power_client;
+
+    client->connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client->tick();
+        usleep(100);
+    }
+
+    peer_fd = accept(listen_fd, nullptr, nullptr);
+
+    if (peer_fd < 0) {
+        printf("accept failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    test_split_frames();
+    test_checksum_mismatch();
+    test_back_to_back_frames();
+    test_duplicate_ids();
+    test_subscription_deadband();
+    test_subscription_shortest_period();
+    test_unsubscribe_in_callback();
+    test_unsubscribe_during_read();
+
+    client->disconnect();
+    close(peer_fd);
+    close(listen_fd);
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/random.h>
+#include <sys/time.h>
+#include <TFTools/Micros.h>
+#include "../src/TFRCTPowerCommon.h"
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// The original bit-serial implementation, used as reference
+static uint16_t reference_crc16ccitt(const uint8_t *buffer, size_t length)
+{
+    uint32_t checksum = 0xFFFF;
+
+    for (size_t i = 0; i < length; ++i) {
+        for (size_t k = 0; k < 8; ++k) {
+            bool bit = (buffer[i] >> (7 - k) & 1) == 1;
+            bool c15 = ((checksum >> 15) & 1) == 1;
+
+            checksum <<= 1;
+
+            if (c15 ^ bit) {
+                checksum ^= 0x1021;
+            }
+        }
+
+        checksum &= 0xFFFF;
+    }
+
+    return checksum & 0xFFFF;
+}
+
+static volatile uint16_t sink;
+
+static micros_t benchmark(uint16_t (*function)(const uint8_t *buffer, size_t length), const uint8_t *buffer, size_t length, size_t iterations)
+{
+    micros_t start = now_us();
+
+    for (size_t i = 0; i < iterations; ++i) {
+        sink = function(buffer, length);
+    }
+
+    return now_us() - start;
+}
+
+int main()
+{
+    static uint8_t buffer[4096];
+
+    if (getrandom(buffer, sizeof(buffer), 0) != sizeof(buffer)) {
+        abort();
+    }
+
+    // equivalence over random inputs, all lengths and offsets up to 64 bytes
+    for (size_t offset = 0; offset < 64; ++offset) {
+        for (size_t length = 0; length <= 64; ++length) {
+            uint16_t expected = reference_crc16ccitt(buffer + offset, length);
+            uint16_t actual   = tf_rct_power_crc16ccitt(buffer + offset, length);
+
+            if (actual != expected) {
+                printf("mismatch at offset %zu length %zu: actual 0x%04x, expected 0x%04x\n", offset, length, actual, expected);
+                return 1;
+            }
+        }
+    }
+
+    if (reference_crc16ccitt(buffer, sizeof(buffer)) != tf_rct_power_crc16ccitt(buffer, sizeof(buffer))) {
+        printf("mismatch for %zu bytes\n", sizeof(buffer));
+        return 1;
+    }
+
+    // CRC-16/CCITT-FALSE check value
+    if (tf_rct_power_crc16ccitt(reinterpret_cast<const uint8_t *>("123456789"), 9) != 0x29B1) {
+        printf("check value mismatch\n");
+        return 1;
+    }
+
+    printf("equivalence test passed, TF_RCT_POWER_CRC16_TABLE_COUNT=%d\n", TF_RCT_POWER_CRC16_TABLE_COUNT);
+
+    // 10 bytes is the checksummed part of a read response, 6 of a read request
+    const size_t lengths[] = {6, 10, 256, 4096};
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        size_t length = lengths[i];
+        size_t iterations = 20000000 / (length + 16);
+        micros_t reference_duration = benchmark(reference_crc16ccitt, buffer, length, iterations);
+        micros_t duration = benchmark(tf_rct_power_crc16ccitt, buffer, length, iterations);
+
+        printf("%4zu bytes: reference %8.2f MB/s, current %8.2f MB/s\n",
+               length,
+               static_cast<double>(length * iterations) / static_cast<double>(static_cast<int64_t>(reference_duration)),
+               static_cast<double>(length * iterations) / static_cast<double>(static_cast<int64_t>(duration)));
+    }
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <TFTools/Micros.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPRecorder.h"
+
+#define FILE_PATH "/tmp/test_recorder.tfmr"
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static int failure_count = 0;
+
+static bool check_next(TFModbusTCPRecorderReader *reader, uint16_t start_address, uint16_t data_count, uint16_t first_value)
+{
+    TFModbusTCPRecorderRecord record;
+
+    if (!reader->next(&record)) {
+        return false;
+    }
+
+    if (record.unit_id != 1 || record.table != TFModbusTCPTable::HoldingRegisters
+     || record.start_address != start_address || record.data_count != data_count) {
+        return false;
+    }
+
+    uint16_t values[8];
+
+    memcpy(values, record.values, data_count * sizeof(uint16_t));
+
+    for (uint16_t i = 0; i < data_count; ++i) {
+        if (values[i] != static_cast<uint16_t>(first_value + i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void record(TFModbusTCPRecorder *recorder, uint16_t start_address, uint16_t data_count, uint16_t first_value)
+{
+    uint16_t values[8];
+
+    for (uint16_t i = 0; i < data_count; ++i) {
+        values[i] = static_cast<uint16_t>(first_value + i);
+    }
+
+    check(recorder->record(1, TFModbusTCPTable::HoldingRegisters, start_address, data_count, values));
+}
+
+// A 40 byte ring holds one 32 byte record and leaves an 8 byte padding record
+// at its end on every wrap-around
+static void test_short_padding()
+{
+    TFModbusTCPRecorder recorder;
+    TFModbusTCPRecorderReader reader;
+
+    check(recorder.open(nullptr, 40));
+    check(reader.open(&recorder));
+
+    check(!check_next(&reader, 0, 1, 0));
+
+    for (uint16_t i = 0; i < 3; ++i) {
+        record(&recorder, i, 1, static_cast<uint16_t>(100 + i));
+        check(check_next(&reader, i, 1, static_cast<uint16_t>(100 + i)));
+        check(!check_next(&reader, i, 1, static_cast<uint16_t>(100 + i)));
+    }
+
+    check(recorder.get_record_count() == 3);
+
+    reader.rewind();
+    check(check_next(&reader, 2, 1, 102));
+    check(!check_next(&reader, 2, 1, 102));
+}
+
+// Records of different lengths wrap around a file-backed ring many times. A
+// reader that follows the writer sees every record, a reader that falls
+// behind restarts at the oldest record that was not overwritten
+static void test_wrap_around()
+{
+    TFModbusTCPRecorder recorder;
+    TFModbusTCPRecorderReader follower;
+    TFModbusTCPRecorderReader laggard;
+
+    unlink(FILE_PATH);
+
+    check(recorder.open(FILE_PATH, 200));
+    check(follower.open(FILE_PATH));
+    check(laggard.open(FILE_PATH));
+
+    for (uint16_t i = 0; i < 500; ++i) {
+        uint16_t data_count = static_cast<uint16_t>(1 + i % 8);
+
+        record(&recorder, i, data_count, static_cast<uint16_t>(i * 10));
+        check(check_next(&follower, i, data_count, static_cast<uint16_t>(i * 10)));
+    }
+
+    check(!check_next(&follower, 0, 1, 0));
+
+    // At most 200 / 32 records remain, the newest ones
+    TFModbusTCPRecorderRecord record;
+    uint16_t expected = 0;
+    int count = 0;
+
+    while (laggard.next(&record)) {
+        check(count == 0 || record.start_address == expected);
+        expected = static_cast<uint16_t>(record.start_address + 1);
+        ++count;
+    }
+
+    check(count > 0 && count <= 200 / 32);
+    check(expected == 500);
+
+    laggard.close();
+    follower.close();
+    recorder.close();
+    unlink(FILE_PATH);
+}
+
+int main()
+{
+    TFNetwork::vlogfln = [](const char *fmt, va_list args) {
+        vprintf(fmt, args);
+        puts("");
+    };
+
+    test_short_padding();
+    test_wrap_around();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
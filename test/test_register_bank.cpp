@@ -0,0 +1,305 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <sys/time.h>
+#include <Arduino.h>
+#include <TFTools/Micros.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPClient.h"
+#include "../src/TFModbusTCPServerRegisterBank.h"
+
+#define PORT 1505
+#define RING_NAME "/tf_modbus_tcp_write_ring_test"
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static TFModbusTCPExceptionCode read_write(TFModbusTCPServerRegisterBank *bank, uint16_t read_start_address, uint16_t read_data_count,
+                                           uint16_t write_start_address, uint16_t write_data_count, uint16_t *read_values, uint16_t *write_values)
+{
+    TFModbusTCPServerReadWriteMultipleRegistersValues values;
+
+    values.write_start_address   = write_start_address;
+    values.write_data_count      = write_data_count;
+    values.write_register_values = write_values;
+    values.read_register_values  = read_values;
+
+    return bank->handle_request(1, TFModbusTCPFunctionCode::ReadWriteMultipleRegisters, read_start_address, read_data_count, &values);
+}
+
+// A read-write request is answered with an exception if the read fails. Its
+// write must not reach the ring in that case
+static void test_read_write()
+{
+    TFModbusTCPRegisterImage image;
+    TFModbusTCPWriteRing ring;
+
+    image.add_block(1, TFModbusTCPTable::HoldingRegisters, 0, 4);
+    image.add_block(1, TFModbusTCPTable::HoldingRegisters, 100, 4);
+
+    check(image.create());
+    check(ring.create());
+
+    TFModbusTCPServerRegisterBank bank(&image, &ring);
+    uint16_t read_values[4];
+    uint16_t write_values[2] = {0x1234, 0x5678};
+    TFModbusTCPWriteRingEntry entry;
+
+    // Read range not covered
+    check(read_write(&bank, 50, 2, 0, 2, read_values, write_values) == TFModbusTCPExceptionCode::IllegalDataAddress);
+    check(!ring.pop(&entry));
+
+    // Read range covered, but not written by the owning process yet
+    check(read_write(&bank, 100, 2, 0, 2, read_values, write_values) == TFModbusTCPExceptionCode::ServerDeviceBusy);
+    check(!ring.pop(&entry));
+
+    uint16_t image_values[4] = {1, 2, 3, 4};
+
+    check(image.write(1, image_values));
+
+    // Write range not covered
+    check(read_write(&bank, 100, 2, 50, 2, read_values, write_values) == TFModbusTCPExceptionCode::IllegalDataAddress);
+    check(!ring.pop(&entry));
+
+    check(read_write(&bank, 101, 3, 2, 2, read_values, write_values) == TFModbusTCPExceptionCode::Success);
+    check(read_values[0] == 2 && read_values[1] == 3 && read_values[2] == 4);
+    check(ring.pop(&entry));
+    check(entry.unit_id == 1);
+    check(entry.function_code == static_cast<uint8_t>(TFModbusTCPFunctionCode::WriteMultipleRegisters));
+    check(entry.start_address == 2);
+    check(entry.data_count == 2);
+    check(entry.register_values[0] == 0x1234 && entry.register_values[1] == 0x5678);
+    check(!ring.pop(&entry));
+}
+
+// Overwrites word 2 of the ring header, the capacity
+static bool set_raw_capacity(const char *name, uint32_t capacity)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        return false;
+    }
+
+    void *region = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (region == MAP_FAILED) {
+        return false;
+    }
+
+    static_cast<uint32_t *>(region)[2] = capacity;
+
+    munmap(region, static_cast<size_t>(st.st_size));
+
+    return true;
+}
+
+// A consumer must not attach to a ring whose capacity does not match the size
+// of the region, push and pop would access memory beyond its end
+static void test_ring_attach()
+{
+    TFModbusTCPWriteRing ring;
+    TFModbusTCPWriteRing consumer;
+
+    check(ring.create(RING_NAME, 8));
+    check(consumer.attach(RING_NAME));
+    consumer.close();
+
+    check(set_raw_capacity(RING_NAME, 1000));
+    check(!consumer.attach(RING_NAME));
+
+    check(set_raw_capacity(RING_NAME, 0));
+    check(!consumer.attach(RING_NAME));
+
+    check(set_raw_capacity(RING_NAME, 8));
+    check(consumer.attach(RING_NAME));
+}
+
+// Reads of a multiple of 8 coils must keep the last byte, on the server and
+// on the client side
+static void test_coil_read()
+{
+    TFModbusTCPRegisterImage image;
+
+    image.add_block(1, TFModbusTCPTable::Coils, 0, 24);
+
+    check(image.create());
+
+    uint8_t image_values[3] = {0xA5, 0xFF, 0x3C};
+
+    check(image.write(0, image_values));
+
+    TFModbusTCPServerRegisterBank bank(&image);
+    TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+
+    check(bank.add_address_ranges(&server));
+
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        (void)peer_address;
+        (void)port;
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        (void)peer_address;
+        (void)port;
+        (void)reason;
+        (void)error_number;
+    },
+    [&bank](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        return bank.handle_request(unit_id, function_code, start_address, data_count, data_values);
+    })) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        ++failure_count;
+        return;
+    }
+
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client.connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    static const struct {
+        uint16_t data_count;
+        uint8_t expected[3];
+    } reads[] = {
+        {8,  {0xA5, 0x00, 0x00}},
+        {16, {0xA5, 0xFF, 0x00}},
+        {24, {0xA5, 0xFF, 0x3C}},
+        {13, {0xA5, 0x1F, 0x00}},
+    };
+
+    for (size_t i = 0; i < sizeof(reads) / sizeof(reads[0]); ++i) {
+        uint8_t buffer[3] = {};
+        bool done = false;
+
+        client.transact(1, TFModbusTCPFunctionCode::ReadCoils, 0, reads[i].data_count, buffer, 1_s,
+        [&done](TFModbusTCPClientTransactionResult result, const char *error_message) {
+            (void)error_message;
+
+            check(result == TFModbusTCPClientTransactionResult::Success);
+            done = true;
+        });
+
+        while (!done) {
+            client.tick();
+            server.tick();
+            usleep(100);
+        }
+
+        check(memcmp(buffer, reads[i].expected, sizeof(buffer)) == 0);
+    }
+
+    client.disconnect();
+    server.stop();
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    test_read_write();
+    test_ring_attach();
+    test_coil_read();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <TFTools/Micros.h>
+#include "../src/TFModbusTCPRegisterImage.h"
+
+#define NAME "/tf_modbus_tcp_register_image_test"
+#define DAMAGED_NAME "/tf_modbus_tcp_register_image_test_damaged"
+#define REGISTER_COUNT 125
+#define WRITE_COUNT 1000000
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// The writer fills all registers of a block with the same value, the reader
+// in another process checks that it never sees a mix of two writes
+static int run_reader()
+{
+    TFModbusTCPRegisterImage image;
+
+    while (!image.attach(NAME)) {
+        usleep(1000);
+    }
+
+    uint16_t values[REGISTER_COUNT];
+    uint32_t read_count = 0;
+    uint32_t inconsistent_count = 0;
+    uint16_t last_value = 0;
+
+    while (last_value != static_cast<uint16_t>(WRITE_COUNT)) {
+        const void *data;
+        uint32_t sequence = image.begin_read(0, &data);
+
+        if (sequence == 0) {
+            continue;
+        }
+
+        const uint16_t *registers = static_cast<const uint16_t *>(data);
+        uint16_t first = registers[0];
+        bool mixed = false;
+
+        for (size_t i = 1; i < REGISTER_COUNT; ++i) {
+            if (registers[i] != first) {
+                mixed = true;
+                break;
+            }
+        }
+
+        if (!image.end_read(0, sequence)) {
+            continue; // changed while reading, a mix is expected here
+        }
+
+        if (mixed) {
+            ++inconsistent_count;
+        }
+
+        ++read_count;
+        last_value = first;
+    }
+
+    image.read(1, values);
+
+    printf("reader: %u consistent zero-copy reads, %u inconsistent, bits 0x%02x\n", read_count, inconsistent_count, values[0] & 0xFF);
+
+    return inconsistent_count == 0 && (values[0] & 0xFF) == 0xA5 ? 0 : 1;
+}
+
+// Maps the region of the image as raw words, to damage it like a crashed or
+// malicious writer would. Word 2 is the block count, each block takes 4 words
+// starting at word 4: sequence, IDs and table, counts, data offset
+static uint32_t *map_raw(const char *name, size_t *length)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        return nullptr;
+    }
+
+    *length = static_cast<size_t>(st.st_size);
+
+    void *region = mmap(nullptr, *length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    return region != MAP_FAILED ? static_cast<uint32_t *>(region) : nullptr;
+}
+
+static int test_damaged_region()
+{
+    TFModbusTCPRegisterImage image;
+    int failure_count = 0;
+
+    image.add_block(1, TFModbusTCPTable::HoldingRegisters, 0, 4);
+
+    if (!image.create(DAMAGED_NAME)) {
+        printf("create failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    uint16_t values[4] = {1, 2, 3, 4};
+
+    image.write(0, values);
+
+    size_t length;
+    uint32_t *raw = map_raw(DAMAGED_NAME, &length);
+
+    if (raw == nullptr) {
+        printf("map failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    // A writer that died in the middle of a write leaves the sequence odd,
+    // readers have to give up instead of spinning forever
+    TFModbusTCPRegisterImage reader;
+    const void *data;
+
+    raw[4] |= 1;
+
+    if (!reader.attach(DAMAGED_NAME)) {
+        printf("attach failed\n");
+        ++failure_count;
+    }
+    else if (reader.begin_read(0, &data) != 0 || data != nullptr || reader.read(0, values)) {
+        printf("read of block with unfinished write succeeded\n");
+        ++failure_count;
+    }
+
+    reader.close();
+
+    // Blocks and data outside of the region must be rejected on attach
+    uint32_t block_count = raw[2];
+    uint32_t data_offset = raw[7];
+
+    raw[2] = 0x10000000;
+
+    if (reader.attach(DAMAGED_NAME)) {
+        printf("attach with too many blocks succeeded\n");
+        ++failure_count;
+        reader.close();
+    }
+
+    raw[2] = block_count;
+    raw[7] = static_cast<uint32_t>(length) - 2;
+
+    if (reader.attach(DAMAGED_NAME)) {
+        printf("attach with block data past the end succeeded\n");
+        ++failure_count;
+        reader.close();
+    }
+
+    raw[7] = data_offset;
+
+    if (!reader.attach(DAMAGED_NAME)) {
+        printf("attach of repaired region failed\n");
+        ++failure_count;
+    }
+
+    reader.close();
+    munmap(raw, length);
+    image.close();
+
+    printf("damaged region: %s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count;
+}
+
+int main()
+{
+    if (test_damaged_region() != 0) {
+        return 1;
+    }
+
+    TFModbusTCPRegisterImage image;
+
+    image.add_block(1, TFModbusTCPTable::HoldingRegisters, 40000, REGISTER_COUNT);
+    image.add_block(1, TFModbusTCPTable::Coils, 0, 8);
+
+    if (!image.create(NAME)) {
+        printf("create failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    uint8_t bits = 0xA5;
+
+    image.write(1, &bits);
+
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        return run_reader();
+    }
+
+    uint16_t values[REGISTER_COUNT];
+    micros_t start = now_us();
+
+    for (uint32_t i = 1; i <= WRITE_COUNT; ++i) {
+        for (size_t k = 0; k < REGISTER_COUNT; ++k) {
+            values[k] = static_cast<uint16_t>(i);
+        }
+
+        image.write(0, values);
+    }
+
+    micros_t duration = now_us() - start;
+    int status;
+
+    waitpid(pid, &status, 0);
+
+    printf("writer: %u writes in %lli us\n", WRITE_COUNT, static_cast<long long>(static_cast<int64_t>(duration)));
+
+    image.close();
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,264 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPServer.h"
+#include "../src/TFModbusTCPClient.h"
+#include "../src/TFModbusTCPSchema.h"
+
+#define PORT 1504
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static constexpr TFModbusTCPSchemaPoint points[] = {
+    {TFModbusTCPTable::HoldingRegisters, 40084, TFModbusTCPSchemaType::Float32},
+    {TFModbusTCPTable::HoldingRegisters, 40072, TFModbusTCPSchemaType::Uint16},
+    {TFModbusTCPTable::InputRegisters,   10,    TFModbusTCPSchemaType::Int32},
+    {TFModbusTCPTable::HoldingRegisters, 40073, TFModbusTCPSchemaType::Int16},
+    {TFModbusTCPTable::HoldingRegisters, 40300, TFModbusTCPSchemaType::Uint32},
+    {TFModbusTCPTable::HoldingRegisters, 40076, TFModbusTCPSchemaType::Uint16},
+};
+
+// Without gap 40072-40073, 40076 and 40084-40085 are separate blocks, with a
+// gap of 16 they are merged into 40072-40085. Holding registers sort before
+// input registers
+static constexpr auto plan = tf_modbus_tcp_schema_make_plan(points);
+static constexpr auto plan_gap = tf_modbus_tcp_schema_make_plan(points, 16);
+
+static_assert(plan.valid, "plan is invalid");
+static_assert(plan.block_count == 5, "plan has unexpected block count");
+static_assert(plan.buffer_register_count == 2 + 1 + 2 + 2 + 2, "plan has unexpected buffer size");
+static_assert(plan_gap.block_count == 3, "plan with gap has unexpected block count");
+static_assert(plan_gap.blocks[0].start_address == 40072 && plan_gap.blocks[0].register_count == 14, "plan with gap has unexpected first block");
+static_assert(plan_gap.blocks[2].table == TFModbusTCPTable::InputRegisters, "plan with gap has unexpected last block");
+static_assert(plan_gap.buffer_register_count == 14 + 2 + 2, "plan with gap has unexpected buffer size");
+static_assert(plan_gap.point_offsets[0] == 12 && plan_gap.point_offsets[5] == 4, "plan with gap has unexpected point offsets");
+
+static constexpr TFModbusTCPSchemaPoint coil_points[] = {
+    {TFModbusTCPTable::Coils, 0, TFModbusTCPSchemaType::Uint16},
+};
+
+static constexpr TFModbusTCPSchemaPoint overflow_points[] = {
+    {TFModbusTCPTable::HoldingRegisters, 65535, TFModbusTCPSchemaType::Uint32},
+};
+
+static_assert(!tf_modbus_tcp_schema_make_plan(coil_points).valid, "plan with coils is valid");
+static_assert(!tf_modbus_tcp_schema_make_plan(overflow_points).valid, "plan past the last address is valid");
+
+// The read limit splits 0-125 into the adjacent blocks 0-124 and 125
+static constexpr TFModbusTCPSchemaPoint adjacent_points[] = {
+    {TFModbusTCPTable::HoldingRegisters, 0,   TFModbusTCPSchemaType::Uint16},
+    {TFModbusTCPTable::HoldingRegisters, 124, TFModbusTCPSchemaType::Uint16},
+    {TFModbusTCPTable::HoldingRegisters, 125, TFModbusTCPSchemaType::Uint16},
+    {TFModbusTCPTable::HoldingRegisters, 200, TFModbusTCPSchemaType::Uint16},
+};
+
+static constexpr auto adjacent_plan = tf_modbus_tcp_schema_make_plan(adjacent_points, 200);
+
+static_assert(adjacent_plan.block_count == 2, "adjacent plan has unexpected block count");
+static_assert(adjacent_plan.blocks[1].start_address == 125 && adjacent_plan.blocks[1].register_count == 76, "adjacent plan has unexpected second block");
+
+static void test_read_registers()
+{
+    uint16_t buffer[adjacent_plan.buffer_register_count];
+    uint16_t values[10];
+
+    for (uint16_t i = 0; i < adjacent_plan.buffer_register_count; ++i) {
+        buffer[i] = 1000 + i;
+    }
+
+    // Spans the end of the first and the start of the second block
+    check(adjacent_plan.read_registers(buffer, TFModbusTCPTable::HoldingRegisters, 120, 10, values) == TFModbusTCPExceptionCode::Success);
+
+    for (uint16_t i = 0; i < 10; ++i) {
+        check(values[i] == 1120 + i);
+    }
+
+    check(adjacent_plan.read_registers(buffer, TFModbusTCPTable::HoldingRegisters, 196, 5, values) == TFModbusTCPExceptionCode::Success);
+    check(adjacent_plan.read_registers(buffer, TFModbusTCPTable::HoldingRegisters, 196, 6, values) == TFModbusTCPExceptionCode::IllegalDataAddress);
+    check(adjacent_plan.read_registers(buffer, TFModbusTCPTable::InputRegisters, 0, 1, values) == TFModbusTCPExceptionCode::IllegalDataAddress);
+
+    // 40074-40075 are within the merged block, but not part of the plan without gap
+    uint16_t plan_buffer[plan.buffer_register_count] = {};
+
+    check(plan.read_registers(plan_buffer, TFModbusTCPTable::HoldingRegisters, 40072, 2, values) == TFModbusTCPExceptionCode::Success);
+    check(plan.read_registers(plan_buffer, TFModbusTCPTable::HoldingRegisters, 40072, 3, values) == TFModbusTCPExceptionCode::IllegalDataAddress);
+}
+
+// A server answers from a buffer of the plan with gap, a client reads it into
+// a buffer of the plan without gap
+static void test_schema_read()
+{
+    uint16_t server_buffer[plan_gap.buffer_register_count] = {};
+
+    plan_gap.set_float32(server_buffer, 0, 3.5f);
+    plan_gap.set_uint16(server_buffer, 1, 7);
+    plan_gap.set_int32(server_buffer, 2, -100000);
+    plan_gap.set_int16(server_buffer, 3, -5);
+    plan_gap.set_uint32(server_buffer, 4, 0xDEADBEEF);
+    plan_gap.set_uint16(server_buffer, 5, 9);
+
+    TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        (void)peer_address;
+        (void)port;
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        (void)peer_address;
+        (void)port;
+        (void)reason;
+        (void)error_number;
+    },
+    [&server_buffer](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        (void)unit_id;
+
+        TFModbusTCPTable table = function_code == TFModbusTCPFunctionCode::ReadInputRegisters ? TFModbusTCPTable::InputRegisters
+                                                                                              : TFModbusTCPTable::HoldingRegisters;
+
+        return plan_gap.read_registers(server_buffer, table, start_address, data_count, static_cast<uint16_t *>(data_values));
+    })) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        ++failure_count;
+        return;
+    }
+
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client.connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    uint16_t buffer[plan.buffer_register_count];
+    bool done = false;
+
+    tf_modbus_tcp_schema_read(&client, 1, &plan, buffer, 1_s,
+    [&done](TFModbusTCPClientTransactionResult result, const char *error_message) {
+        (void)error_message;
+
+        check(result == TFModbusTCPClientTransactionResult::Success);
+        done = true;
+    });
+
+    while (!done) {
+        client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    check(plan.get_float32(buffer, 0) == 3.5f);
+    check(plan.get_uint16(buffer, 1) == 7);
+    check(plan.get_int32(buffer, 2) == -100000);
+    check(plan.get_int16(buffer, 3) == -5);
+    check(plan.get_uint32(buffer, 4) == 0xDEADBEEF);
+    check(plan.get_uint16(buffer, 5) == 9);
+
+    client.disconnect();
+    server.stop();
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    test_read_registers();
+    test_schema_read();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
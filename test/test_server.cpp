@@ -154,6 +154,26 @@ int main()
 
             return TFModbusTCPExceptionCode::Success;
         }
+        else if (function_code == TFModbusTCPFunctionCode::ReadWriteMultipleRegisters) {
+            TFModbusTCPServerReadWriteMultipleRegistersValues *values = static_cast<TFModbusTCPServerReadWriteMultipleRegistersValues *>(data_values);
+
+            TFNetwork::logfln("read_write_multiple_registers unit_id=%u write_start_address=%u write_data_count=%u write_data_values=...",
+                              unit_id, values->write_start_address, values->write_data_count);
+
+            for (uint16_t i = 0; i < values->write_data_count; ++i) {
+                TFNetwork::logfln("  %u: %u", i, values->write_register_values[i]);
+            }
+
+            TFNetwork::logfln("read_write_multiple_registers unit_id=%u read_start_address=%u read_data_count=%u read_data_values=...", unit_id, start_address, data_count);
+
+            for (uint16_t i = 0; i < data_count; ++i) {
+                values->read_register_values[i] = start_address + i;
+
+                TFNetwork::logfln("  %u: %u", i, values->read_register_values[i]);
+            }
+
+            return TFModbusTCPExceptionCode::Success;
+        }
 
         return TFModbusTCPExceptionCode::ForceTimeout;
     });
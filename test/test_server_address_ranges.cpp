@@ -0,0 +1,227 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPServer.h"
+#include "../src/TFModbusTCPClient.h"
+
+#define PORT 1510
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static int failure_count = 0;
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static int request_count = 0;
+
+static TFModbusTCPClientTransactionResult read(TFModbusTCPClient *client, TFModbusTCPServer *server, uint8_t unit_id, TFModbusTCPTable table,
+                                               uint16_t start_address, uint16_t data_count)
+{
+    static uint16_t buffer[125];
+    TFModbusTCPFunctionCode function_code = table == TFModbusTCPTable::InputRegisters ? TFModbusTCPFunctionCode::ReadInputRegisters
+                                                                                      : TFModbusTCPFunctionCode::ReadHoldingRegisters;
+    TFModbusTCPClientTransactionResult transaction_result = TFModbusTCPClientTransactionResult::Aborted;
+    bool done = false;
+
+    client->transact(unit_id, function_code, start_address, data_count, buffer, 1_s,
+    [&transaction_result, &done](TFModbusTCPClientTransactionResult result, const char *error_message) {
+        (void)error_message;
+
+        transaction_result = result;
+        done = true;
+    });
+
+    while (!done) {
+        client->tick();
+        server->tick();
+        usleep(100);
+    }
+
+    return transaction_result;
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    TFModbusTCPServer server(TFModbusTCPByteOrder::Host);
+
+    if (!server.start(0, PORT,
+    [](uint32_t peer_address, uint16_t port) {
+        (void)peer_address;
+        (void)port;
+    },
+    [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+        (void)peer_address;
+        (void)port;
+        (void)reason;
+        (void)error_number;
+    },
+    [](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+        (void)unit_id;
+        (void)function_code;
+
+        // The register values are not 2-byte aligned in the response
+        for (uint16_t i = 0; i < data_count; ++i) {
+            uint16_t value = static_cast<uint16_t>(start_address + i);
+
+            memcpy(static_cast<uint8_t *>(data_values) + i * 2, &value, sizeof(value));
+        }
+
+        ++request_count;
+        return TFModbusTCPExceptionCode::Success;
+    })) {
+        printf("server start failed: %s (%d)\n", strerror(errno), errno);
+        return 1;
+    }
+
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+
+    client.connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client.tick();
+        server.tick();
+        usleep(100);
+    }
+
+    const TFModbusTCPClientTransactionResult success = TFModbusTCPClientTransactionResult::Success;
+    const TFModbusTCPClientTransactionResult illegal = TFModbusTCPClientTransactionResult::ModbusIllegalDataAddress;
+
+    // Without address ranges every request is accepted
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 5000, 10) == success);
+
+    check(!server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 100, 0));
+    check(!server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 65530, 7));
+    check(server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 65530, 6));
+
+    // Overlapping and adjacent ranges are merged, added out of order
+    check(server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 105, 10)); // 105..114
+    check(server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 200, 10)); // 200..209
+    check(server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 100, 10)); // 100..109, overlaps
+    check(server.add_address_range(1, TFModbusTCPTable::HoldingRegisters, 115, 5));  // 115..119, adjacent
+
+    // Same addresses for other unit IDs and tables are not merged
+    check(server.add_address_range(1, TFModbusTCPTable::InputRegisters, 120, 10));   // 120..129
+    check(server.add_address_range(2, TFModbusTCPTable::HoldingRegisters, 120, 10)); // 120..129
+
+    request_count = 0;
+
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 100, 20) == success);
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 108, 4) == success);
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 200, 10) == success);
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 65530, 6) == success);
+    check(read(&client, &server, 1, TFModbusTCPTable::InputRegisters, 120, 10) == success);
+    check(read(&client, &server, 2, TFModbusTCPTable::HoldingRegisters, 120, 10) == success);
+    check(request_count == 6);
+
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 99, 2) == illegal);
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 119, 2) == illegal);   // 120 would only be valid for the input registers
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 115, 90) == illegal);  // straddles the gap 120..199
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 150, 10) == illegal);  // inside the gap
+    check(read(&client, &server, 1, TFModbusTCPTable::HoldingRegisters, 209, 2) == illegal);
+    check(read(&client, &server, 1, TFModbusTCPTable::InputRegisters, 110, 10) == illegal);    // only valid for the holding registers
+    check(read(&client, &server, 2, TFModbusTCPTable::HoldingRegisters, 100, 10) == illegal);  // only valid for unit ID 1
+    check(read(&client, &server, 2, TFModbusTCPTable::HoldingRegisters, 119, 11) == illegal);
+    check(read(&client, &server, 3, TFModbusTCPTable::HoldingRegisters, 120, 1) == illegal);
+    check(request_count == 6); // rejected without calling the request callback
+
+    check(server.clear_address_ranges());
+
+    check(read(&client, &server, 3, TFModbusTCPTable::HoldingRegisters, 150, 10) == success);
+    check(read(&client, &server, 1, TFModbusTCPTable::InputRegisters, 0, 125) == success);
+    check(request_count == 8);
+
+    client.disconnect();
+    server.stop();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
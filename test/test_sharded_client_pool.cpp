@@ -0,0 +1,396 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <atomic>
+#include <thread>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPServer.h"
+#include "../src/TFModbusTCPShardedClientPool.h"
+#include "../src/TFModbusTCPSubmit.h"
+
+#define PORT 1506 // and the next SERVER_COUNT - 1 ports
+#define SHARD_COUNT 3
+#define SERVER_COUNT 4
+#define READ_COUNT 200
+#define MAX_OUTSTANDING 8
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static std::atomic<int> failure_count{0};
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+static void wait_for(const std::function<bool(void)> &condition)
+{
+    micros_t deadline = calculate_deadline(5_s);
+
+    while (!condition() && !deadline_elapsed(deadline)) {
+        usleep(100);
+    }
+
+    check(condition());
+}
+
+// Changing the weight of a shard only moves the endpoints that hashed to the
+// changed part of the ring
+static void test_consistent_hashing()
+{
+    TFModbusTCPShardedClientPool pool(TFModbusTCPByteOrder::Host, SHARD_COUNT);
+    size_t before[200];
+    size_t moved_count = 0;
+    size_t shard0_count = 0;
+    char host[32];
+
+    for (int i = 0; i < 200; ++i) {
+        snprintf(host, sizeof(host), "10.0.%d.%d", i / 50, i);
+        before[i] = pool.get_shard_index(host, 502);
+        check(before[i] < SHARD_COUNT);
+
+        if (before[i] == 0) {
+            ++shard0_count;
+        }
+    }
+
+    check(pool.set_shard_weight(0, 0));
+
+    for (int i = 0; i < 200; ++i) {
+        snprintf(host, sizeof(host), "10.0.%d.%d", i / 50, i);
+
+        size_t shard_index = pool.get_shard_index(host, 502);
+
+        check(shard_index != 0);
+
+        if (shard_index != before[i]) {
+            check(before[i] == 0);
+            ++moved_count;
+        }
+    }
+
+    check(shard0_count > 0);
+    check(moved_count == shard0_count);
+
+    check(pool.set_shard_weight(0, 1));
+
+    for (int i = 0; i < 200; ++i) {
+        snprintf(host, sizeof(host), "10.0.%d.%d", i / 50, i);
+        check(pool.get_shard_index(host, 502) == before[i]);
+    }
+
+    // At least one shard has to keep a weight greater than 0
+    check(!pool.set_shard_weight(SHARD_COUNT, 1));
+    check(pool.set_shard_weight(1, 0));
+    check(pool.set_shard_weight(2, 0));
+    check(!pool.set_shard_weight(0, 0));
+    check(pool.get_shard_weight(0) == 1);
+}
+
+struct Endpoint
+{
+    std::atomic<TFGenericTCPSharedClient *> shared_client{nullptr};
+    std::atomic<int> connect_count{0};
+    std::atomic<int> disconnect_count{0};
+    uint16_t buffer[READ_COUNT][2];
+};
+
+// Reads from all endpoints through the submit queues of their shards
+static void read_all(TFModbusTCPShardedClientPool *pool, Endpoint *endpoints)
+{
+    std::atomic<int> success_count{0};
+    std::atomic<int> outstanding_count{0};
+
+    for (uint16_t r = 0; r < READ_COUNT; ++r) {
+        for (uint16_t i = 0; i < SERVER_COUNT; ++i) {
+            TFModbusTCPSharedClient *shared_client = static_cast<TFModbusTCPSharedClient *>(endpoints[i].shared_client.load());
+            ssize_t shard_index = pool->get_shard_index(shared_client);
+            uint16_t *buffer = endpoints[i].buffer[r];
+
+            check(shard_index >= 0);
+
+            while (outstanding_count >= MAX_OUTSTANDING) {
+                usleep(50);
+            }
+
+            ++outstanding_count;
+
+            while (!tf_modbus_tcp_submit_transact(pool->get_submit_queue(static_cast<size_t>(shard_index)), shared_client, 1,
+                                                  TFModbusTCPFunctionCode::ReadHoldingRegisters, r, 2, buffer, 2_s,
+            [&success_count, &outstanding_count, buffer, r, i](TFModbusTCPClientTransactionResult result, const char *error_message) {
+                (void)error_message;
+
+                check(result == TFModbusTCPClientTransactionResult::Success);
+
+                if (result == TFModbusTCPClientTransactionResult::Success && buffer[0] == r + i && buffer[1] == r + i + 1) {
+                    ++success_count;
+                }
+
+                --outstanding_count;
+            })) {
+                usleep(100);
+            }
+        }
+    }
+
+    // The counters live on this stack frame, wait for the last callback
+    wait_for([&outstanding_count]() { return outstanding_count == 0; });
+    check(success_count == READ_COUNT * SERVER_COUNT);
+}
+
+static size_t get_total_share_count(TFModbusTCPShardedClientPool *pool)
+{
+    size_t total = 0;
+
+    for (size_t s = 0; s < SHARD_COUNT; ++s) {
+        total += pool->get_share_count(s);
+    }
+
+    return total;
+}
+
+// Acquires, uses and releases endpoints across shards and moves them with
+// rebalance() after a weight change
+static void test_pool()
+{
+    TFModbusTCPServer *servers[SERVER_COUNT];
+
+    for (uint16_t i = 0; i < SERVER_COUNT; ++i) {
+        servers[i] = new TFModbusTCPServer(TFModbusTCPByteOrder::Host);
+
+        if (!servers[i]->start(0, PORT + i,
+        [](uint32_t peer_address, uint16_t port) {
+            (void)peer_address;
+            (void)port;
+        },
+        [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+            (void)peer_address;
+            (void)port;
+            (void)reason;
+            (void)error_number;
+        },
+        [i](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+            (void)unit_id;
+            (void)function_code;
+
+            // The register values are not aligned in the response frame
+            for (uint16_t k = 0; k < data_count; ++k) {
+                uint16_t value = static_cast<uint16_t>(start_address + k + i);
+
+                memcpy(static_cast<uint16_t *>(data_values) + k, &value, sizeof(value));
+            }
+
+            return TFModbusTCPExceptionCode::Success;
+        })) {
+            printf("server start failed: %s (%d)\n", strerror(errno), errno);
+            exit(1);
+        }
+    }
+
+    std::atomic<bool> running{true};
+    std::thread server_thread([&servers, &running]() {
+        while (running) {
+            for (TFModbusTCPServer *server : servers) {
+                server->tick();
+            }
+
+            usleep(50);
+        }
+    });
+
+    TFModbusTCPShardedClientPool pool(TFModbusTCPByteOrder::Host, SHARD_COUNT);
+    Endpoint endpoints[SERVER_COUNT];
+
+    check(pool.start());
+
+    for (uint16_t i = 0; i < SERVER_COUNT; ++i) {
+        Endpoint *endpoint = &endpoints[i];
+
+        check(pool.acquire("127.0.0.1", PORT + i,
+        [endpoint](TFGenericTCPClientConnectResult result, int error_number, TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level) {
+            (void)error_number;
+            (void)share_level;
+
+            check(result == TFGenericTCPClientConnectResult::Connected);
+
+            endpoint->shared_client = shared_client;
+            ++endpoint->connect_count;
+        },
+        [endpoint](TFGenericTCPClientDisconnectReason reason, int error_number, TFGenericTCPSharedClient *shared_client, TFGenericTCPClientPoolShareLevel share_level) {
+            (void)reason;
+            (void)error_number;
+            (void)share_level;
+
+            check(endpoint->shared_client == shared_client);
+
+            endpoint->shared_client = nullptr;
+            ++endpoint->disconnect_count;
+        }));
+    }
+
+    for (Endpoint &endpoint : endpoints) {
+        wait_for([&endpoint]() { return endpoint.connect_count == 1; });
+    }
+
+    check(get_total_share_count(&pool) == SERVER_COUNT);
+
+    for (uint16_t i = 0; i < SERVER_COUNT; ++i) {
+        check(pool.get_shard_index(endpoints[i].shared_client) == static_cast<ssize_t>(pool.get_shard_index("127.0.0.1", PORT + i)));
+    }
+
+    read_all(&pool, endpoints);
+
+    // Nothing to move without a weight change
+    check(pool.rebalance() == 0);
+
+    // Take the shard of the first endpoint out of the ring
+    size_t drained_shard_index = pool.get_shard_index("127.0.0.1", PORT);
+    size_t drained_share_count = pool.get_share_count(drained_shard_index);
+
+    check(drained_share_count > 0);
+
+    check(pool.set_shard_weight(drained_shard_index, 0));
+    check(pool.get_share_count(drained_shard_index) == drained_share_count); // existing shares stay
+    check(pool.rebalance() == drained_share_count);
+
+    // Each moved endpoint reports a disconnect and then the new shared client
+    wait_for([&endpoints, drained_share_count]() {
+        size_t moved_count = 0;
+
+        for (Endpoint &endpoint : endpoints) {
+            if (endpoint.disconnect_count == 1 && endpoint.connect_count == 2 && endpoint.shared_client != nullptr) {
+                ++moved_count;
+            }
+        }
+
+        return moved_count == drained_share_count;
+    });
+
+    check(pool.get_share_count(drained_shard_index) == 0);
+    check(get_total_share_count(&pool) == SERVER_COUNT);
+
+    for (uint16_t i = 0; i < SERVER_COUNT; ++i) {
+        check(endpoints[i].connect_count == endpoints[i].disconnect_count + 1);
+        check(pool.get_shard_index(endpoints[i].shared_client) == static_cast<ssize_t>(pool.get_shard_index("127.0.0.1", PORT + i)));
+    }
+
+    read_all(&pool, endpoints);
+
+    // The test is built with a max wait duration of 1 s, so an idle worker
+    // blocks in select() and only the wakeup socket makes it run a posted
+    // function that fast
+    std::atomic<int64_t> post_run_time{0};
+
+    usleep(50000);
+
+    micros_t post_time = now_us();
+
+    check(pool.post(endpoints[0].shared_client, [&post_run_time]() {
+        post_run_time = static_cast<int64_t>(now_us());
+    }));
+
+    wait_for([&post_run_time]() { return post_run_time != 0; });
+    check(micros_t{post_run_time} - post_time < 100_ms);
+
+    TFGenericTCPSharedClient *released_client = endpoints[0].shared_client;
+
+    for (Endpoint &endpoint : endpoints) {
+        int disconnect_count = endpoint.disconnect_count;
+
+        check(pool.release(endpoint.shared_client));
+        wait_for([&endpoint, disconnect_count]() { return endpoint.disconnect_count == disconnect_count + 1; });
+    }
+
+    check(get_total_share_count(&pool) == 0);
+    check(!pool.release(released_client));
+
+    pool.stop();
+
+    running = false;
+    server_thread.join();
+
+    for (TFModbusTCPServer *server : servers) {
+        server->stop();
+        delete server;
+    }
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    now_us(); // sets the baseline before the worker threads call it
+
+    test_consistent_hashing();
+    test_pool();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
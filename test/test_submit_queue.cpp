@@ -0,0 +1,217 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <TFTools/Micros.h>
+#include "../src/TFModbusTCPSubmit.h"
+
+// Stress test for the submit and completion queues. Build it with
+// -fsanitize=thread to check the memory ordering
+
+#define PRODUCER_COUNT 4
+#define POST_COUNT 200000
+#define SUBMITTER_COUNT 2
+#define SUBMIT_COUNT 50000
+
+#define check(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++failure_count; \
+    } \
+} while (0)
+
+static std::atomic<int> failure_count{0};
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// Completes every transaction immediately on the ticking thread. The result
+// depends on the unit ID that identifies the submitter, the start address is
+// a sequence number that is written to the buffer
+class FakeClient
+{
+public:
+    void transact(uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count,
+                  void *buffer, micros_t timeout, TFModbusTCPClientTransactionCallback &&callback)
+    {
+        (void)function_code;
+        (void)data_count;
+        (void)timeout;
+
+        *static_cast<uint16_t *>(buffer) = start_address;
+        ++transaction_count;
+
+        callback(unit_id == 0 ? TFModbusTCPClientTransactionResult::Success : TFModbusTCPClientTransactionResult::Timeout,
+                 unit_id == 0 ? nullptr : "timeout");
+    }
+
+    size_t transaction_count = 0; // ticking thread only
+};
+
+// Several producers post into a small queue that is full most of the time.
+// Every function runs exactly once and functions of the same producer run in
+// the order they were posted
+static void test_multi_producer()
+{
+    TFGenericTCPSubmitQueue queue(16);
+    size_t next_value[PRODUCER_COUNT] = {};
+    std::atomic<size_t> full_count{0};
+    size_t run_count = 0;
+    std::vector<std::thread> producers;
+
+    for (size_t p = 0; p < PRODUCER_COUNT; ++p) {
+        producers.emplace_back([&queue, &next_value, &full_count, &run_count, p]() {
+            for (size_t i = 0; i < POST_COUNT; ++i) {
+                while (!queue.post([&next_value, &run_count, p, i]() {
+                    check(next_value[p] == i);
+                    next_value[p] = i + 1;
+                    ++run_count;
+                })) {
+                    full_count.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    while (run_count < PRODUCER_COUNT * POST_COUNT) {
+        if (queue.drain() == 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+
+    check(queue.drain() == 0);
+
+    for (size_t p = 0; p < PRODUCER_COUNT; ++p) {
+        check(next_value[p] == POST_COUNT);
+    }
+
+    printf("multi producer: %zu posts, %zu full\n", static_cast<size_t>(PRODUCER_COUNT * POST_COUNT), full_count.load());
+}
+
+// Each submitting thread has its own completion queue, the network thread
+// pushes completions into all of them. Both queues are small, so that submits
+// fail because all completion slots are reserved and because the submit queue
+// is full, which has to give the reserved slot back
+static void test_completions()
+{
+    TFGenericTCPSubmitQueue queue(4);
+    FakeClient client;
+    std::atomic<bool> running{true};
+    std::atomic<size_t> done_count{0};
+
+    std::thread network([&queue, &running]() {
+        while (running.load(std::memory_order_acquire)) {
+            if (queue.drain() == 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        queue.drain();
+    });
+
+    std::vector<std::thread> submitters;
+
+    for (size_t s = 0; s < SUBMITTER_COUNT; ++s) {
+        submitters.emplace_back([&queue, &client, &done_count, s]() {
+            TFGenericTCPCompletionQueue completion_queue(8);
+            std::thread::id submitter_id = std::this_thread::get_id();
+            uint16_t buffer[8]; // one per completion slot
+            size_t completed_count = 0;
+            size_t rejected_count = 0;
+
+            for (size_t i = 0; i < SUBMIT_COUNT; ++i) {
+                uint16_t sequence = static_cast<uint16_t>(i);
+
+                while (!tf_modbus_tcp_submit_transact(&queue, &client, static_cast<uint8_t>(s), TFModbusTCPFunctionCode::ReadHoldingRegisters,
+                                                      sequence, 1, &buffer[sequence % 8], 1_s,
+                [&completed_count, &buffer, submitter_id, s, sequence](TFModbusTCPClientTransactionResult result, const char *error_message) {
+                    check(std::this_thread::get_id() == submitter_id);
+                    check(result == (s == 0 ? TFModbusTCPClientTransactionResult::Success : TFModbusTCPClientTransactionResult::Timeout));
+                    check(s == 0 ? error_message == nullptr : strcmp(error_message, "timeout") == 0);
+                    check(buffer[sequence % 8] == sequence);
+                    ++completed_count;
+                }, &completion_queue)) {
+                    ++rejected_count;
+                    completion_queue.poll();
+                    std::this_thread::yield();
+                }
+            }
+
+            while (completed_count < SUBMIT_COUNT) {
+                if (completion_queue.poll() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+
+            check(completion_queue.poll() == 0);
+
+            // All slots are free again, including those of rejected submits
+            for (size_t i = 0; i < 8; ++i) {
+                check(completion_queue.reserve());
+            }
+
+            check(!completion_queue.reserve());
+
+            printf("submitter %zu: %zu submits, %zu rejected\n", s, static_cast<size_t>(SUBMIT_COUNT), rejected_count);
+            done_count.fetch_add(1);
+        });
+    }
+
+    for (std::thread &submitter : submitters) {
+        submitter.join();
+    }
+
+    running.store(false, std::memory_order_release);
+    network.join();
+
+    check(done_count.load() == SUBMITTER_COUNT);
+    check(client.transaction_count == SUBMITTER_COUNT * SUBMIT_COUNT);
+}
+
+int main()
+{
+    test_multi_producer();
+    test_completions();
+
+    printf("%s\n", failure_count == 0 ? "all checks passed" : "some checks failed");
+
+    return failure_count == 0 ? 0 : 1;
+}
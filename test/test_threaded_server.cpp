@@ -0,0 +1,239 @@
+/* TFNetwork
+ * Copyright (C) 2024 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <sys/select.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include "../src/TFNetwork.h"
+#include "../src/TFModbusTCPClient.h"
+#include "../src/TFModbusTCPThreadedServer.h"
+
+#define PORT 1502
+#define CLIENT_COUNT 16
+#define REGISTER_COUNT 64
+#define DURATION 3_s
+
+micros_t now_us()
+{
+    struct timeval tv;
+    static int64_t baseline_sec = 0;
+
+    gettimeofday(&tv, nullptr);
+
+    if (baseline_sec == 0) {
+        baseline_sec = tv.tv_sec;
+    }
+
+    return micros_t{(static_cast<int64_t>(tv.tv_sec) - baseline_sec) * 1000000 + tv.tv_usec};
+}
+
+// Block instead of spinning, so that client threads don't starve the server workers of CPU time
+static void wait_for_socket(TFModbusTCPClient *client)
+{
+    if (client->is_send_pending()) {
+        return;
+    }
+
+    bool writable;
+    int fd = client->get_wait_socket_fd(&writable);
+
+    if (fd < 0) {
+        usleep(100);
+        return;
+    }
+
+    fd_set fds;
+    struct timeval timeout;
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 10000;
+
+    select(fd + 1, writable ? nullptr : &fds, writable ? &fds : nullptr, nullptr, &timeout);
+}
+
+// Each client thread owns one client and reads back to back for the duration
+static void run_client(std::atomic<bool> *started, std::atomic<uint32_t> *request_count, std::atomic<uint32_t> *error_count)
+{
+    TFModbusTCPClient client(TFModbusTCPByteOrder::Host);
+    bool connected = false;
+    uint16_t buffer[REGISTER_COUNT];
+
+    client.connect("127.0.0.1", PORT,
+    [&connected](TFGenericTCPClientConnectResult result, int error_number) {
+        if (result != TFGenericTCPClientConnectResult::Connected) {
+            TFNetwork::logfln("connect failed: %s / %s (%d)",
+                              get_tf_generic_tcp_client_connect_result_name(result),
+                              strerror(error_number),
+                              error_number);
+            exit(1);
+        }
+
+        connected = true;
+    },
+    [](TFGenericTCPClientDisconnectReason reason, int error_number) {
+        (void)reason;
+        (void)error_number;
+    });
+
+    while (!connected) {
+        client.tick();
+        usleep(100);
+    }
+
+    while (!started->load()) {
+        usleep(100);
+    }
+
+    micros_t deadline = calculate_deadline(DURATION);
+
+    while (!deadline_elapsed(deadline)) {
+        bool done = false;
+
+        client.transact(1, TFModbusTCPFunctionCode::ReadHoldingRegisters, 1000, REGISTER_COUNT, buffer, 1_s,
+        [&done, request_count, error_count](TFModbusTCPClientTransactionResult result, const char *error_message) {
+            (void)error_message;
+
+            if (result == TFModbusTCPClientTransactionResult::Success) {
+                ++*request_count;
+            }
+            else {
+                ++*error_count;
+            }
+
+            done = true;
+        });
+
+        while (!done) {
+            client.tick();
+
+            if (!done) {
+                wait_for_socket(&client);
+            }
+        }
+    }
+
+    client.disconnect();
+}
+
+int main()
+{
+    TFNetwork::vlogfln =
+    [](const char *format, va_list args) {
+        vprintf(format, args);
+        puts("");
+    };
+
+    // Called from all client threads, so avoid gethostbyname()
+    TFNetwork::resolve =
+    [](const char *host, std::function<void(uint32_t host_address, int error_number)> &&callback) {
+        in_addr_t address = inet_addr(host);
+
+        if (address == INADDR_NONE) {
+            callback(0, EINVAL);
+        }
+        else {
+            callback(address, 0);
+        }
+    };
+
+    TFNetwork::get_random_uint16 =
+    []() {
+        uint16_t r;
+
+        if (getrandom(&r, sizeof(r), 0) != sizeof(r)) {
+            abort();
+        }
+
+        return r;
+    };
+
+    // Set the time baseline before any thread reads it
+    now_us();
+
+    size_t worker_counts[] = {1, 2, 4, 8};
+
+    for (size_t worker_count : worker_counts) {
+        TFModbusTCPThreadedServer server(TFModbusTCPByteOrder::Host, worker_count, CLIENT_COUNT);
+
+        if (!server.start(0, PORT,
+        [](uint32_t peer_address, uint16_t port) {
+            (void)peer_address;
+            (void)port;
+        },
+        [](uint32_t peer_address, uint16_t port, TFModbusTCPServerDisconnectReason reason, int error_number) {
+            (void)peer_address;
+            (void)port;
+            (void)reason;
+            (void)error_number;
+        },
+        [](uint8_t unit_id, TFModbusTCPFunctionCode function_code, uint16_t start_address, uint16_t data_count, void *data_values) {
+            (void)unit_id;
+            (void)function_code;
+
+            // Called from all worker threads, only touches the request
+            for (uint16_t i = 0; i < data_count; ++i) {
+                static_cast<uint16_t *>(data_values)[i] = start_address + i;
+            }
+
+            return TFModbusTCPExceptionCode::Success;
+        })) {
+            TFNetwork::logfln("server start failed: %s (%d)", strerror(errno), errno);
+            return 1;
+        }
+
+        std::atomic<bool> started{false};
+        std::atomic<uint32_t> request_count{0};
+        std::atomic<uint32_t> error_count{0};
+        std::vector<std::thread> clients;
+
+        for (size_t i = 0; i < CLIENT_COUNT; ++i) {
+            clients.emplace_back(run_client, &started, &request_count, &error_count);
+        }
+
+        usleep(200000);
+        started.store(true);
+
+        for (std::thread &client : clients) {
+            client.join();
+        }
+
+        server.stop();
+
+        TFNetwork::logfln("workers %zu clients %d: %8.0f requests/s, %u errors",
+                          worker_count, CLIENT_COUNT,
+                          request_count.load() / (static_cast<int64_t>(DURATION) / 1000000.0),
+                          error_count.load());
+    }
+
+    return 0;
+}